@@ -0,0 +1,88 @@
+/*
+ * calendar.c
+ *
+ * Integer date arithmetic
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* These are Howard Hinnant's algorithms
+ * (https://howardhinnant.github.io/date_algorithms.html), which shift the
+ * start of the year to 1st March so that the leap day comes at the end.
+ * Then the month lengths follow a simple pattern, and everything is a
+ * fixed sequence of integer operations with no tables, loops or state.
+ * They are only used for years after 1970, so the eras (400-year cycles)
+ * are never negative. */
+
+#include <pico/stdlib.h>
+
+#include "calendar.h"
+
+#define DAYS_PER_ERA 146097
+#define UNIX_EPOCH 719468       /* 1970-01-01, in days since 0000-03-01 */
+
+
+int32_t days_from_civil(int year, int month, int day)
+{
+    uint32_t y = year - (month <= 2);
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era*400;
+    uint32_t mp = (month + 9) % 12;     /* March = 0 */
+    uint32_t doy = (153*mp + 2)/5 + day - 1;
+    uint32_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+
+    return era*DAYS_PER_ERA + doe - UNIX_EPOCH;
+}
+
+
+void civil_from_days(int32_t days, int *year, int *month, int *day)
+{
+    uint32_t z = days + UNIX_EPOCH;
+    uint32_t era = z / DAYS_PER_ERA;
+    uint32_t doe = z - era*DAYS_PER_ERA;
+    uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+    uint32_t mp = (5*doy + 2)/153;
+    uint32_t m = (mp + 2) % 12 + 1;
+
+    *day = doy - (153*mp + 2)/5 + 1;
+    *month = m;
+    *year = yoe + era*400 + (m <= 2);
+}
+
+
+/* 1970-01-01 was a Thursday */
+int weekday_from_days(int32_t days)
+{
+    return (days + 4) % 7;
+}
+
+
+/* Returns the day number of the last given weekday of the month */
+int32_t last_weekday_of_month(int year, int month, int weekday)
+{
+    int32_t last;
+
+    if ( month == 12 ) {
+        last = days_from_civil(year+1, 1, 1) - 1;
+    } else {
+        last = days_from_civil(year, month+1, 1) - 1;
+    }
+    return last - (weekday_from_days(last) - weekday + 7) % 7;
+}
@@ -0,0 +1,30 @@
+/*
+ * calendar.h
+ *
+ * Integer date arithmetic
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Days are counted from 1970-01-01 (day 0), in the proleptic Gregorian
+ * calendar.  Weekdays are 0..6 for Sunday..Saturday, like datetime_t. */
+extern int32_t days_from_civil(int year, int month, int day);
+extern void civil_from_days(int32_t days, int *year, int *month, int *day);
+extern int weekday_from_days(int32_t days);
+extern int32_t last_weekday_of_month(int year, int month, int weekday);
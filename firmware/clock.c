@@ -0,0 +1,276 @@
+/*
+ * clock.c
+ *
+ * Sub-second UTC timebase, extrapolated from the Pico's timer
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* There is one timebase: UTC is time_us_64() plus an offset.  Each source
+ * of the time (NTP, DS3231, console...) provides samples, and the offset
+ * comes from whichever source currently has the smallest error bound.
+ *
+ * A source's error bound grows from the moment of the sample at the rate
+ * of the Pico's crystal error.  That rate is the same for every source,
+ * so the order only changes when a new sample arrives - which is when
+ * the choice is made.  Reading the time is just an addition.
+ *
+ * Conversion to calendar time (datetime_t) should only happen at the
+ * edges: the schedule, the console and the DS3231 registers.
+ */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+
+#include "calendar.h"
+#include "clock.h"
+
+/* Beyond this, we don't claim to be synchronised any more */
+#define MAX_DISPERSION_US 1000000
+
+struct clock_sample
+{
+    int valid;
+    int64_t offset_us;          /* UTC minus time_us_64() */
+    uint64_t local_us;          /* time_us_64() at the sample */
+    uint32_t error_us;          /* Error bound at the sample */
+};
+
+static struct clock_sample sources[CLOCK_NUM_SOURCES];
+static int selected = CLOCK_SRC_NONE;
+static int64_t offset_us;
+static uint64_t offset_local_us;
+
+/* Measured frequency error of time_us_64() (fast is positive, units of
+ * 2^-32), and the resulting drift between samples */
+static int64_t freq_q32 = 0;
+static uint32_t drift_ppm = CLOCK_DRIFT_PPM;
+
+/* Extra details from NTP, for our own NTP server and the status */
+static int ntp_stratum;
+static uint32_t ntp_refid;
+static uint32_t ntp_root_delay_us;
+
+static const char *source_names[] = {"none", "console", "retained",
+                                     "DS3231", "NTP"};
+
+
+static uint32_t error_at(const struct clock_sample *s, uint64_t local_us)
+{
+    uint64_t err = s->error_us + (local_us - s->local_us)*drift_ppm/1000000;
+    if ( err > UINT32_MAX ) return UINT32_MAX;
+    return err;
+}
+
+
+static void select_source()
+{
+    uint64_t now = time_us_64();
+    uint32_t best_err = UINT32_MAX;
+    int i;
+
+    selected = CLOCK_SRC_NONE;
+    for ( i=1; i<CLOCK_NUM_SOURCES; i++ ) {
+        uint32_t err;
+        if ( !sources[i].valid ) continue;
+        err = error_at(&sources[i], now);
+        if ( (selected == CLOCK_SRC_NONE) || (err < best_err) ) {
+            selected = i;
+            best_err = err;
+        }
+    }
+    if ( selected != CLOCK_SRC_NONE ) {
+        offset_us = sources[selected].offset_us;
+        offset_local_us = sources[selected].local_us;
+    }
+}
+
+
+/* Call when 'source' says that local time 'local_us' (from time_us_64())
+ * corresponds to 'utc_us' microseconds since 1970, give or take
+ * 'error_us' */
+void clock_set(int source, uint64_t utc_us, uint64_t local_us,
+               uint32_t error_us)
+{
+    int old = selected;
+
+    if ( (source <= CLOCK_SRC_NONE) || (source >= CLOCK_NUM_SOURCES) ) return;
+
+    sources[source].offset_us = utc_us - local_us;
+    sources[source].local_us = local_us;
+    sources[source].error_us = error_us;
+    sources[source].valid = 1;
+    select_source();
+
+    if ( selected != old ) {
+        printf("Time source is now %s\n", source_names[selected]);
+    }
+}
+
+
+/* NTP client's version of clock_set() */
+void clock_sync(uint64_t utc_us, uint64_t local_us, int stratum,
+                uint32_t refid, uint32_t root_delay_us,
+                uint32_t root_disp_us)
+{
+    ntp_stratum = stratum;
+    ntp_refid = refid;
+    ntp_root_delay_us = root_delay_us;
+    clock_set(CLOCK_SRC_NTP, utc_us, local_us,
+              root_delay_us/2 + root_disp_us);
+}
+
+
+/* Call with a measurement of the crystal's frequency error, relative to
+ * something better, and the error bound for time extrapolated using it */
+void clock_set_freq(int64_t new_freq_q32, uint32_t new_drift_ppm)
+{
+    freq_q32 = new_freq_q32;
+    drift_ppm = new_drift_ppm;
+}
+
+
+/* Convert a value from time_us_64() to UTC.  Returns zero if there is no
+ * source of the time yet */
+uint64_t clock_utc_us(uint64_t local_us)
+{
+    int64_t since;
+    if ( selected == CLOCK_SRC_NONE ) return 0;
+    since = local_us - offset_local_us;
+    return local_us + offset_us - ((since * freq_q32) >> 32);
+}
+
+
+/* Difference between the time according to 'source' and the time we're
+ * using.  Returns non-zero if either is missing */
+int clock_compare(int source, int64_t *diff_us)
+{
+    const struct clock_sample *s;
+    uint64_t now = time_us_64();
+    int64_t since;
+
+    if ( (source <= CLOCK_SRC_NONE) || (source >= CLOCK_NUM_SOURCES) ) {
+        return 1;
+    }
+    s = &sources[source];
+    if ( !s->valid || (selected == CLOCK_SRC_NONE) ) return 1;
+
+    since = now - s->local_us;
+    *diff_us = now + s->offset_us - ((since * freq_q32) >> 32)
+             - clock_utc_us(now);
+    return 0;
+}
+
+
+uint64_t clock_now_us()
+{
+    return clock_utc_us(time_us_64());
+}
+
+
+int clock_source()
+{
+    return selected;
+}
+
+
+uint32_t clock_error_us()
+{
+    if ( selected == CLOCK_SRC_NONE ) return UINT32_MAX;
+    return error_at(&sources[selected], time_us_64());
+}
+
+
+void clock_get_status(struct clock_status *st)
+{
+    const struct clock_sample *s = &sources[selected];
+
+    st->source = selected;
+    if ( selected == CLOCK_SRC_NONE ) {
+        st->synced = 0;
+        st->stratum = 16;
+        st->refid = 0;
+        st->ref_time = 0;
+        st->root_delay_us = 0;
+        st->root_disp_us = MAX_DISPERSION_US;
+        return;
+    }
+
+    st->ref_time = s->local_us + s->offset_us;
+    st->root_disp_us = clock_error_us();
+
+    /* Only NTP counts as synchronised, as far as other NTP clients (and
+     * the status display) are concerned */
+    if ( selected == CLOCK_SRC_NTP ) {
+        st->stratum = ntp_stratum + 1;
+        st->refid = ntp_refid;
+        st->root_delay_us = ntp_root_delay_us;
+    } else {
+        st->stratum = 16;
+        st->refid = 0;
+        st->root_delay_us = 0;
+    }
+    st->synced = (st->root_disp_us < MAX_DISPERSION_US) && (st->stratum < 16);
+}
+
+
+void clock_to_datetime(uint64_t utc_us, datetime_t *t)
+{
+    uint32_t secs = utc_us / 1000000;
+    uint32_t days = secs / 86400;
+    uint32_t sod = secs - days*86400;
+    int y, m, d;
+
+    civil_from_days(days, &y, &m, &d);
+    t->year = y;
+    t->month = m;
+    t->day = d;
+    t->dotw = weekday_from_days(days);
+    t->hour = sod / 3600;
+    t->min = (sod / 60) % 60;
+    t->sec = sod % 60;
+}
+
+
+/* Ignores t->dotw */
+uint64_t clock_from_datetime(const datetime_t *t)
+{
+    uint32_t days = days_from_civil(t->year, t->month, t->day);
+    uint32_t secs = days*86400 + t->hour*3600 + t->min*60 + t->sec;
+    return (uint64_t)secs * 1000000;
+}
+
+
+void clock_show()
+{
+    uint64_t now = time_us_64();
+    int i;
+
+    for ( i=1; i<CLOCK_NUM_SOURCES; i++ ) {
+        const struct clock_sample *s = &sources[i];
+        if ( !s->valid ) continue;
+        printf("%c %-8s: last sample %lli s ago, error +/- %li ms\n",
+               (i == selected) ? '*' : ' ', source_names[i],
+               (now - s->local_us)/1000000, error_at(s, now)/1000);
+    }
+    if ( selected == CLOCK_SRC_NONE ) printf("No source of the time yet\n");
+    printf("Crystal correction %+li ppb, drift +/- %li ppm\n",
+           (int32_t)((freq_q32 * 1000000000) >> 32), drift_ppm);
+}
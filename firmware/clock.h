@@ -0,0 +1,59 @@
+/*
+ * clock.h
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Where the time came from.  Also sent in struct mt_status. */
+#define CLOCK_SRC_NONE 0
+#define CLOCK_SRC_CONSOLE 1     /* Typed in with 'set' */
+#define CLOCK_SRC_RETAINED 2    /* Carried over from before a restart */
+#define CLOCK_SRC_DS3231 3
+#define CLOCK_SRC_NTP 4
+#define CLOCK_NUM_SOURCES 5
+
+/* Assumed worst-case frequency error of the Pico's crystal */
+#define CLOCK_DRIFT_PPM 30
+
+struct clock_status
+{
+    int synced;
+    int source;                 /* Currently selected, CLOCK_SRC_xxx */
+    int stratum;                /* Ours, i.e. upstream + 1 */
+    uint32_t refid;             /* Upstream server address */
+    uint64_t ref_time;          /* UTC microseconds of last sample */
+    uint32_t root_delay_us;
+    uint32_t root_disp_us;      /* Including drift since last sample */
+};
+
+extern void clock_set(int source, uint64_t utc_us, uint64_t local_us,
+                      uint32_t error_us);
+extern void clock_sync(uint64_t utc_us, uint64_t local_us, int stratum,
+                       uint32_t refid, uint32_t root_delay_us,
+                       uint32_t root_disp_us);
+extern void clock_set_freq(int64_t freq_q32, uint32_t drift_ppm);
+extern uint64_t clock_utc_us(uint64_t local_us);
+extern uint64_t clock_now_us(void);
+extern int clock_compare(int source, int64_t *diff_us);
+extern int clock_source(void);
+extern uint32_t clock_error_us(void);
+extern void clock_get_status(struct clock_status *st);
+extern void clock_to_datetime(uint64_t utc_us, datetime_t *t);
+extern uint64_t clock_from_datetime(const datetime_t *t);
+extern void clock_show(void);
@@ -0,0 +1,57 @@
+/*
+ * ctl.h
+ *
+ * Messages of the control protocol, over UDP (udpctl.c) or the serial
+ * console (serialctl.c)
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define CTL_MAGIC 0x544d    /* "MT" */
+
+/* Goes up whenever the layout of a message changes, including struct
+ * mt_status and struct mt_settings.  2: OTA, I2C, clock source, holdover
+ * and energy fields added to the status. */
+#define CTL_VERSION 2
+
+#define CTL_STATUS 1
+#define CTL_GET_SETTINGS 2
+#define CTL_SET_SETTINGS 3
+#define CTL_SAVE_SETTINGS 4
+#define CTL_OTA_START 5         /* UDP only */
+#define CTL_SUBSCRIBE 6         /* Serial only */
+#define CTL_TELEMETRY 7         /* Serial only, never requested */
+#define CTL_ERROR 0x7f
+#define CTL_REPLY 0x80
+
+#define CTL_ERR_BAD_REQUEST 1
+#define CTL_ERR_NOT_PERMITTED 2
+#define CTL_ERR_BAD_SETTINGS 3
+#define CTL_ERR_OTA_REFUSED 4
+#define CTL_ERR_BAD_VERSION 5   /* The reply's header has our version */
+
+/* Every message starts with this, all fields little-endian.  Replies copy
+ * the request's sequence number and set CTL_REPLY in 'op'. */
+struct __attribute__((packed)) ctl_header
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t op;
+    uint32_t seq;
+};
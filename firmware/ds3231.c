@@ -21,16 +21,71 @@
  */
 
 
-#include <time.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <pico/stdlib.h>
-#include <hardware/rtc.h>
 #include <hardware/i2c.h>
 
 #include "settings.h"
+#include "status.h"
+#include "clock.h"
+#include "ds3231.h"
+#include "pps.h"
+#include "record.h"
+
+#define DS3231_ADDR 0x68
+#define PIN_SDA 4
+#define PIN_SCL 5
+#define I2C_BAUD 200000
+
+/* Each byte takes 45 us at 200 kHz.  Allow twice that, plus some slack
+ * for clock stretching and the start/stop conditions. */
+#define TIMEOUT_US(len) (200 + 90*(len))
+
+/* Half a clock period for the bus clear (bit-banged at 100 kHz) */
+#define CLEAR_HALF_US 5
+
+/* Writing the seconds register restarts the DS3231's countdown when it
+ * acknowledges the seconds byte.  That's the START, address, register
+ * number and seconds (28 bit times at 200 kHz) after the write begins,
+ * plus a little for the SDK. */
+#define WRITE_LEAD_US 150
+
+/* Uncertainty of an aligned write, mostly interrupt latency */
+#define WRITE_SLACK_US 50
+
+/* Don't schedule a write closer to the second boundary than this */
+#define MIN_NOTICE_US 2000
+
+/* After an NTP sync, set the DS3231 again if its 1 Hz edges show it
+ * further than this from NTP, beyond NTP's own error bound */
+#define RESET_US 2000
+
+/* Only set the DS3231 from NTP at all if NTP's error bound is at least
+ * this many times smaller than the DS3231's would be without it */
+#define SET_MARGIN 4
+
+/* DS3231 is specified to +/- 2 ppm */
+#define DS3231_DRIFT_PPM 2
 
 static int have_ds3231 = 0;
+static uint32_t worst_us = 0;
+
+/* Set by read_regs() and write_regs(), so that the aligned write (from
+ * an alarm) doesn't interrupt a transaction */
+static volatile int bus_busy = 0;
+
+/* Aligned write in progress, set up by ds3231_from_clock() */
+static volatile int write_pending = 0;
+static uint64_t write_local_us;         /* time_us_64() at the boundary */
+static uint32_t write_utc;              /* UTC second starting there */
+static uint32_t write_error_us;
+
+/* Last aligned write since boot (set_count == 0 if none) */
+static volatile uint32_t set_count = 0;
+static uint64_t set_local_us;
+static uint32_t set_error_us;
 
 uint8_t clear_bit(uint8_t byte, int bit)
 {
@@ -38,35 +93,144 @@ uint8_t clear_bit(uint8_t byte, int bit)
 }
 
 
+static void bus_init()
+{
+    i2c_init(i2c_default, I2C_BAUD);
+    gpio_set_function(PIN_SDA, GPIO_FUNC_I2C);
+    gpio_set_function(PIN_SCL, GPIO_FUNC_I2C);
+    gpio_pull_up(PIN_SDA);
+    gpio_pull_up(PIN_SCL);
+}
+
+
+/* Open-drain by hand: drive low, or let the pull-up have it */
+static void od_set(int pin, int high)
+{
+    gpio_set_dir(pin, high ? GPIO_IN : GPIO_OUT);
+    busy_wait_us_32(CLEAR_HALF_US);
+}
+
+
+/* If the DS3231 was interrupted half way through sending a byte, it
+ * will hold SDA low until it gets enough clocks to finish.  Nine clocks
+ * are always enough, then a STOP puts everything back to idle. */
+static void bus_clear()
+{
+    int i;
+
+    i2c_deinit(i2c_default);
+    gpio_init(PIN_SDA);
+    gpio_init(PIN_SCL);
+    gpio_put(PIN_SDA, 0);
+    gpio_put(PIN_SCL, 0);
+    od_set(PIN_SDA, 1);
+    od_set(PIN_SCL, 1);
+
+    for ( i=0; i<9; i++ ) {
+        if ( gpio_get(PIN_SDA) ) break;
+        od_set(PIN_SCL, 0);
+        od_set(PIN_SCL, 1);
+    }
+
+    /* STOP: SDA rises while SCL is high */
+    od_set(PIN_SCL, 0);
+    od_set(PIN_SDA, 0);
+    od_set(PIN_SCL, 1);
+    od_set(PIN_SDA, 1);
+
+    bus_init();
+}
+
+
+/* Reads 'len' registers starting at 'reg'.  Every part has a timeout, so
+ * the worst case is TIMEOUT_US(1) + TIMEOUT_US(len), plus about 150 us
+ * for the bus clear after a failure. */
+static int read_regs(uint8_t reg, uint8_t *buf, size_t len)
+{
+    uint64_t t0 = time_us_64();
+    uint32_t dt;
+    int r;
+
+    bus_busy = 1;
+
+    r = i2c_write_timeout_us(i2c_default, DS3231_ADDR, &reg, 1, true,
+                             TIMEOUT_US(1));
+    if ( r == 1 ) {
+        r = i2c_read_timeout_us(i2c_default, DS3231_ADDR, buf, len, false,
+                                TIMEOUT_US(len));
+    }
+
+    if ( r != (int)len ) {
+        counters.i2c_errors++;
+        bus_clear();
+    }
+    bus_busy = 0;
+
+    dt = time_us_64() - t0;
+    if ( dt > worst_us ) worst_us = dt;
+    return (r == (int)len) ? 0 : 1;
+}
+
+
+/* Writes registers, starting with the one given in buf[0] */
+static int write_regs(const uint8_t *buf, size_t len)
+{
+    uint64_t t0 = time_us_64();
+    uint32_t dt;
+    int r;
+
+    bus_busy = 1;
+
+    r = i2c_write_timeout_us(i2c_default, DS3231_ADDR, buf, len, false,
+                             TIMEOUT_US(len));
+    if ( r != (int)len ) {
+        counters.i2c_errors++;
+        bus_clear();
+    }
+    bus_busy = 0;
+
+    dt = time_us_64() - t0;
+    if ( dt > worst_us ) worst_us = dt;
+    return (r == (int)len) ? 0 : 1;
+}
+
+
 static int clear_32khz_bit()
 {
     uint8_t buf[2];
-    int r;
 
-    buf[0] = 0x0f;
-    i2c_write_blocking(i2c_default, 0x68, buf, 1, true);
-    r = i2c_read_blocking(i2c_default, 0x68, buf, 1, false);
-    if ( r == PICO_ERROR_GENERIC ) {
+    if ( read_regs(0x0f, buf+1, 1) ) {
         printf("ds3231 not found\n");
         return 0;
     }
 
-    buf[1] = clear_bit(buf[0], 3);
     buf[0] = 0x0f;
-    i2c_write_blocking(i2c_default, 0x68, buf, 2, false);
+    buf[1] = clear_bit(buf[1], 3);
+    write_regs(buf, 2);
     return 1;
 }
 
 
-void ds3231_init()
+/* INTCN=0 and RS2=RS1=0 gives a 1 Hz square wave on INT/SQW, for pps.c */
+static void enable_1hz()
 {
-    i2c_init(i2c0, 200000);
-    gpio_set_function(4, GPIO_FUNC_I2C);
-    gpio_set_function(5, GPIO_FUNC_I2C);
-    gpio_pull_up(4);
-    gpio_pull_up(5);
+    uint8_t buf[2];
 
+    if ( read_regs(0x0e, buf+1, 1) ) return;
+
+    buf[0] = 0x0e;
+    buf[1] = clear_bit(buf[1], 4);
+    buf[1] = clear_bit(buf[1], 3);
+    buf[1] = clear_bit(buf[1], 2);
+    write_regs(buf, 2);
+}
+
+
+void ds3231_init()
+{
+    bus_init();
     have_ds3231 = clear_32khz_bit();
+    if ( have_ds3231 ) enable_1hz();
 }
 
 
@@ -82,14 +246,25 @@ static int from_bcd(uint8_t n)
 }
 
 
-void set_ds3231_from_picortc()
+static int64_t write_handler(alarm_id_t id, void *user_data)
 {
     uint8_t buf[8];
-    datetime_t t = {0};
+    datetime_t t;
+    uint64_t now;
 
-    if ( !have_ds3231 ) return;
+    /* Try again at the next second if the main loop is using the bus */
+    if ( bus_busy ) {
+        write_local_us += 1000000;
+        write_utc++;
+        return 1000000;
+    }
 
-    rtc_get_datetime(&t);
+    now = time_us_64();
+    if ( now < write_local_us - WRITE_LEAD_US ) {
+        busy_wait_us_32(write_local_us - WRITE_LEAD_US - now);
+    }
+
+    clock_to_datetime((uint64_t)write_utc*1000000, &t);
 
     buf[0] = 0;
     buf[1] = to_bcd(t.sec);
@@ -100,23 +275,97 @@ void set_ds3231_from_picortc()
     buf[6] = to_bcd(t.month);
     buf[7] = to_bcd(t.year%100);
 
-    i2c_write_blocking(i2c_default, 0x68, buf, 8, true);
+    if ( write_regs(buf, 8) == 0 ) {
+        set_local_us = write_local_us;
+        set_error_us = write_error_us + WRITE_SLACK_US;
+        set_count++;
+    }
+    write_pending = 0;
+    return 0;
+}
+
+
+/* Sets the DS3231 at the start of the next second, from an alarm, so that
+ * its seconds tick over at the same time as ours.  Returns non-zero if
+ * there is no DS3231 or nothing to set it to */
+int ds3231_from_clock()
+{
+    uint64_t local = time_us_64();
+    uint64_t utc = clock_utc_us(local);
+    uint32_t to_go;
+
+    if ( !have_ds3231 || (utc == 0) || write_pending ) return 1;
+
+    to_go = 1000000 - utc % 1000000;
+    if ( to_go < MIN_NOTICE_US ) to_go += 1000000;
+
+    write_local_us = local + to_go;
+    write_utc = (utc + to_go) / 1000000;
+    write_error_us = clock_error_us();
+    write_pending = 1;
+    add_alarm_in_us(to_go - WRITE_LEAD_US - MIN_NOTICE_US/2, write_handler,
+                    NULL, true);
+    return 0;
+}
+
+
+/* Number of times the DS3231 has been set since boot */
+uint32_t ds3231_set_count()
+{
+    return set_count;
+}
+
+
+/* Error bound for the start of each DS3231 second */
+uint32_t ds3231_error_us()
+{
+    uint64_t since;
+
+    if ( set_count == 0 ) return DS3231_ERROR_US;
+    since = time_us_64() - set_local_us;
+    return set_error_us + since*DS3231_DRIFT_PPM/1000000;
+}
+
+
+/* Call after each NTP sync.  Sets the DS3231 the first time NTP is good
+ * enough, then only if its 1 Hz edges say that it's wandered off by more
+ * than NTP's error bound can explain */
+void ds3231_check_ntp()
+{
+    int64_t diff;
+    uint32_t err;
+
+    if ( !have_ds3231 || (clock_source() != CLOCK_SRC_NTP) ) return;
+    err = clock_error_us();
+
+    if ( set_count == 0 ) {
+        if ( err > DS3231_ERROR_US/SET_MARGIN ) return;
+    } else {
+        if ( !pps_locked() ) return;
+        if ( clock_compare(CLOCK_SRC_DS3231, &diff) ) return;
+        if ( (diff <= (int64_t)err + RESET_US)
+          && (diff >= -(int64_t)err - RESET_US) ) return;
+        printf("DS3231 is %lli us from NTP (+/- %li us), setting it again\n",
+               diff, err);
+    }
+    ds3231_from_clock();
 }
 
 
 int ds3231_get_datetime(datetime_t *t)
 {
-    uint8_t buf[7];
-    int r;
+    uint8_t rec[10];
+    uint8_t *buf = rec+3;
+    uint64_t t0 = time_us_64();
+    uint16_t dt;
 
     if ( !have_ds3231 ) return 1;
 
-    buf[0] = 0x00;
-    i2c_write_blocking(i2c_default, 0x68, buf, 1, true);
-    r = i2c_read_blocking(i2c_default, 0x68, buf, 7, false);
-    if ( r == PICO_ERROR_GENERIC ) {
-        return 1;
-    }
+    rec[0] = (read_regs(0x00, buf, 7) == 0);
+    dt = time_us_64() - t0;
+    memcpy(rec+1, &dt, 2);
+    record_input(REC_DS3231, rec, rec[0] ? 10 : 3);
+    if ( !rec[0] ) return 1;
 
     t->year = 2000+from_bcd(buf[6]);
     t->month = from_bcd(buf[5] & 0x1f);
@@ -130,12 +379,16 @@ int ds3231_get_datetime(datetime_t *t)
 }
 
 
-int set_picortc_from_ds3231()
+/* Gives the DS3231 time to the clock core.  It only counts whole seconds,
+ * so assume we're half way through one. */
+int ds3231_to_clock()
 {
     datetime_t t;
-    if ( !have_ds3231 ) return 1;
-    ds3231_get_datetime(&t);
-    rtc_set_datetime(&t);
+    uint64_t local = time_us_64();
+
+    if ( ds3231_get_datetime(&t) ) return 1;
+    clock_set(CLOCK_SRC_DS3231, clock_from_datetime(&t) + 500000, local,
+              DS3231_ERROR_US);
     return 0;
 }
 
@@ -146,17 +399,11 @@ static signed int conv_signed(uint8_t lsb)
 }
 
 
+/* Two's complement in quarter degrees, in the top 10 bits, so the
+ * fraction is added even when the whole part is negative */
 static float conv_temp(uint8_t msb, uint8_t lsb)
 {
-    float t = conv_signed(msb);
-    if ( t < 0 ) {
-        if ( lsb & 1<<7 ) t -= 0.5;
-        if ( lsb & 1<<6 ) t -= 0.25;
-    } else {
-        if ( lsb & 1<<7 ) t += 0.5;
-        if ( lsb & 1<<6 ) t += 0.25;
-    }
-    return t;
+    return (int16_t)((msb << 8) | lsb) / 256.0f;
 }
 
 
@@ -173,11 +420,7 @@ static void print_flag(uint8_t byte, int bit, const char *name)
 int ds3231_osf_set()
 {
     uint8_t buf[19];
-    int r;
-    buf[0] = 0x00;
-    i2c_write_blocking(i2c_default, 0x68, buf, 1, true);
-    r = i2c_read_blocking(i2c_default, 0x68, buf, 19, false);
-    if ( r == PICO_ERROR_GENERIC ) {
+    if ( read_regs(0x00, buf, 19) ) {
         printf("DS3231 not found\n");
         return 0;
     }
@@ -188,14 +431,16 @@ int ds3231_osf_set()
 void ds3231_status()
 {
     uint8_t buf[19];
-    int j;
-    int r;
     datetime_t t;
 
-    buf[0] = 0x00;
-    i2c_write_blocking(i2c_default, 0x68, buf, 1, true);
-    r = i2c_read_blocking(i2c_default, 0x68, buf, 19, false);
-    if ( r == PICO_ERROR_GENERIC ) {
+    printf("I2C errors: %li, slowest transaction: %li us\n",
+           counters.i2c_errors, worst_us);
+    if ( set_count > 0 ) {
+        printf("Set %lli s ago, error now +/- %li us\n",
+               (time_us_64() - set_local_us)/1000000, ds3231_error_us());
+    }
+
+    if ( read_regs(0x00, buf, 19) ) {
         printf("DS3231 not found\n");
         return;
     }
@@ -209,7 +454,8 @@ void ds3231_status()
     t.sec = from_bcd(buf[0]);
     printf("Time: %2i:%2i:%2i  Date: %i/%i/%i  DoW=%i\n",
             t.hour, t.min, t.sec, t.day, t.month, t.year, t.dotw);
-    printf("Offset to local time: %i + %i\n", settings.utc_offset, dst(t));
+    printf("Offset to local time: %i + %i\n", settings.utc_offset,
+           dst(clock_from_datetime(&t)/1000000));
 
     printf("Flags: ");
     print_flag(buf[14], 7, "/EOSC");
@@ -230,22 +476,32 @@ void ds3231_status()
 }
 
 
+/* Get the oscillator stop flag and temperature (in 1/100 degC) */
+int ds3231_get_flags(int *osf, int16_t *temp)
+{
+    uint8_t buf[4];
+
+    if ( !have_ds3231 ) return 1;
+    if ( read_regs(0x0f, buf, 4) ) return 1;
+
+    *osf = (buf[0] & 1<<7) != 0;
+    *temp = conv_temp(buf[2], buf[3]) * 100;
+    return 0;
+}
+
+
 void ds3231_reset_osf()
 {
     uint8_t buf[2];
-    int r;
 
-    buf[0] = 0x0f;
-    i2c_write_blocking(i2c_default, 0x68, buf, 1, true);
-    r = i2c_read_blocking(i2c_default, 0x68, buf, 1, false);
-    if ( r == PICO_ERROR_GENERIC ) {
+    if ( read_regs(0x0f, buf+1, 1) ) {
         printf("ds3231 not found\n");
         return;
     }
 
-    buf[1] = clear_bit(buf[0], 7);
     buf[0] = 0x0f;
-    i2c_write_blocking(i2c_default, 0x68, buf, 2, false);
+    buf[1] = clear_bit(buf[1], 7);
+    write_regs(buf, 2);
 }
 
 
@@ -253,3 +509,10 @@ int ds3231_found()
 {
     return have_ds3231;
 }
+
+
+/* Longest time taken by any DS3231 transaction, including recovery */
+uint32_t ds3231_worst_us()
+{
+    return worst_us;
+}
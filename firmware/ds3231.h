@@ -20,11 +20,20 @@
  *
  */
 
+/* Half a second for the unknown fraction, and some margin for the
+ * DS3231's own drift since it was last set */
+#define DS3231_ERROR_US 600000
+
 extern void ds3231_init(void);
 extern void ds3231_status(void);
 extern void ds3231_reset_osf(void);
-extern int set_picortc_from_ds3231(void);
-extern void set_ds3231_from_picortc(void);
+extern int ds3231_to_clock(void);
+extern int ds3231_from_clock(void);
+extern void ds3231_check_ntp(void);
+extern uint32_t ds3231_set_count(void);
+extern uint32_t ds3231_error_us(void);
 extern int ds3231_get_datetime(datetime_t *t);
 extern int ds3231_found(void);
 extern int ds3231_osf_set(void);
+extern int ds3231_get_flags(int *osf, int16_t *temp);
+extern uint32_t ds3231_worst_us(void);
@@ -0,0 +1,160 @@
+/*
+ * energy.c
+ *
+ * Time spent in each power state, and the charge used
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Each state's level is integrated over time whenever it changes, so
+ * nothing needs to be polled.  The charge estimate is then the sleeping
+ * current for the whole uptime, plus the extra current for each state
+ * times its integrated level.  The currents are settings (in uA), since
+ * they depend on the board, LEDs and wireless network. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "settings.h"
+#include "energy.h"
+
+#define SLEEP 0         /* Index in mt_settings.energy_ua */
+
+_Static_assert(sizeof(settings.energy_ua)/sizeof(settings.energy_ua[0])
+               == ENERGY_NUM_STATES + 1,
+               "One current setting per state, plus the sleeping current");
+
+/* Rough figures for a Pico W, used when the setting is zero */
+static const uint16_t default_ua[] = {8000, 12000, 5000, 60000, 20000, 2000};
+
+static const char *names[] = {"asleep", "awake", "usb", "joining", "wifi",
+                              "leds"};
+
+static uint64_t start_us = 0;
+static int level[ENERGY_NUM_STATES] = {1, 0, 0, 0, 0};
+static uint64_t changed_us[ENERGY_NUM_STATES];
+static uint64_t level_us[ENERGY_NUM_STATES];    /* Integral of level */
+static uint64_t on_us[ENERGY_NUM_STATES];       /* Time with level > 0 */
+
+
+static void account(int state, uint64_t now)
+{
+    uint64_t dt = now - changed_us[state];
+    level_us[state] += dt * level[state];
+    if ( level[state] > 0 ) on_us[state] += dt;
+    changed_us[state] = now;
+}
+
+
+/* Call whenever the level of a state changes.  Calling it with the same
+ * level again costs almost nothing. */
+void energy_set(int state, int new_level)
+{
+    if ( new_level == level[state] ) return;
+    account(state, time_us_64());
+    level[state] = new_level;
+}
+
+
+uint64_t energy_residency_us(int state)
+{
+    account(state, time_us_64());
+    return on_us[state];
+}
+
+
+static uint32_t current_ua(int n)
+{
+    if ( settings.energy_ua[n] == 0 ) return default_ua[n];
+    return settings.energy_ua[n];
+}
+
+
+/* Average current since the last reset */
+static double average_ua()
+{
+    uint64_t now = time_us_64();
+    double ua = current_ua(SLEEP);
+    int i;
+
+    if ( now == start_us ) return ua;
+    for ( i=0; i<ENERGY_NUM_STATES; i++ ) {
+        account(i, now);
+        ua += (double)current_ua(i+1) * level_us[i] / (now - start_us);
+    }
+    return ua;
+}
+
+
+uint32_t energy_uah_per_day()
+{
+    return average_ua() * 24;
+}
+
+
+void energy_reset()
+{
+    uint64_t now = time_us_64();
+    int i;
+
+    start_us = now;
+    for ( i=0; i<ENERGY_NUM_STATES; i++ ) {
+        changed_us[i] = now;
+        level_us[i] = 0;
+        on_us[i] = 0;
+    }
+}
+
+
+void energy_show()
+{
+    uint64_t span = time_us_64() - start_us;
+    double ua = average_ua();
+    int i;
+
+    printf("Over the last %lli s: %.0f uA average, %.1f mAh per day\n",
+           span/1000000, ua, ua*24/1000);
+    printf("  %-8s %6li uA\n", names[0], current_ua(SLEEP));
+    for ( i=0; i<ENERGY_NUM_STATES; i++ ) {
+        printf("  %-8s %+6li uA  %5.1f%% of the time", names[i+1],
+               current_ua(i+1), span ? 100.0*on_us[i]/span : 0.0);
+        if ( i == ENERGY_LEDS ) {
+            printf(", %.2f lit on average", span ? (double)level_us[i]/span : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+
+/* Sets the current for a state, by name.  Returns non-zero if the name
+ * isn't known */
+int energy_set_current(const char *name, uint16_t ua)
+{
+    int i;
+
+    for ( i=0; i<=ENERGY_NUM_STATES; i++ ) {
+        if ( strcmp(name, names[i]) == 0 ) {
+            settings.energy_ua[i] = ua;
+            return 0;
+        }
+    }
+    return 1;
+}
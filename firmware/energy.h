@@ -0,0 +1,39 @@
+/*
+ * energy.h
+ *
+ * Time spent in each power state, and the charge used
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Things which use power, with a level for each: 0/1, or the number of
+ * LED channels lit */
+#define ENERGY_AWAKE 0          /* CPU running, not waiting in idle_ms() */
+#define ENERGY_USB 1            /* USB connected (and the faster loop) */
+#define ENERGY_JOINING 2        /* Radio scanning or joining */
+#define ENERGY_WIFI 3           /* Radio associated */
+#define ENERGY_LEDS 4
+#define ENERGY_NUM_STATES 5
+
+extern void energy_set(int state, int level);
+extern uint64_t energy_residency_us(int state);
+extern uint32_t energy_uah_per_day(void);
+extern void energy_reset(void);
+extern void energy_show(void);
+extern int energy_set_current(const char *name, uint16_t ua);
@@ -0,0 +1,88 @@
+/*
+ * holdover.c
+ *
+ * What to do with the LEDs when the time is too uncertain for the schedule
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Used by the main loop (morningtown.c) and the replayer (host/replay.c),
+ * so that both make the same decisions */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+
+#include "settings.h"
+#include "clock.h"
+#include "status.h"
+#include "holdover.h"
+
+static int uncertain = 0;
+static uint8_t last_sched = 0;
+
+
+/* Call on each pass of the main loop.  The error bound grows while
+ * nothing is correcting the time.  Returns non-zero if the time has just
+ * become too uncertain for the schedule, or good enough again. */
+int holdover_poll()
+{
+    if ( clock_source() == CLOCK_SRC_NONE ) return 0;
+    if ( (clock_error_us() > holdover_max_us()) == uncertain ) return 0;
+
+    uncertain = !uncertain;
+    if ( uncertain ) {
+        printf("Time might be %li s out, too far for the schedule\n",
+               clock_error_us()/1000000);
+    } else {
+        printf("Time is good enough for the schedule again\n");
+    }
+    return 1;
+}
+
+
+int holdover_uncertain()
+{
+    return uncertain;
+}
+
+
+/* Returns the LEDs to show, given what the schedule says ('sched') and
+ * what they are now */
+uint8_t holdover_leds(uint8_t sched, uint8_t current, int current_valid)
+{
+    uint8_t leds;
+    uint8_t prev = last_sched;
+
+    /* Kept up to date even while certain, so that the first change held
+     * back in the next holdover is a real one */
+    last_sched = sched;
+    if ( !uncertain ) return sched;
+
+    switch ( holdover_policy() ) {
+        case HOLDOVER_HOLD : leds = current_valid ? current : 0; break;
+        case HOLDOVER_OFF : leds = 0; break;
+        default : leds = sched; break;
+    }
+
+    /* Only count the changes which are actually held back */
+    if ( (sched != prev) && (leds != sched) ) counters.leds_held++;
+
+    return leds;
+}
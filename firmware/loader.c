@@ -0,0 +1,183 @@
+/*
+ * loader.c
+ *
+ * Finishes (or undoes) firmware updates, then starts the firmware
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The RP2040 only boots from the start of the flash, so this goes there,
+ * and is the one part which an update never touches.  Everything it needs
+ * to know is in the journal (see ota_layout.h), so that it can carry on
+ * from wherever it was when the power was cut.
+ *
+ * Each sector is exchanged in three steps, each of which only starts once
+ * the last one has been recorded, and can simply be done again if it was
+ * interrupted:
+ *
+ *   running slot -> scratch, staging -> running slot, scratch -> staging
+ *
+ * With the slots exchanged, the new firmware runs on trial, with the
+ * watchdog already running in case it hangs before it gets going.  If it
+ * restarts for any reason other than a power cut before confirming
+ * itself (ota_checkin() writes a new journal), the slots are exchanged
+ * back.  The firmware finds out by looking at the journal (ota_init()).
+ *
+ * The loader's RAM is at the top of the firmware's heap (see
+ * CMakeLists.txt), so that it doesn't disturb anything the firmware keeps
+ * across restarts (see retain.c). */
+
+#include <string.h>
+
+#include <pico/stdlib.h>
+#include <hardware/flash.h>
+#include <hardware/watchdog.h>
+#include <hardware/structs/watchdog.h>
+#include <hardware/structs/scb.h>
+
+#include "ota.h"
+#include "ota_layout.h"
+
+/* The longest the watchdog allows, about 8 seconds */
+#define TRIAL_WATCHDOG_MS 0x7fffff
+
+
+static const uint8_t *flash(uint32_t offs)
+{
+    return (const uint8_t *)(XIP_BASE + offs);
+}
+
+
+static int step_done(uint32_t log, uint32_t i, uint8_t step)
+{
+    return (flash(log)[i] & step) == 0;
+}
+
+
+/* Only clears bits, so the page doesn't need to be erased first */
+static void record_step(uint32_t log, uint32_t i, uint8_t step)
+{
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    memset(page, 0xff, FLASH_PAGE_SIZE);
+    page[i] = ~step;
+    flash_range_program(log, page, FLASH_PAGE_SIZE);
+}
+
+
+/* The two sectors are never the same, so the destination can be erased
+ * first and filled a page at a time */
+static void copy_sector(uint32_t to, uint32_t from)
+{
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t p;
+
+    flash_range_erase(to, FLASH_SECTOR_SIZE);
+    for ( p=0; p<FLASH_SECTOR_SIZE; p+=FLASH_PAGE_SIZE ) {
+        memcpy(page, flash(from+p), FLASH_PAGE_SIZE);
+        flash_range_program(to+p, page, FLASH_PAGE_SIZE);
+    }
+}
+
+
+/* Exchanges whatever is left of sectors LOADER_SECTORS to n-1, according
+ * to 'log'.  Returns the number of sectors which weren't already done. */
+static uint32_t exchange(uint32_t log, uint32_t n)
+{
+    uint32_t i;
+    uint32_t count = 0;
+
+    for ( i=LOADER_SECTORS; i<n; i++ ) {
+
+        uint32_t a = i * FLASH_SECTOR_SIZE;
+        uint32_t b = STAGING_OFFSET + a;
+
+        if ( step_done(log, i, SECTOR_DONE) ) continue;
+        count++;
+
+        if ( !step_done(log, i, SECTOR_SAVED) ) {
+            copy_sector(SCRATCH_OFFSET, a);
+            record_step(log, i, SECTOR_SAVED);
+        }
+        if ( !step_done(log, i, SECTOR_COPIED) ) {
+            copy_sector(a, b);
+            record_step(log, i, SECTOR_COPIED);
+        }
+        copy_sector(b, SCRATCH_OFFSET);
+        record_step(log, i, SECTOR_DONE);
+
+    }
+
+    return count;
+}
+
+
+/* Same as the second stage bootloader does for us, but for the firmware's
+ * vector table, which follows its own (unused) copy of the second stage
+ * bootloader */
+static void __attribute__((noreturn)) start_firmware()
+{
+    const uint32_t *vectors = (const uint32_t *)(XIP_BASE + LOADER_SIZE + 256);
+
+    scb_hw->vtor = (uintptr_t)vectors;
+    __asm volatile ("msr msp, %0\n"
+                    "bx %1\n" : : "r" (vectors[0]), "r" (vectors[1]));
+    __builtin_unreachable();
+}
+
+
+int main()
+{
+    const struct ota_journal *j;
+    uint32_t n;
+    uint32_t scratch4;
+
+    j = (const struct ota_journal *)flash(JOURNAL_OFFSET);
+    if ( (j->signature != JOURNAL_SIGNATURE) || (j->state != OTA_TRIAL) ) {
+        start_firmware();
+    }
+
+    n = j->n_sectors;
+    if ( n > SLOT_SECTORS ) start_firmware();
+
+    /* Exchanging even one sector takes longer than the firmware's
+     * watchdog timeout */
+    watchdog_hw->ctrl &= ~WATCHDOG_CTRL_ENABLE_BITS;
+
+    if ( step_done(ROLLBACK_LOG, 0, SECTOR_DONE) ) {
+        exchange(ROLLBACK_LOG, n);
+        start_firmware();
+    }
+
+    /* If the update was already installed, the new firmware has been
+     * running and something restarted it */
+    if ( (exchange(INSTALL_LOG, n) == 0) && watchdog_caused_reboot() ) {
+        record_step(ROLLBACK_LOG, 0, SECTOR_DONE);
+        exchange(ROLLBACK_LOG, n);
+        start_firmware();
+    }
+
+    /* watchdog_enable() leaves a note for watchdog_enable_caused_reboot(),
+     * which should still be about the last restart when the firmware
+     * looks at it */
+    scratch4 = watchdog_hw->scratch[4];
+    watchdog_enable(TRIAL_WATCHDOG_MS, 1);
+    watchdog_hw->scratch[4] = scratch4;
+    start_firmware();
+}
@@ -1,22 +1,21 @@
 #ifndef _LWIPOPTS_H
 #define _LWIPOPTS_H
 
+/* Two profiles, chosen with -DLWIP_PROFILE=... (see CMakeLists.txt):
+ *  full:    everything, including TCP for firmware updates
+ *  minimal: only what DHCP, DNS, NTP and the control protocol need */
+
 #define NO_SYS                      1
 #define LWIP_SOCKET                 0
 #define MEM_LIBC_MALLOC             0
 #define MEM_ALIGNMENT               4
-#define MEM_SIZE                    4000
-#define MEMP_NUM_TCP_SEG            32
 #define MEMP_NUM_ARP_QUEUE          10
-#define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
 #define LWIP_ICMP                   1
 #define LWIP_RAW                    1
-#define TCP_WND                     (8 * TCP_MSS)
+/* Also sets the pbuf pool buffer size, which must fit a whole frame */
 #define TCP_MSS                     1460
-#define TCP_SND_BUF                 (8 * TCP_MSS)
-#define TCP_SND_QUEUELEN            ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
 #define LWIP_NETIF_STATUS_CALLBACK  1
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
@@ -29,13 +28,29 @@
 #define LWIP_CHKSUM_ALGORITHM       3
 #define LWIP_DHCP                   1
 #define LWIP_IPV4                   1
-#define LWIP_TCP                    1
 #define LWIP_UDP                    1
 #define LWIP_DNS                    1
-#define LWIP_TCP_KEEPALIVE          1
+#define LWIP_IGMP                   1
 #define LWIP_NETIF_TX_SINGLE_PBUF   1
 #define DHCP_DOES_ARP_CHECK         0
 #define LWIP_DHCP_DOES_ACD_CHECK    0
+#define LWIP_DHCP_GET_NTP_SRV       1
+#define LWIP_DHCP_MAX_NTP_SERVERS   2
+
+#ifdef MT_LWIP_MINIMAL
+#define LWIP_TCP                    0
+#define MEM_SIZE                    1600
+#define PBUF_POOL_SIZE              8
+#else
+#define LWIP_TCP                    1
+#define LWIP_TCP_KEEPALIVE          1
+#define MEM_SIZE                    4000
+#define PBUF_POOL_SIZE              24
+#define MEMP_NUM_TCP_SEG            32
+#define TCP_WND                     (8 * TCP_MSS)
+#define TCP_SND_BUF                 (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN            ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+#endif
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
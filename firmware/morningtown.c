@@ -23,10 +23,7 @@
  */
 
 #include <pico/stdlib.h>
-#include <hardware/rtc.h>
-#include <hardware/watchdog.h>
 #include <hardware/pwm.h>
-#include <time.h>
 #include <stdio.h>
 
 #ifdef PICO_W
@@ -35,40 +32,40 @@
 
 #include "ntp_client.h"
 #include "terminal.h"
+#include "clock.h"
 #include "ds3231.h"
 #include "settings.h"
+#include "schedule.h"
+#include "wifi.h"
+#include "udpctl.h"
+#include "serialctl.h"
+#include "status.h"
+#include "ota.h"
+#include "supervisor.h"
+#include "retain.h"
+#include "pps.h"
+#include "energy.h"
+#include "record.h"
+#include "holdover.h"
+#include "morningtown.h"
 
 #define LED_BLUE 21
 #define TEST_BUTTON 16
 
-static void check_clock(int *pre_wake, int *wake_now)
-{
-    int32_t dstoffs;
-    datetime_t t = {0};
-
-    if ( ds3231_get_datetime(&t) ) {
-        rtc_get_datetime(&t);
-    }
-
-    dstoffs = settings.utc_offset + dst(t);
+/* How often to give the DS3231 time to the clock core (microseconds) */
+#define DS3231_INTERVAL (60 * 1000000)
 
-    if ( t.hour >= settings.clear_hour-dstoffs ) {
-        *pre_wake = 0;
-        *wake_now = 0;
-
-    } else if ( (t.hour >= settings.late_hour-dstoffs) && (t.min >= settings.late_min) ) {
-        *pre_wake = 0;
-        *wake_now = 1;
+static uint8_t check_clock()
+{
+    uint64_t t0 = time_us_64();
+    uint32_t dt;
+    uint8_t leds;
 
-    } else if ( (t.hour >= settings.morning_hour-dstoffs) && (t.min >= settings.morning_min) ) {
-        *pre_wake = 1;
-        *wake_now = 0;
-
-    } else {
-        *pre_wake = 0;
-        *wake_now = 0;
-    }
+    leds = schedule_lookup(schedule_minute_of_week(clock_utc_us(t0)/1000000));
 
+    dt = time_us_64() - t0;
+    if ( dt > counters.check_max_us ) counters.check_max_us = dt;
+    return leds;
 }
 
 
@@ -83,6 +80,31 @@ static void setup_pwm(int pin)
 }
 
 
+static void set_channel(int channel, int level)
+{
+    static uint8_t lit = 0;
+
+    if ( settings.channel_pin[channel] == CHANNEL_UNUSED ) return;
+    pwm_set_gpio_level(settings.channel_pin[channel], level);
+
+    if ( level > 0 ) {
+        lit |= 1<<channel;
+    } else {
+        lit &= ~(1<<channel);
+    }
+    energy_set(ENERGY_LEDS, __builtin_popcount(lit));
+}
+
+
+static void set_leds(uint8_t leds, int brightness)
+{
+    int i;
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        set_channel(i, (leds & 1<<i)?brightness:0);
+    }
+}
+
+
 static void set_board_led(int level)
 {
     #ifdef PICO_W
@@ -93,18 +115,137 @@ static void set_board_led(int level)
 }
 
 
-int main()
+static int blink()
 {
-    NTP_T *ntp_state;
-    int last_conn, countdown;
-    int pre_wake = 0;
-    int wake_now = 0;
-    int time_ok = 0;
+    return (time_us_64() / 500000) % 2;
+}
+
+
+/* Wait for up to the given time, but return early if the network has
+ * something for us to do */
+static void idle_ms(int ms)
+{
+#ifdef PICO_W
+    cyw43_arch_wait_for_work_until(make_timeout_time_ms(ms));
+#else
+    sleep_ms(ms);
+#endif
+}
+
+
+/* Boot display, run alongside everything else instead of holding up
+ * the terminal and network:
+ *  blue = alive, red = DS3231 found (blinking = oscillator stopped),
+ *  green = time known. */
+enum boot_stage
+{
+    BOOT_DS3231,
+    BOOT_OSF,
+    BOOT_TIME,
+    BOOT_HOLD,
+    BOOT_DONE
+};
+
+struct boot_display
+{
+    enum boot_stage stage;
+    absolute_time_t next;
+    int blinks;
+};
+
+
+static void boot_display_start(struct boot_display *bd, int brightness)
+{
+    set_board_led(1);
+    pwm_set_gpio_level(LED_BLUE, brightness);
+    bd->stage = BOOT_DS3231;
+    bd->next = make_timeout_time_ms(500);
+}
+
+
+/* Returns non-zero while the boot display is using the LEDs */
+static int boot_display_poll(struct boot_display *bd, int brightness)
+{
+    if ( bd->stage == BOOT_DONE ) return 0;
+    if ( absolute_time_diff_us(get_absolute_time(), bd->next) > 0 ) return 1;
+
+    switch ( bd->stage ) {
+
+        case BOOT_DS3231 :
+        if ( ds3231_found() ) {
+            set_channel(CH_RISE, brightness);
+        }
+        if ( ds3231_osf_set() ) {
+            bd->blinks = 50;
+            bd->stage = BOOT_OSF;
+            bd->next = make_timeout_time_ms(100);
+        } else {
+            bd->stage = BOOT_TIME;
+            bd->next = make_timeout_time_ms(500);
+        }
+        break;
+
+        case BOOT_OSF :
+        bd->blinks--;
+        set_channel(CH_RISE, (bd->blinks % 2) ? brightness : 0);
+        if ( bd->blinks == 0 ) {
+            bd->stage = BOOT_TIME;
+            bd->next = make_timeout_time_ms(500);
+        } else {
+            bd->next = make_timeout_time_ms(100);
+        }
+        break;
+
+        case BOOT_TIME :
+        if ( clock_source() != CLOCK_SRC_NONE ) {
+            set_channel(CH_WAKE, brightness);
+        }
+        bd->stage = BOOT_HOLD;
+        bd->next = make_timeout_time_ms(2000);
+        break;
+
+        case BOOT_HOLD :
+        set_board_led(0);
+        set_leds(0, brightness);
+        pwm_set_gpio_level(LED_BLUE, 0);
+        bd->stage = BOOT_DONE;
+        return 0;
+
+        default :
+        bd->stage = BOOT_DONE;
+        return 0;
+
+    }
+    return 1;
+}
 
-    const int brightness = 65535;
+
+/* The main loop's state lives out here, so that the host build can run
+ * many units side by side, one pass at a time (see host/fleet.c) */
+static NTP_T *ntp_state;
+static Terminal *trm;
+static struct boot_display bd;
+static int countdown;
+static uint8_t leds = 0;
+static int leds_valid = 0;
+static int leds_reported = 0;
+static int time_ok = 0;
+static int flag = 0;
+static uint8_t button = 1;
+static uint64_t next_ds3231;
+
+static const int brightness = 65535;
+
+
+void morningtown_init()
+{
+    int i;
 
     stdio_init_all();
     printf("MorningTown initialising\n");
+    record_input(REC_BOOT, NULL, 0);
+    supervisor_init();
+    ota_init();
 
 #ifdef PICO_W
     cyw43_arch_init();
@@ -114,9 +255,8 @@ int main()
     gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
 #endif
 
-    watchdog_enable(0x7fffff, 1);
-    rtc_init();
     ds3231_init();
+    pps_init();
 
     /* Board LED shows we're alive */
     set_board_led(1);
@@ -127,104 +267,140 @@ int main()
 
     settings_read();
 
-    setup_pwm(settings.morning_pin);
-    setup_pwm(settings.late_pin);
-    setup_pwm(LED_BLUE);
-
-    pwm_set_gpio_level(LED_BLUE, brightness);
-
-    if ( !set_picortc_from_ds3231() ) {
-        time_ok = 1;
-    }
-
-    /* Red light indicates DS3231 */
-    sleep_ms(500);
-    if ( ds3231_found() ) {
-        pwm_set_gpio_level(settings.late_pin, brightness);
-    }
-
-    if ( ds3231_osf_set() ) {
-        int i;
-        for ( i=0; i<25; i++ ) {
-            pwm_set_gpio_level(settings.late_pin, brightness);
-            sleep_ms(100);
-            pwm_set_gpio_level(settings.late_pin, 0);
-            sleep_ms(100);
-        }
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        if ( settings.channel_pin[i] == CHANNEL_UNUSED ) continue;
+        setup_pwm(settings.channel_pin[i]);
     }
+    setup_pwm(LED_BLUE);
 
-    /* Green light indicates RP2040 RTC */
-    sleep_ms(500);
-    if ( rtc_running() ) {
-        pwm_set_gpio_level(settings.morning_pin, brightness);
-    }
+    /* The clock core picks whichever of these is better, until NTP
+     * comes along */
+    retain_restore();
+    ds3231_to_clock();
+    next_ds3231 = time_us_64() + DS3231_INTERVAL;
 
-    /* Wait, then turn everything off */
-    sleep_ms(2000);
-    set_board_led(0);
-    pwm_set_gpio_level(settings.morning_pin, 0);
-    pwm_set_gpio_level(settings.late_pin, 0);
-    pwm_set_gpio_level(LED_BLUE, 0);
+    boot_display_start(&bd, brightness);
 
-    Terminal *trm = terminal_init();
+    trm = terminal_init();
 
     ntp_state = ntp_init();
-    last_conn = 20000;
+#ifdef PICO_W
+    wifi_init(ntp_state);
+    udpctl_init();
+#endif
     countdown = 100;
-    while (1) {
+    supervisor_start();
+}
+
 
-        watchdog_update();
+/* One pass of the main loop.  Returns the number of milliseconds to wait
+ * before the next one. */
+int morningtown_poll()
+{
+    energy_set(ENERGY_AWAKE, 1);
+
+    /* New firmware which doesn't confirm itself in time gets rolled
+     * back by the watchdog */
+    if ( ota_trial_expired() ) {
+        supervisor_stop();
+    } else {
+        supervisor_poll();
+        if ( time_ok ) retain_update();
+    }
 
 #ifdef PICO_W
-        int st = cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA);
-
-        if ( (st != CYW43_LINK_JOIN) && (last_conn > 10000) ) {
-            cyw43_arch_wifi_connect_async(WIFI_SSID,
-                    WIFI_PASSWORD,
-                    CYW43_AUTH_WPA2_AES_PSK);
-            printf("connecting to wifi...\n");
-            last_conn = 0;
-        }
+    supervisor_checkin(TASK_NET);
+    wifi_poll();
+    ota_checkin(wifi_connected());
 #endif
+    ota_poll();
 
-        if ( ntp_ok(ntp_state) ) time_ok = 1;
+    time_ok = (clock_source() != CLOCK_SRC_NONE);
 
-        /* Check clock every 10 seconds */
-        countdown--;
-        if ( countdown == 0 ) {
-            if ( time_ok ) check_clock(&pre_wake, &wake_now);
-            countdown = 100;
+    if ( holdover_poll() ) countdown = 0;
+    flag = holdover_uncertain() && (holdover_policy() == HOLDOVER_FLAG);
+
+    /* The DS3231 has its own crystal, so keep offering its time in
+     * case it's better than what we have.  Its 1 Hz output does that
+     * by itself when it's working. */
+    supervisor_checkin(TASK_I2C);
+    pps_poll();
+    if ( !pps_locked() && (time_us_64() > next_ds3231) ) {
+        ds3231_to_clock();
+        next_ds3231 = time_us_64() + DS3231_INTERVAL;
+    }
+
+    /* Check clock every 10 seconds, or as soon as the time is known */
+    countdown--;
+    if ( (countdown <= 0) || (time_ok && !leds_valid) ) {
+        if ( time_ok ) {
+            uint8_t sched = holdover_leds(check_clock(), leds, leds_valid);
+            if ( !leds_valid || (sched != leds) ) {
+                record_input(REC_LEDS, &sched, 1);
+            }
+            leds = sched;
+            leds_valid = 1;
+            status_set_leds(leds);
         }
+        countdown = 100;
+    }
+
+    /* Determine the LED status */
+    supervisor_checkin(TASK_LED);
+    if ( gpio_get(TEST_BUTTON) != button ) {
+        button = !button;
+        record_input(REC_BUTTON, &button, 1);
+    }
+    if ( boot_display_poll(&bd, brightness) ) {
+        /* Boot display still running */
 
-        /* Determine the LED status */
-        if ( gpio_get(TEST_BUTTON) == 0 ) {
-            /* Button pressed */
-            pwm_set_gpio_level(settings.morning_pin, (time_ok && rtc_running())?brightness:0);
-            pwm_set_gpio_level(settings.late_pin, ntp_ok(ntp_state)?brightness:0);
+    } else if ( button == 0 ) {
+        /* Button pressed */
+        set_channel(CH_WAKE, time_ok?brightness:0);
+        set_channel(CH_RISE, ntp_ok(ntp_state)?brightness:0);
 #ifdef PICO_W
-            set_board_led(st == CYW43_LINK_JOIN);
+        set_board_led(wifi_connected());
 #else
-            set_board_led(1);
+        set_board_led(1);
 #endif
-        } else {
-            /* Normal operation */
-            pwm_set_gpio_level(settings.morning_pin, (pre_wake||wake_now)?brightness:0);
-            pwm_set_gpio_level(settings.late_pin, wake_now?brightness:0);
-            set_board_led(0);
+    } else {
+        /* Normal operation */
+        set_leds(leds, brightness);
+        set_board_led(0);
+        if ( leds_valid && !leds_reported ) {
+            printf("LEDs correct %lli ms after boot\n",
+                   time_us_64()/1000);
+            leds_reported = 1;
         }
+    }
 
-        last_conn += 1;
 #ifdef PICO_W
-        cyw43_arch_poll();
+    supervisor_checkin(TASK_NET);
+    cyw43_arch_poll();
 #endif
-        terminal_poll(trm);
-        if ( stdio_usb_connected() ) {
-            set_board_led(1);
-            sleep_ms(10);
-        } else {
-            set_board_led(0);
-            sleep_ms(100);
-        }
+    supervisor_checkin(TASK_TERMINAL);
+    terminal_poll(trm);
+    serialctl_poll();
+    record_poll();
+    energy_set(ENERGY_USB, stdio_usb_connected());
+    energy_set(ENERGY_AWAKE, 0);
+
+    if ( bd.stage != BOOT_DONE ) {
+        return 10;
+    } else if ( stdio_usb_connected() ) {
+        set_board_led(flag ? blink() : 1);
+        return 10;
+    } else {
+        set_board_led(flag ? blink() : 0);
+        return 100;
+    }
+}
+
 
+int main()
+{
+    morningtown_init();
+    while (1) {
+        idle_ms(morningtown_poll());
     }
 }
@@ -24,37 +24,52 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
-#include <hardware/rtc.h>
 #include <pico/stdlib.h>
-#include <pico/util/datetime.h>
 #include <pico/cyw43_arch.h>
 
 #include "lwip/dns.h"
+#include "lwip/dhcp.h"
+#include "lwip/igmp.h"
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
 
 #include "ntp_client.h"
+#include "ntp_server.h"
+#include "ntp_reply.h"
+#include "settings.h"
+#include "clock.h"
+#include "ds3231.h"
+#include "record.h"
+#include "status.h"
 
 
 typedef struct NTP_T_ {
 	ip_addr_t ntp_server_address;
 	struct udp_pcb *ntp_pcb;
 	alarm_id_t send_alarm;
+	alarm_id_t update_alarm;	/* Next regular sync, if > 0 */
 	int err;
 	int ok;
 	int need_request;
+	int pending;
+	int server;
+	uint64_t t1;
+	uint8_t cookie[8];
+	int64_t delay_us;
+	struct ntp_bcast bcast;
 } NTP_T;
 
 
-#define NTP_SERVER "pool.ntp.org"
-#define NTP_MSG_LEN 48
-#define NTP_PORT 123
+/* Last resort, if neither DHCP nor the settings give us a server */
+#define NTP_POOL "pool.ntp.org"
+/* IANA multicast group for NTP */
+#define NTP_MULTICAST_GROUP "224.0.1.1"
 
-/* Seconds between 1 Jan 1900 and 1 Jan 1970 */
-#define NTP_DELTA 2208988800
+/* Go back to polling if broadcasts stop for this long (in microseconds) */
+#define NTP_BROADCAST_TIMEOUT (3ULL * 60 * 60 * 1000000)
 
 /* Interval between re-sending NTP requests (in MICROseconds) */
 #define NTP_RESEND_TIME (5 * 1000000)
@@ -63,23 +78,80 @@ typedef struct NTP_T_ {
 #define NTP_UPDATE_INTERVAL ((37*60*60 + 23*60 + 43)*1000)
 
 
-static void set_rtc(time_t iutc)
+/* NTP servers from DHCP option 42 */
+static ip4_addr_t dhcp_servers[LWIP_DHCP_MAX_NTP_SERVERS];
+static int n_dhcp_servers = 0;
+static NTP_T *ntp_instance = NULL;
+
+
+/* Servers are tried in order: those advertised by DHCP, those from the
+ * settings, and finally the pool */
+static int n_servers()
+{
+	int i;
+	int n = n_dhcp_servers + 1;
+	for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+		if ( settings.ntp_server[i][0] != '\0' ) n++;
+	}
+	return n;
+}
+
+
+/* Returns the hostname for server number 'idx', or NULL if the address
+ * is already known and has been placed in 'addr'. */
+static const char *server_name(int idx, ip_addr_t *addr)
 {
-	struct tm *utc = gmtime(&iutc);
-	datetime_t t;
+	int i;
+
+	if ( idx < n_dhcp_servers ) {
+		ip_addr_copy_from_ip4(*addr, dhcp_servers[idx]);
+		return NULL;
+	}
+	idx -= n_dhcp_servers;
 
-	t.year = utc->tm_year + 1900;
-	t.month = utc->tm_mon + 1;
-	t.day = utc->tm_mday;
-	t.dotw = utc->tm_wday;
-	t.hour = utc->tm_hour;
-	t.min = utc->tm_min;
-	t.sec = utc->tm_sec;
+	for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+		if ( settings.ntp_server[i][0] == '\0' ) continue;
+		if ( idx == 0 ) return settings.ntp_server[i];
+		idx--;
+	}
 
-	printf("time is %i/%i/%i   %i   %i:%i:%i\n",
-            t.year, t.month, t.day, t.dotw, t.hour, t.min, t.sec);
+	return NTP_POOL;
+}
+
+
+static void next_server(NTP_T *state)
+{
+	state->server = (state->server + 1) % n_servers();
+}
+
+
+/* Called by lwIP's DHCP client (LWIP_DHCP_GET_NTP_SRV) */
+void dhcp_set_ntp_servers(u8_t num_ntp_servers,
+                          const ip4_addr_t *ntp_server_addrs)
+{
+	int i;
+
+	if ( num_ntp_servers > LWIP_DHCP_MAX_NTP_SERVERS ) {
+		num_ntp_servers = LWIP_DHCP_MAX_NTP_SERVERS;
+	}
+
+	for ( i=0; i<num_ntp_servers; i++ ) {
+		printf("DHCP offers NTP server %s\n", ip4addr_ntoa(&ntp_server_addrs[i]));
+		dhcp_servers[i] = ntp_server_addrs[i];
+	}
+	n_dhcp_servers = num_ntp_servers;
 
-	rtc_set_datetime(&t);
+	/* Start again with the most local server */
+	if ( ntp_instance != NULL ) ntp_instance->server = 0;
+}
+
+
+/* Call before joining a network.  lwIP only calls dhcp_set_ntp_servers()
+ * if the DHCP reply offers any, so the old network's would otherwise stay */
+void ntp_forget_dhcp_servers()
+{
+	n_dhcp_servers = 0;
+	if ( ntp_instance != NULL ) ntp_instance->server = 0;
 }
 
 
@@ -87,43 +159,115 @@ static int64_t request_handler(alarm_id_t id, void *user_data)
 {
 	NTP_T *state = (NTP_T*)user_data;
 	state->need_request = 1;
+	state->update_alarm = 0;
 	return 0;
 }
 
 
-static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
-                     const ip_addr_t *addr, u16_t port)
+static void ntp_request(NTP_T *state);
+
+
+static void unicast_recv(NTP_T *state, const struct ntp_reply *r,
+                         struct pbuf *p, u16_t port, uint64_t t4)
 {
-	NTP_T *state = (NTP_T*)arg;
-	uint8_t mode = pbuf_get_at(p, 0) & 0x7;
-	uint8_t stratum = pbuf_get_at(p, 1);
+	/* The server copies our transmit timestamp to its origin timestamp.
+	 * Anything else is a duplicate or stray reply. */
+	if ( memcmp(r->origin, state->cookie, 8) != 0 ) return;
+	memset(state->cookie, 0, 8);
 
-	printf("got UDP: %i %i\n", addr, state->ntp_server_address);
-	printf("port %i len %i mode %i stratum %i\n", port, p->tot_len, mode, stratum);
+	state->pending = 0;
 
-	if (ip_addr_cmp(addr, &state->ntp_server_address)
-	 && port == NTP_PORT
+	if (port == NTP_PORT
 	 && p->tot_len == NTP_MSG_LEN
-	 && mode == 0x4 && stratum != 0)
+	 && r->synced)
 	{
-		uint8_t seconds_buf[4] = {0};
-		pbuf_copy_partial(p, seconds_buf, sizeof(seconds_buf), 40);
-		uint32_t seconds_since_1900 = seconds_buf[0] << 24
-		                            | seconds_buf[1] << 16
-		                            | seconds_buf[2] << 8
-		                            | seconds_buf[3];
-		uint32_t seconds_since_1970 = seconds_since_1900 - NTP_DELTA;
-		time_t epoch = seconds_since_1970;
-		printf("second since 1970 = %i\n", epoch);
-		set_rtc(epoch);
+		uint32_t addr = ip4_addr_get_u32(ip_2_ip4(&state->ntp_server_address));
+		int64_t delay = ntp_reply_sync(r, state->t1, t4, addr);
+		state->delay_us = delay/2;
+		printf("NTP round trip %lli us\n", delay);
 		state->err = 0;
 		state->ok = 1;
-		add_alarm_in_ms(NTP_UPDATE_INTERVAL, request_handler, state, false);
+		counters.ntp_syncs++;
+
+		if ( !ntp_bcast_calibrate(&state->bcast, addr, t4) ) {
+			/* A sync forced by ntp_sync_now() replaces the regular one */
+			if ( state->update_alarm > 0 ) cancel_alarm(state->update_alarm);
+			state->update_alarm = add_alarm_in_ms(NTP_UPDATE_INTERVAL,
+			                                      request_handler,
+			                                      state, false);
+		}
 
 	} else {
 		state->err = 1;
 		state->ok = 0;
+		counters.ntp_failures++;
+		next_server(state);
+	}
+}
+
+
+static void broadcast_recv(NTP_T *state, const struct ntp_reply *r,
+                           const ip_addr_t *addr, uint64_t t4)
+{
+	uint32_t a = ip4_addr_get_u32(ip_2_ip4(addr));
+
+	switch ( ntp_bcast_check(&state->bcast, r, a, t4, state->pending) ) {
+
+		case NTP_BCAST_CALIBRATE :
+		/* Measure the delay from this server with one normal exchange */
+		printf("NTP broadcast from %s, calibrating\n", ipaddr_ntoa(addr));
+		state->ntp_server_address = *addr;
+		ntp_request(state);
+		break;
+
+		case NTP_BCAST_SYNC :
+		ntp_bcast_sync(&state->bcast, r, a, t4, state->delay_us);
+		state->err = 0;
+		state->ok = 1;
+		break;
+
 	}
+}
+
+
+static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                     const ip_addr_t *addr, u16_t port)
+{
+	NTP_T *state = (NTP_T*)arg;
+	uint64_t t4 = time_us_64();
+	uint8_t msg[NTP_MSG_LEN];
+	struct ntp_reply r;
+
+	if ( p->tot_len < NTP_MSG_LEN ) {
+		pbuf_free(p);
+		return;
+	}
+
+	pbuf_copy_partial(p, msg, NTP_MSG_LEN, 0);
+	ntp_reply_decode(msg, &r);
+
+	/* Requests to our own server don't affect us */
+	if ( r.mode != NTP_MODE_CLIENT ) {
+		uint8_t rec[6+NTP_MSG_LEN];
+		uint32_t a = ip4_addr_get_u32(ip_2_ip4(addr));
+		memcpy(rec, &a, 4);
+		memcpy(rec+4, &port, 2);
+		memcpy(rec+6, msg, NTP_MSG_LEN);
+		record_input(REC_NTP, rec, sizeof(rec));
+	}
+
+	if ( r.mode == NTP_MODE_CLIENT ) {
+		if ( settings.flags & SETTING_NTP_SERVER ) {
+			ntp_server_recv(pcb, p, addr, port, t4);
+		}
+	} else if ( r.mode == NTP_MODE_BROADCAST ) {
+		broadcast_recv(state, &r, addr, t4);
+	} else if ( (r.mode == NTP_MODE_SERVER)
+	         && ip_addr_cmp(addr, &state->ntp_server_address) )
+	{
+		unicast_recv(state, &r, p, port, t4);
+	}
+
 	pbuf_free(p);
 }
 
@@ -137,10 +281,17 @@ static void ntp_request(NTP_T *state)
 	uint8_t *req = (uint8_t *) p->payload;
 	memset(req, 0, NTP_MSG_LEN);
 	req[0] = 0x1b;
+
+	/* Any unique value will do for the transmit timestamp.  It comes back
+	 * as the origin timestamp, which tells us the reply is genuine. */
+	state->t1 = time_us_64();
+	memcpy(state->cookie, &state->t1, 8);
+	memcpy(req+40, state->cookie, 8);
 	udp_sendto(state->ntp_pcb, p, &state->ntp_server_address, NTP_PORT);
 	pbuf_free(p);
 	cyw43_arch_lwip_end();
 	state->err = 0;
+	state->pending = 1;
 }
 
 
@@ -155,23 +306,31 @@ static void ntp_dns_found(const char *hostname,
 		state->err = 0;
 		ntp_request(state);
 	} else {
-		printf("NTP failed: DNS no address\n");
+		printf("NTP failed: DNS no address for %s\n", hostname);
 		state->err = 1;
 		state->ok = 0;
+		next_server(state);
 	}
 }
 
 
-static int64_t send_handler(alarm_id_t id, void *user_data)
+static void start_request(NTP_T *state)
 {
 	int err;
-	NTP_T *state = (NTP_T*)user_data;
+	const char *name;
 
-	if ( !state->need_request && !state->err ) return NTP_RESEND_TIME;
 	state->need_request = 0;
 
+	name = server_name(state->server, &state->ntp_server_address);
+	if ( name == NULL ) {
+		/* Address given directly - no need for DNS */
+		ntp_request(state);
+		return;
+	}
+
+	printf("NTP server %s\n", name);
 	cyw43_arch_lwip_begin();
-	err = dns_gethostbyname(NTP_SERVER,
+	err = dns_gethostbyname(name,
 	                        &state->ntp_server_address,
 	                        ntp_dns_found,
 	                        state);
@@ -183,7 +342,35 @@ static int64_t send_handler(alarm_id_t id, void *user_data)
 		state->err = 0;
 	} else if (err != ERR_INPROGRESS) {
 		state->err = 1;
+		next_server(state);
 	}
+}
+
+
+static int64_t send_handler(alarm_id_t id, void *user_data)
+{
+	NTP_T *state = (NTP_T*)user_data;
+
+	if ( state->bcast.calibrated ) {
+		if ( time_us_64() - state->bcast.last < NTP_BROADCAST_TIMEOUT ) {
+			state->need_request = 0;
+			return NTP_RESEND_TIME;
+		}
+		printf("NTP broadcasts stopped\n");
+		state->bcast.calibrated = 0;
+		state->need_request = 1;
+	}
+
+	if ( state->pending ) {
+		printf("No reply from NTP server\n");
+		counters.ntp_failures++;
+		state->pending = 0;
+		state->err = 1;
+		next_server(state);
+	}
+
+	if ( !state->need_request && !state->err ) return NTP_RESEND_TIME;
+	start_request(state);
 	return NTP_RESEND_TIME;
 }
 
@@ -196,6 +383,9 @@ NTP_T *ntp_init()
 	state->err = 0;
 	state->ok = 0;
 	state->need_request = 1;
+	state->pending = 0;
+	state->server = 0;
+	ntp_instance = state;
 
 	state->ntp_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
 	if (!state->ntp_pcb) {
@@ -206,6 +396,21 @@ NTP_T *ntp_init()
 	/* Set up UDP callback */
 	udp_recv(state->ntp_pcb, ntp_recv, state);
 
+	if ( settings.flags & (SETTING_NTP_BROADCAST | SETTING_NTP_SERVER) ) {
+		udp_bind(state->ntp_pcb, IP_ANY_TYPE, NTP_PORT);
+	}
+
+	if ( settings.flags & SETTING_NTP_BROADCAST ) {
+		ip4_addr_t group;
+		ip4addr_aton(NTP_MULTICAST_GROUP, &group);
+		igmp_joingroup_netif(&cyw43_state.netif[CYW43_ITF_STA], &group);
+		printf("Listening for NTP broadcasts\n");
+	}
+
+	if ( settings.flags & SETTING_NTP_SERVER ) {
+		printf("Serving time via NTP\n");
+	}
+
 	/* It's probably too early to start resolving hostnames or sending
 	 * UDP packets.  Call us back in a moment. */
 	state->send_alarm = add_alarm_in_us(NTP_RESEND_TIME,
@@ -217,6 +422,17 @@ NTP_T *ntp_init()
 }
 
 
+/* Call when the network has just become usable.  Asks straight away even
+ * if the time was already good, because it has been drifting while the
+ * network was down, and the next regular poll could be hours away. */
+void ntp_sync_now(NTP_T *state)
+{
+	if ( state == NULL ) return;
+	state->pending = 0;
+	start_request(state);
+}
+
+
 int ntp_ok(NTP_T *state)
 {
 	if ( state == NULL ) return 0;
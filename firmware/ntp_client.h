@@ -24,8 +24,19 @@
  *
  */
 
+#define NTP_MSG_LEN 48
+#define NTP_PORT 123
+#define NTP_MODE_CLIENT 3
+#define NTP_MODE_SERVER 4
+#define NTP_MODE_BROADCAST 5
+
+/* Seconds between 1 Jan 1900 and 1 Jan 1970 */
+#define NTP_DELTA 2208988800
+
 typedef struct NTP_T_ NTP_T;
 
 extern NTP_T *ntp_init(void);
+extern void ntp_sync_now(NTP_T *state);
 extern int ntp_ok(NTP_T *state);
 extern int ntp_err(NTP_T *state);
+extern void ntp_forget_dhcp_servers(void);
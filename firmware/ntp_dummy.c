@@ -25,8 +25,10 @@
  */
 
 #include <stddef.h>
+#include <stdio.h>
 
 #include "ntp_client.h"
+#include "ntp_server.h"
 
 
 typedef struct NTP_T_ {
@@ -39,6 +41,11 @@ NTP_T *ntp_init()
 	return NULL;
 }
 
+void ntp_sync_now(NTP_T *state)
+{
+}
+
+
 int ntp_ok(NTP_T *state)
 {
 	return 1;
@@ -49,3 +56,14 @@ int ntp_err(NTP_T *state)
 {
 	return 0;
 }
+
+
+void ntp_forget_dhcp_servers()
+{
+}
+
+
+void ntp_server_stats()
+{
+	printf("No network, so no NTP server\n");
+}
@@ -0,0 +1,146 @@
+/*
+ * ntp_reply.c
+ *
+ * What the NTP client does with each reply, without the network
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Separate from ntp_client.c, which needs lwIP, so that the replayer
+ * (host/replay.c) can give the recorded replies to the same code */
+
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "ntp_client.h"
+#include "ntp_reply.h"
+#include "settings.h"
+#include "clock.h"
+#include "ds3231.h"
+
+/* Listen to a different broadcaster if ours has said nothing for this
+ * long, which is several of the usual 64 second intervals */
+#define NTP_BROADCAST_SWITCH (10ULL * 60 * 1000000)
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+
+/* Convert an NTP short-format value (16.16 seconds) to microseconds */
+static uint32_t get_short(const uint8_t *p)
+{
+    return ((uint64_t)get_u32(p)*1000000) >> 16;
+}
+
+
+/* Convert an NTP timestamp to microseconds since 1970 */
+static uint64_t get_timestamp(const uint8_t *p)
+{
+    /* Unsigned subtraction keeps this working after 2036 */
+    uint32_t secs = get_u32(p) - NTP_DELTA;
+    return (uint64_t)secs*1000000 + (((uint64_t)get_u32(p+4)*1000000) >> 32);
+}
+
+
+/* 'msg' must be NTP_MSG_LEN bytes long */
+void ntp_reply_decode(const uint8_t *msg, struct ntp_reply *r)
+{
+    r->mode = msg[0] & 0x7;
+    r->stratum = msg[1];
+
+    /* Stratum 0 is a kiss-o'-death, and stratum 16 or leap indicator 3
+     * means that the server doesn't know the time itself */
+    r->synced = (r->stratum != 0) && (r->stratum < 16) && ((msg[0] >> 6) != 3);
+
+    r->root_delay = get_short(msg+4);
+    r->root_dispersion = get_short(msg+8);
+    memcpy(r->origin, msg+24, 8);
+    r->t2 = get_timestamp(msg+32);
+    r->t3 = get_timestamp(msg+40);
+}
+
+
+/* Sets the clock from a reply from 'addr' to our request, which was sent
+ * at t1 and answered at t4.  Returns the round trip delay. */
+int64_t ntp_reply_sync(const struct ntp_reply *r, uint64_t t1, uint64_t t4,
+                       uint32_t addr)
+{
+    int64_t delay = (t4 - t1) - (r->t3 - r->t2);
+
+    if ( delay < 0 ) delay = 0;
+    clock_sync(r->t3 + delay/2, t4, r->stratum, addr,
+               r->root_delay + delay, r->root_dispersion);
+    ds3231_check_ntp();
+    return delay;
+}
+
+
+/* Decides what to do with a broadcast from 'addr'.  After
+ * NTP_BCAST_CALIBRATE, the caller should send 'addr' a request, and give
+ * the reply to ntp_bcast_calibrate().  Nothing changes if 'busy' (waiting
+ * for a reply already). */
+int ntp_bcast_check(struct ntp_bcast *b, const struct ntp_reply *r,
+                    uint32_t addr, uint64_t t4, int busy)
+{
+    if ( !(settings.flags & SETTING_NTP_BROADCAST) ) return NTP_BCAST_IGNORE;
+    if ( !r->synced ) return NTP_BCAST_IGNORE;
+
+    /* With more than one broadcaster, stick with the calibrated one
+     * unless it has gone quiet */
+    if ( b->calibrated && (addr != b->server)
+      && (t4 - b->last < NTP_BROADCAST_SWITCH) ) return NTP_BCAST_IGNORE;
+
+    if ( !b->calibrated || (addr != b->server) ) {
+        if ( busy ) return NTP_BCAST_IGNORE;
+        b->server = addr;
+        b->calibrated = 0;
+        return NTP_BCAST_CALIBRATE;
+    }
+
+    return NTP_BCAST_SYNC;
+}
+
+
+/* Sets the clock from a broadcast which got NTP_BCAST_SYNC.  'delay_us'
+ * is the one-way delay measured by the calibration. */
+void ntp_bcast_sync(struct ntp_bcast *b, const struct ntp_reply *r,
+                    uint32_t addr, uint64_t t4, int64_t delay_us)
+{
+    clock_sync(r->t3 + delay_us, t4, r->stratum, addr,
+               r->root_delay + 2*delay_us, r->root_dispersion);
+    b->last = t4;
+    ds3231_check_ntp();
+}
+
+
+/* Call after each good reply to a request.  Returns non-zero if it came
+ * from the broadcast server, whose broadcasts are then enough from now
+ * on. */
+int ntp_bcast_calibrate(struct ntp_bcast *b, uint32_t addr, uint64_t t4)
+{
+    if ( !(settings.flags & SETTING_NTP_BROADCAST) ) return 0;
+    if ( addr != b->server ) return 0;
+    b->calibrated = 1;
+    b->last = t4;
+    return 1;
+}
@@ -0,0 +1,59 @@
+/*
+ * ntp_reply.h
+ *
+ * What the NTP client does with each reply, without the network
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* One NTP message, times in microseconds (since 1970 for timestamps) */
+struct ntp_reply
+{
+    int mode;
+    uint8_t stratum;
+    int synced;                 /* Server knows the time itself */
+    uint32_t root_delay;
+    uint32_t root_dispersion;
+    uint8_t origin[8];          /* Our transmit timestamp, as we sent it */
+    uint64_t t2;                /* Request received by the server */
+    uint64_t t3;                /* Reply sent by the server */
+};
+
+/* The broadcast server being listened to.  Its broadcasts are only used
+ * once a normal exchange with it has measured the network delay. */
+struct ntp_bcast
+{
+    uint32_t server;            /* Network order */
+    int calibrated;
+    uint64_t last;              /* When it was last heard from */
+};
+
+#define NTP_BCAST_IGNORE 0
+#define NTP_BCAST_SYNC 1
+#define NTP_BCAST_CALIBRATE 2
+
+extern void ntp_reply_decode(const uint8_t *msg, struct ntp_reply *r);
+extern int64_t ntp_reply_sync(const struct ntp_reply *r, uint64_t t1,
+                              uint64_t t4, uint32_t addr);
+extern int ntp_bcast_check(struct ntp_bcast *b, const struct ntp_reply *r,
+                           uint32_t addr, uint64_t t4, int busy);
+extern void ntp_bcast_sync(struct ntp_bcast *b, const struct ntp_reply *r,
+                           uint32_t addr, uint64_t t4, int64_t delay_us);
+extern int ntp_bcast_calibrate(struct ntp_bcast *b, uint32_t addr,
+                               uint64_t t4);
@@ -0,0 +1,146 @@
+/*
+ * ntp_server.c
+ *
+ * Minimal SNTP server
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "ntp_client.h"
+#include "ntp_server.h"
+#include "clock.h"
+#include "status.h"
+
+/* Rate limit: sustained requests per second, and burst size */
+#define NTP_SERVER_RATE 50
+#define NTP_SERVER_BURST 20
+
+/* log2 of the timer resolution in seconds (2^-19 s is about 2 us) */
+#define NTP_PRECISION (-19)
+
+static uint32_t tokens = NTP_SERVER_BURST;
+static uint64_t last_refill = 0;
+static uint32_t n_unsynced = 0;
+
+
+static void put_u32(uint8_t *buf, uint32_t v)
+{
+    buf[0] = v >> 24;
+    buf[1] = v >> 16;
+    buf[2] = v >> 8;
+    buf[3] = v;
+}
+
+
+static void put_short(uint8_t *buf, uint32_t us)
+{
+    put_u32(buf, ((uint64_t)us << 16) / 1000000);
+}
+
+
+static void put_timestamp(uint8_t *buf, uint64_t utc_us)
+{
+    uint32_t secs = utc_us / 1000000 + NTP_DELTA;
+    uint32_t frac = ((utc_us % 1000000) << 32) / 1000000;
+    put_u32(buf, secs);
+    put_u32(buf+4, frac);
+}
+
+
+static int rate_ok(uint64_t now)
+{
+    uint64_t n = (now - last_refill) * NTP_SERVER_RATE / 1000000;
+
+    if ( n > 0 ) {
+        tokens += n;
+        if ( tokens > NTP_SERVER_BURST ) tokens = NTP_SERVER_BURST;
+        last_refill = now;
+    }
+
+    if ( tokens == 0 ) return 0;
+    tokens--;
+    return 1;
+}
+
+
+/* Called with a mode 3 (client) packet, timestamped on arrival */
+void ntp_server_recv(struct udp_pcb *pcb, struct pbuf *req,
+                     const ip_addr_t *addr, u16_t port,
+                     uint64_t rx_local_us)
+{
+    struct clock_status st;
+    struct pbuf *p;
+    uint8_t *rep;
+    uint8_t vn;
+
+    if ( !rate_ok(rx_local_us) ) {
+        counters.ntp_limited++;
+        return;
+    }
+
+    clock_get_status(&st);
+    if ( !st.synced ) {
+        /* Better to stay silent than to send rubbish */
+        n_unsynced++;
+        return;
+    }
+
+    p = pbuf_alloc(PBUF_TRANSPORT, NTP_MSG_LEN, PBUF_RAM);
+    if ( p == NULL ) return;
+    rep = (uint8_t *)p->payload;
+    memset(rep, 0, NTP_MSG_LEN);
+
+    vn = (pbuf_get_at(req, 0) >> 3) & 0x7;
+    rep[0] = vn<<3 | NTP_MODE_SERVER;
+    rep[1] = st.stratum;
+    rep[2] = pbuf_get_at(req, 2);       /* Poll interval */
+    rep[3] = NTP_PRECISION;
+    put_short(rep+4, st.root_delay_us);
+    put_short(rep+8, st.root_disp_us);
+    memcpy(rep+12, &st.refid, 4);       /* Already network order */
+    put_timestamp(rep+16, st.ref_time);
+    pbuf_copy_partial(req, rep+24, 8, 40);  /* Origin = their transmit */
+    put_timestamp(rep+32, clock_utc_us(rx_local_us));
+
+    /* Transmit timestamp as late as possible */
+    put_timestamp(rep+40, clock_utc_us(time_us_64()));
+    udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+    counters.ntp_served++;
+}
+
+
+void ntp_server_stats()
+{
+    struct clock_status st;
+    clock_get_status(&st);
+    printf("NTP server: %s, stratum %i, root dispersion %li us\n",
+           st.synced ? "synchronised" : "NOT synchronised",
+           st.stratum, st.root_disp_us);
+    printf("Requests served %li, rate limited %li, unanswered %li\n",
+           counters.ntp_served, counters.ntp_limited, n_unsynced);
+}
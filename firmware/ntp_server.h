@@ -0,0 +1,30 @@
+/*
+ * ntp_server.h
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+extern void ntp_server_stats(void);
+
+/* Only needed by ntp_client.c, which has the lwIP headers */
+#ifdef LWIP_HDR_UDP_H
+extern void ntp_server_recv(struct udp_pcb *pcb, struct pbuf *req,
+                            const ip_addr_t *addr, u16_t port,
+                            uint64_t rx_local_us);
+#endif
@@ -0,0 +1,337 @@
+/*
+ * ota.c
+ *
+ * Firmware update via a staging slot in flash
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* A new image is written to the staging slot as it arrives, then checked
+ * against its SHA-256.  If it matches, we write the journal and restart,
+ * and the loader (see loader.c) exchanges the two slots and starts the
+ * new image on trial.  The old image is now in the staging slot.
+ *
+ * During the trial, the supervisor only feeds the watchdog until
+ * TRIAL_TIMEOUT.  The new image confirms itself, ending the trial, once
+ * it has joined the wireless network and the main loop has then made
+ * CONFIRM_PASSES passes in a row with the network still up (see
+ * ota_checkin()).  NTP isn't needed, so that an update still works on a
+ * network which can't reach any time server.  If the new image restarts
+ * before it is confirmed, for any reason, the loader exchanges the slots
+ * again, bringing back the old image.
+ *
+ * The exchange takes about 0.1 s per sector, and picks up where it left
+ * off if the power is cut meanwhile.
+ *
+ * The SHA-256 only catches corruption on the way.  It comes from whoever
+ * asked for the update, so anyone who can send control requests to a unit
+ * with 'remote on' can install any firmware they like on it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <hardware/structs/watchdog.h>
+
+#include "sha256.h"
+#include "ota.h"
+#include "ota_layout.h"
+
+/* How long a new image has to confirm itself (microseconds) */
+#define TRIAL_TIMEOUT (5 * 60 * 1000 * 1000ULL)
+
+/* Passes of the main loop in a row, with the network up, which confirm a
+ * new image.  Each pass takes 10 to 100 ms, and would restart the board
+ * if it got stuck (see supervisor.c). */
+#define CONFIRM_PASSES 300
+
+/* Time between verifying the image and swapping, to let the network
+ * connection finish (microseconds) */
+#define SWAP_DELAY (1000 * 1000)
+
+/* End of the running image, from the SDK's linker script */
+extern char __flash_binary_end;
+
+static struct ota_journal journal;
+static int state = OTA_IDLE;
+static uint32_t received;
+static uint8_t page[FLASH_PAGE_SIZE];
+static struct sha256 hash;
+static uint64_t swap_at;
+static int good_passes = 0;
+
+
+static uint32_t running_size()
+{
+    return (uintptr_t)&__flash_binary_end - XIP_BASE;
+}
+
+
+static uint32_t sectors(uint32_t bytes)
+{
+    return (bytes + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+}
+
+
+/* Also clears the progress pages for the loader */
+static void write_journal(int new_state)
+{
+    uint32_t v;
+
+    journal.signature = JOURNAL_SIGNATURE;
+    journal.state = new_state;
+    v = save_and_disable_interrupts();
+    flash_range_erase(JOURNAL_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(JOURNAL_OFFSET, (uint8_t *)&journal, FLASH_PAGE_SIZE);
+    restore_interrupts(v);
+}
+
+
+/* Must be called first thing at startup (after supervisor_init()) */
+void ota_init()
+{
+    const struct ota_journal *j;
+
+    j = (const struct ota_journal *)(XIP_BASE + JOURNAL_OFFSET);
+    if ( j->signature != JOURNAL_SIGNATURE ) {
+        memset(&journal, 0, sizeof(journal));
+        state = OTA_IDLE;
+        return;
+    }
+
+    journal = *j;
+    state = journal.state;
+
+    /* The loader has already put the old image back, if necessary */
+    if ( (state == OTA_TRIAL)
+      && ((*(const uint8_t *)(XIP_BASE + ROLLBACK_LOG) & SECTOR_DONE) == 0) )
+    {
+        write_journal(OTA_ROLLED_BACK);
+        state = OTA_ROLLED_BACK;
+    }
+
+    if ( state == OTA_ROLLED_BACK ) {
+        printf("The last firmware update was rolled back\n");
+    } else if ( state == OTA_TRIAL ) {
+        printf("Running new firmware on trial\n");
+    }
+}
+
+
+int ota_state()
+{
+    return state;
+}
+
+
+int ota_begin(uint32_t size, const uint8_t *sha256)
+{
+    if ( (state == OTA_RECEIVING) || (state == OTA_SWAP_PENDING) ) {
+        printf("Firmware update already in progress\n");
+        return 1;
+    }
+    if ( state == OTA_TRIAL ) {
+        printf("Can't update while the current firmware is on trial\n");
+        return 1;
+    }
+    if ( (size == 0) || (size > SLOT_SIZE) || (running_size() > SLOT_SIZE) ) {
+        printf("Firmware image too big (%li bytes, slot is %li)\n",
+               size, SLOT_SIZE);
+        return 1;
+    }
+
+    journal.image_size = size;
+    memcpy(journal.sha256, sha256, 32);
+    received = 0;
+    sha256_init(&hash);
+    state = OTA_RECEIVING;
+    printf("Receiving new firmware (%li bytes)\n", size);
+    return 0;
+}
+
+
+/* The SHA-256 is worked out as we go, from what went into the flash
+ * rather than what was received.  Doing it all at the end would take
+ * longer than the supervisor allows (see supervisor.c). */
+static void program_page(uint32_t offs, uint32_t len)
+{
+    uint32_t v = save_and_disable_interrupts();
+    if ( offs % FLASH_SECTOR_SIZE == 0 ) {
+        flash_range_erase(STAGING_OFFSET + offs, FLASH_SECTOR_SIZE);
+    }
+    flash_range_program(STAGING_OFFSET + offs, page, FLASH_PAGE_SIZE);
+    restore_interrupts(v);
+
+    sha256_update(&hash, (const uint8_t *)(XIP_BASE + STAGING_OFFSET + offs),
+                  len);
+}
+
+
+/* Programs each page into the staging slot as soon as it's complete */
+int ota_write(const uint8_t *data, size_t len)
+{
+    if ( state != OTA_RECEIVING ) return 1;
+    if ( len > ota_remaining() ) {
+        printf("Too much firmware data received\n");
+        ota_abort();
+        return 1;
+    }
+
+    while ( len > 0 ) {
+
+        uint32_t in_page = received % FLASH_PAGE_SIZE;
+        size_t n = FLASH_PAGE_SIZE - in_page;
+        if ( n > len ) n = len;
+
+        memcpy(page+in_page, data, n);
+        received += n;
+        data += n;
+        len -= n;
+
+        if ( (received % FLASH_PAGE_SIZE == 0)
+          || (received == journal.image_size) )
+        {
+            uint32_t used = received - received/FLASH_PAGE_SIZE*FLASH_PAGE_SIZE;
+            if ( used > 0 ) memset(page+used, 0xff, FLASH_PAGE_SIZE-used);
+            program_page((received-1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE,
+                         used ? used : FLASH_PAGE_SIZE);
+        }
+
+    }
+
+    return 0;
+}
+
+
+uint32_t ota_remaining()
+{
+    if ( state != OTA_RECEIVING ) return 0;
+    return journal.image_size - received;
+}
+
+
+int ota_finish()
+{
+    uint8_t digest[32];
+    const uint32_t *vectors;
+
+    if ( (state != OTA_RECEIVING) || (ota_remaining() != 0) ) return 1;
+
+    sha256_final(&hash, digest);
+    if ( memcmp(digest, journal.sha256, 32) != 0 ) {
+        printf("Firmware image has the wrong SHA-256\n");
+        ota_abort();
+        return 1;
+    }
+
+    /* The firmware's vector table follows the loader and the 256-byte
+     * second stage bootloader.  Its first entry is the initial stack
+     * pointer, and the second is the reset handler. */
+    vectors = (const uint32_t *)(XIP_BASE + STAGING_OFFSET + LOADER_SIZE + 256);
+    if ( (journal.image_size < LOADER_SIZE + 512)
+      || (vectors[0] < SRAM_BASE) || (vectors[0] > SRAM_END)
+      || (vectors[1] < XIP_BASE + LOADER_SIZE)
+      || (vectors[1] >= XIP_BASE + journal.image_size) )
+    {
+        printf("Doesn't look like a firmware image for this board\n");
+        ota_abort();
+        return 1;
+    }
+
+    journal.n_sectors = sectors(journal.image_size);
+    if ( sectors(running_size()) > journal.n_sectors ) {
+        journal.n_sectors = sectors(running_size());
+    }
+
+    printf("New firmware verified, installing\n");
+    state = OTA_SWAP_PENDING;
+    swap_at = time_us_64() + SWAP_DELAY;
+    return 0;
+}
+
+
+void ota_abort()
+{
+    if ( state != OTA_RECEIVING ) return;
+    printf("Firmware update abandoned\n");
+    state = journal.state;
+}
+
+
+/* Call on each pass of the main loop, with 'connected' non-zero if the
+ * wireless network is up */
+void ota_checkin(int connected)
+{
+    if ( state != OTA_TRIAL ) return;
+    if ( !connected ) {
+        good_passes = 0;
+        return;
+    }
+    if ( ++good_passes < CONFIRM_PASSES ) return;
+    printf("New firmware confirmed\n");
+    write_journal(OTA_IDLE);
+    state = OTA_IDLE;
+}
+
+
+int ota_trial_expired()
+{
+    return (state == OTA_TRIAL) && (time_us_64() > TRIAL_TIMEOUT);
+}
+
+
+void ota_poll()
+{
+    if ( (state == OTA_SWAP_PENDING) && (time_us_64() > swap_at) ) {
+        printf("Restarting to exchange %li sectors\n",
+               journal.n_sectors - LOADER_SECTORS);
+        write_journal(OTA_TRIAL);
+
+        /* Clear the SDK's magic number, so that the next boot doesn't
+         * look like a watchdog timeout */
+        watchdog_hw->scratch[4] = 0;
+        watchdog_hw->ctrl = WATCHDOG_CTRL_TRIGGER_BITS;
+        while ( 1 );
+    }
+}
+
+
+void ota_show()
+{
+    static const char *names[] = {"idle", "receiving", "swap pending",
+                                  "on trial", "rolled back"};
+    int i;
+
+    printf("Running image: %li bytes, slot size: %li bytes\n",
+           running_size(), SLOT_SIZE);
+    printf("Loader: %i bytes, staging slot at %p, journal at %p\n",
+           LOADER_SIZE, XIP_BASE+STAGING_OFFSET, XIP_BASE+JOURNAL_OFFSET);
+    printf("Update state: %s\n", names[state]);
+    if ( state == OTA_RECEIVING ) {
+        printf("Received %li of %li bytes\n", received, journal.image_size);
+    }
+    if ( journal.image_size > 0 ) {
+        printf("Last image SHA-256: ");
+        for ( i=0; i<32; i++ ) printf("%02x", journal.sha256[i]);
+        printf("\n");
+    }
+}
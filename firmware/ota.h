@@ -0,0 +1,42 @@
+/*
+ * ota.h
+ *
+ * Firmware update via a staging slot in flash
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Values of ota_state(), also sent in struct mt_status */
+#define OTA_IDLE 0
+#define OTA_RECEIVING 1
+#define OTA_SWAP_PENDING 2
+#define OTA_TRIAL 3
+#define OTA_ROLLED_BACK 4
+
+extern void ota_init(void);
+extern int ota_state(void);
+extern int ota_begin(uint32_t size, const uint8_t *sha256);
+extern int ota_write(const uint8_t *data, size_t len);
+extern uint32_t ota_remaining(void);
+extern int ota_finish(void);
+extern void ota_abort(void);
+extern void ota_checkin(int connected);
+extern int ota_trial_expired(void);
+extern void ota_poll(void);
+extern void ota_show(void);
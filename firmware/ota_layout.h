@@ -0,0 +1,78 @@
+/*
+ * ota_layout.h
+ *
+ * Flash layout and update journal, shared by ota.c and loader.c
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Flash layout (2 MB on a Pico W):
+ *
+ *   0                      Loader (LOADER_SIZE, set in CMakeLists.txt)
+ *   LOADER_SIZE            Running firmware
+ *   STAGING_OFFSET         Staging slot, same size as the running one
+ *   SCRATCH_OFFSET         One sector, for the exchange
+ *   JOURNAL_OFFSET         One sector for the journal
+ *   last sector            Settings (see settings.c)
+ *
+ * The "running slot" is the first SLOT_SIZE bytes, including the loader.
+ * Images are built with the loader at the start, so that the same offsets
+ * work in both slots, but the loader's sectors are never exchanged.
+ */
+
+#define LOADER_SECTORS (LOADER_SIZE / FLASH_SECTOR_SIZE)
+#define SLOT_SECTORS ((PICO_FLASH_SIZE_BYTES/FLASH_SECTOR_SIZE - 3) / 2)
+#define SLOT_SIZE (SLOT_SECTORS * FLASH_SECTOR_SIZE)
+#define STAGING_OFFSET SLOT_SIZE
+#define SCRATCH_OFFSET (PICO_FLASH_SIZE_BYTES - 3*FLASH_SECTOR_SIZE)
+#define JOURNAL_OFFSET (PICO_FLASH_SIZE_BYTES - 2*FLASH_SECTOR_SIZE)
+
+#define JOURNAL_SIGNATURE 0x32544f4d    /* "MOT2" */
+
+/* The first page of the journal sector.  Only OTA_IDLE, OTA_TRIAL and
+ * OTA_ROLLED_BACK are ever saved.  OTA_TRIAL means that the slots should
+ * be exchanged, or have been. */
+struct ota_journal
+{
+    uint32_t signature;
+    uint32_t state;
+    uint32_t n_sectors;         /* Exchange sectors LOADER_SECTORS to this */
+    uint32_t image_size;
+    uint8_t sha256[32];
+    char pad[FLASH_PAGE_SIZE-48];
+};
+
+/* The next two pages record the progress of exchanging the slots for
+ * the update, and of exchanging them back again for a rollback.  Byte i
+ * is for sector i of each slot, and its bits are cleared one by one as
+ * the sector goes through the steps of the exchange, so that the pages
+ * never need to be erased until the journal is written again.  Byte 0
+ * of the rollback page (sector 0 belongs to the loader) is cleared when
+ * a rollback is decided on. */
+#define INSTALL_LOG (JOURNAL_OFFSET + FLASH_PAGE_SIZE)
+#define ROLLBACK_LOG (JOURNAL_OFFSET + 2*FLASH_PAGE_SIZE)
+
+#define SECTOR_SAVED 0x01       /* Running slot's sector copied to scratch */
+#define SECTOR_COPIED 0x02      /* Staging slot's sector copied to running */
+#define SECTOR_DONE 0x04        /* Scratch copied to staging */
+
+_Static_assert(sizeof(struct ota_journal) == FLASH_PAGE_SIZE,
+               "OTA journal must be one flash page");
+_Static_assert(SLOT_SECTORS <= FLASH_PAGE_SIZE,
+               "One byte per sector in each progress page");
@@ -0,0 +1,140 @@
+/*
+ * ota_net.c
+ *
+ * Fetching firmware updates over TCP
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The update server (tools/ota_server.py) asks for an update via the
+ * control protocol, giving the image size, SHA-256 and a TCP port.  We
+ * connect back to that port and the server sends the raw image
+ * (morningtown.bin).  Each pbuf goes straight into the staging slot, and
+ * the TCP window only opens up again once the data has been written.
+ * At the end, we send back one byte: 0 if the image was verified and
+ * will be installed, 1 otherwise. */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+
+#include "ota.h"
+#include "ota_net.h"
+
+/* Give up if nothing arrives for this many tcp_poll intervals (2 s) */
+#define MAX_IDLE_POLLS 5
+
+static struct tcp_pcb *ota_pcb = NULL;
+static int idle_polls;
+
+
+/* Returns ERR_ABRT if the pcb had to be aborted, which the callback has
+ * to pass back to lwIP */
+static err_t finish(struct tcp_pcb *pcb, uint8_t result)
+{
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    tcp_write(pcb, &result, 1, TCP_WRITE_FLAG_COPY);
+    ota_pcb = NULL;
+    if ( tcp_close(pcb) != ERR_OK ) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+
+static err_t ota_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p,
+                      err_t err)
+{
+    struct pbuf *q;
+
+    if ( p == NULL ) {
+        printf("Update server closed the connection early\n");
+        ota_abort();
+        return finish(pcb, 1);
+    }
+
+    idle_polls = 0;
+    for ( q=p; q!=NULL; q=q->next ) {
+        if ( ota_write(q->payload, q->len) ) {
+            pbuf_free(p);
+            return finish(pcb, 1);
+        }
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    if ( ota_remaining() == 0 ) {
+        return finish(pcb, ota_finish() ? 1 : 0);
+    }
+    return ERR_OK;
+}
+
+
+static err_t ota_poll_cb(void *arg, struct tcp_pcb *pcb)
+{
+    if ( ++idle_polls < MAX_IDLE_POLLS ) return ERR_OK;
+    printf("Firmware download stalled\n");
+    ota_abort();
+    tcp_abort(pcb);
+    ota_pcb = NULL;
+    return ERR_ABRT;
+}
+
+
+static void ota_err(void *arg, err_t err)
+{
+    /* The pcb has already been freed */
+    printf("Firmware download failed (error %i)\n", err);
+    ota_abort();
+    ota_pcb = NULL;
+}
+
+
+int ota_fetch(const ip_addr_t *addr, uint16_t port, uint32_t size,
+              const uint8_t *sha256)
+{
+    if ( ota_pcb != NULL ) return 1;
+    if ( ota_begin(size, sha256) ) return 1;
+
+    ota_pcb = tcp_new_ip_type(IP_GET_TYPE(addr));
+    if ( ota_pcb == NULL ) {
+        ota_abort();
+        return 1;
+    }
+
+    idle_polls = 0;
+    tcp_recv(ota_pcb, ota_recv);
+    tcp_err(ota_pcb, ota_err);
+    tcp_poll(ota_pcb, ota_poll_cb, 4);
+
+    if ( tcp_connect(ota_pcb, addr, port, NULL) != ERR_OK ) {
+        tcp_abort(ota_pcb);
+        ota_pcb = NULL;
+        ota_abort();
+        return 1;
+    }
+    return 0;
+}
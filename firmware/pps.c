@@ -0,0 +1,278 @@
+/*
+ * pps.c
+ *
+ * DS3231 1 Hz output as a pulse-per-second reference
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The DS3231's INT/SQW pin gives a 1 Hz square wave, and the time
+ * registers tick over on its falling edge.  The edge interrupt records
+ * time_us_64(), and pps_poll() (from the main loop) does the rest:
+ *
+ *  - The first edge is labelled with the DS3231's time, read just after
+ *    the edge.  If the main loop only gets to it more than LABEL_READ_US
+ *    later, the registers are read at a later edge instead.  After that,
+ *    each edge is one second later than the last.
+ *  - Each edge goes to the clock core as a DS3231 sample, with the exact
+ *    local time of the second boundary.
+ *  - The local time between the oldest and newest of the last WINDOW
+ *    edges gives the frequency error of the Pico's crystal against the
+ *    DS3231's temperature-compensated one, which the clock core uses to
+ *    steer its extrapolation.
+ *
+ * The label is checked against the registers every LABEL_CHECK edges.
+ * If the edges stop or come at the wrong rate, we start again.
+ */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+#include <hardware/irq.h>
+
+#include "clock.h"
+#include "ds3231.h"
+#include "pps.h"
+#include "record.h"
+
+#define PIN_SQW 6
+
+/* Edges used for the frequency estimate */
+#define WINDOW 64
+
+/* Edges needed before trusting the frequency estimate */
+#define MIN_EDGES 8
+
+/* Reject intervals further than this from a whole number of seconds */
+#define MAX_PPM 500
+
+/* Give up if there hasn't been an edge for this long (microseconds) */
+#define LOST_US 3000000
+
+/* Read the DS3231 registers to check the label this often (edges) */
+#define LABEL_CHECK 600
+
+/* Only read the label this soon after the edge (microseconds).  Any later,
+ * and the registers might already hold the next second. */
+#define LABEL_READ_US 500000
+
+/* DS3231 is specified to +/- 2 ppm, plus a little for our estimate */
+#define LOCKED_DRIFT_PPM 3
+
+/* Written by the interrupt handler */
+static volatile uint64_t edge_us;
+static volatile uint32_t n_edges = 0;
+
+static int active = 0;
+static uint32_t seen_edges = 0;
+static uint64_t ring_local[WINDOW];     /* time_us_64() at each edge */
+static uint32_t ring_count[WINDOW];     /* Seconds since the first edge */
+static int ring_n = 0;
+static int ring_head = 0;
+static uint32_t count = 0;
+static uint32_t label = 0;              /* UTC second which began at the edge */
+static uint32_t since_check = 0;
+static int freq_valid = 0;
+static int64_t freq_q32 = 0;
+static uint32_t restarts = 0;
+static uint32_t seen_sets = 0;
+static int verify = 0;
+
+
+static void sqw_irq()
+{
+    if ( gpio_get_irq_event_mask(PIN_SQW) & GPIO_IRQ_EDGE_FALL ) {
+        gpio_acknowledge_irq(PIN_SQW, GPIO_IRQ_EDGE_FALL);
+        edge_us = time_us_64();
+        n_edges++;
+    }
+}
+
+
+void pps_init()
+{
+    if ( !ds3231_found() ) return;
+
+    /* INT/SQW is open-drain */
+    gpio_init(PIN_SQW);
+    gpio_set_dir(PIN_SQW, GPIO_IN);
+    gpio_pull_up(PIN_SQW);
+    gpio_add_raw_irq_handler(PIN_SQW, sqw_irq);
+    gpio_set_irq_enabled(PIN_SQW, GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+    active = 1;
+}
+
+
+static void restart(const char *why)
+{
+    if ( label != 0 ) printf("DS3231 1 Hz lost (%s)\n", why);
+    if ( freq_valid ) clock_set_freq(freq_q32, CLOCK_DRIFT_PPM);
+    ring_n = 0;
+    label = 0;
+    freq_valid = 0;
+    restarts++;
+}
+
+
+/* The edge has just happened, so the registers hold the second which
+ * began at the edge */
+static int read_label(uint32_t *secs)
+{
+    datetime_t t;
+    if ( ds3231_get_datetime(&t) ) return 1;
+    *secs = clock_from_datetime(&t) / 1000000;
+    return 0;
+}
+
+
+static int ring_index(int back)
+{
+    return (ring_head - 1 - back + WINDOW) % WINDOW;
+}
+
+
+static void update_freq()
+{
+    int oldest = ring_index(ring_n-1);
+    int newest = ring_index(0);
+    int64_t span = (ring_count[newest] - ring_count[oldest]) * (int64_t)1000000;
+    int64_t err = ring_local[newest] - ring_local[oldest] - span;
+
+    freq_q32 = err * 4294967296LL / span;
+    clock_set_freq(freq_q32, LOCKED_DRIFT_PPM);
+    if ( !freq_valid ) {
+        printf("Locked to DS3231 1 Hz, crystal error %+li ppb\n",
+               (int32_t)((freq_q32 * 1000000000) >> 32));
+        freq_valid = 1;
+    }
+}
+
+
+void pps_poll()
+{
+    uint32_t n, since_edge;
+    uint64_t t;
+
+    if ( !active ) return;
+
+    /* The handler could run in between */
+    do {
+        n = n_edges;
+        t = edge_us;
+    } while ( n != n_edges );
+
+    if ( n == seen_edges ) {
+        if ( (ring_n > 0) && (time_us_64() - t > LOST_US) ) {
+            restart("no edges");
+        }
+        return;
+    }
+    seen_edges = n;
+    since_edge = time_us_64() - t;
+    record_input(REC_PPS, &since_edge, 4);
+
+    /* Setting the DS3231 restarts its countdown, so the edges jump.  This
+     * edge might have come before that, so wait for the next one.  The
+     * crystal frequency estimate is still good. */
+    if ( ds3231_set_count() != seen_sets ) {
+        seen_sets = ds3231_set_count();
+        ring_n = 0;
+        label = 0;
+        verify = 1;
+        return;
+    }
+
+    if ( ring_n > 0 ) {
+
+        uint64_t interval = t - ring_local[ring_index(0)];
+        uint32_t secs = (interval + 500000) / 1000000;
+        int64_t err = interval - secs*(int64_t)1000000;
+
+        /* Usually one second, but we might have missed some edges */
+        if ( err < 0 ) err = -err;
+        if ( (secs == 0) || (err > secs*MAX_PPM) ) {
+            restart("wrong rate");
+            return;
+        }
+        count += secs;
+        if ( label != 0 ) label += secs;
+
+    } else {
+        count = 0;
+    }
+
+    if ( (label == 0) || (++since_check >= LABEL_CHECK) ) {
+        uint32_t regs;
+        if ( since_edge > LABEL_READ_US ) {
+            /* Too late to be sure, so try again at the next edge */
+            since_check = LABEL_CHECK;
+        } else {
+            since_check = 0;
+            if ( read_label(&regs) ) {
+                restart("can't read DS3231");
+                return;
+            }
+            if ( (label != 0) && (regs != label) ) {
+                printf("DS3231 time moved by %li s\n",
+                       (int32_t)(regs - label));
+            }
+            label = regs;
+        }
+    }
+
+    ring_local[ring_head] = t;
+    ring_count[ring_head] = count;
+    ring_head = (ring_head + 1) % WINDOW;
+    if ( ring_n < WINDOW ) ring_n++;
+
+    if ( ring_n >= MIN_EDGES ) update_freq();
+    if ( label == 0 ) return;
+    if ( verify ) {
+        int64_t diff = (uint64_t)label*1000000 - clock_utc_us(t);
+        printf("DS3231 set, now %+lli us from our time\n", diff);
+        verify = 0;
+    }
+
+    clock_set(CLOCK_SRC_DS3231, (uint64_t)label*1000000, t,
+              ds3231_error_us());
+}
+
+
+/* Returns non-zero if the edges are giving the DS3231 time to the clock
+ * core, so there's no need to read it separately */
+int pps_locked()
+{
+    return label != 0;
+}
+
+
+void pps_show()
+{
+    if ( !active ) {
+        printf("DS3231 1 Hz input not in use\n");
+        return;
+    }
+    printf("DS3231 1 Hz: %li edges, %s, %li restarts\n", n_edges,
+           (label != 0) ? "locked" : "not locked", restarts);
+    if ( freq_valid ) {
+        printf("Crystal error: %+li ppb over the last %i s\n",
+               (int32_t)((freq_q32 * 1000000000) >> 32), ring_n - 1);
+    }
+}
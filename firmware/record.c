@@ -0,0 +1,233 @@
+/*
+ * record.c
+ *
+ * Recording external inputs, for replay on the host
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The inputs from outside, in a ring buffer so that the latest are
+ * always there.  Each record is:
+ *
+ *   type (1 byte)
+ *   length of data (varint)
+ *   microseconds since the previous record (varint)
+ *   data
+ *
+ * where a varint is 7 bits per byte, least significant first, with the
+ * top bit set on all but the last byte.  The oldest records are dropped
+ * to make room.  'record dump' prints the ring in hex, along with the
+ * settings in force at the start, and host/replay.c feeds it back
+ * through the firmware code.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "settings.h"
+#include "record.h"
+
+#define RECORD_SIZE 16384
+
+/* Lines of hex printed by each call to record_poll() */
+#define DUMP_LINES 8
+
+/* Longest possible header: type, then two varints */
+#define MAX_HEADER (1 + 5 + 10)
+
+static uint8_t ring[RECORD_SIZE];
+static size_t head = 0;         /* Where the next record goes */
+static size_t tail = 0;         /* Oldest record */
+static size_t used = 0;
+static uint64_t last_us = 0;    /* Time of the newest record */
+static uint64_t base_us = 0;    /* Time that the oldest record counts from */
+static uint32_t dropped = 0;
+
+/* Dump in progress (recording is paused until it's finished) */
+static int dumping = 0;
+static size_t dump_pos;
+static size_t dump_left;
+static uint32_t missed = 0;
+
+/* Settings in force at the oldest record, if that's not the first */
+static struct mt_settings start_settings;
+static int have_start_settings = 0;
+
+static const char *type_names[] = {"boot", "settings", "DS3231", "NTP",
+                                   "1 Hz", "button", "terminal", "retained",
+                                   "LEDs"};
+static uint32_t type_counts[REC_NUM_TYPES];
+
+
+static void put(uint8_t byte)
+{
+    ring[head] = byte;
+    head = (head + 1) % RECORD_SIZE;
+    used++;
+}
+
+
+static void put_varint(uint64_t v)
+{
+    while ( v >= 0x80 ) {
+        put((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    put(v);
+}
+
+
+static uint8_t get(size_t *pos)
+{
+    uint8_t byte = ring[*pos];
+    *pos = (*pos + 1) % RECORD_SIZE;
+    return byte;
+}
+
+
+static uint64_t get_varint(size_t *pos)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = get(pos);
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while ( byte & 0x80 );
+    return v;
+}
+
+
+static void drop_oldest()
+{
+    size_t pos = tail;
+    int type = get(&pos);
+    size_t len = get_varint(&pos);
+    uint64_t dt = get_varint(&pos);
+    size_t i;
+
+    /* Keep the latest settings which have gone */
+    if ( (type == REC_SETTINGS) && (len == sizeof(start_settings)) ) {
+        uint8_t *s = (uint8_t *)&start_settings;
+        for ( i=0; i<len; i++ ) s[i] = get(&pos);
+        have_start_settings = 1;
+    } else {
+        pos = (pos + len) % RECORD_SIZE;
+    }
+
+    used -= (pos + RECORD_SIZE - tail) % RECORD_SIZE;
+    tail = pos;
+    base_us += dt;
+    dropped++;
+}
+
+
+/* Call from the main loop (not from interrupts) with an input */
+void record_input(int type, const void *data, size_t len)
+{
+    uint64_t now = time_us_64();
+    const uint8_t *d = data;
+    size_t i;
+
+    if ( dumping ) {
+        missed++;
+        return;
+    }
+    if ( len + MAX_HEADER > RECORD_SIZE ) return;
+    while ( used + len + MAX_HEADER > RECORD_SIZE ) drop_oldest();
+
+    /* The first record ever counts from zero, i.e. the time since boot */
+    put(type);
+    put_varint(len);
+    put_varint(now - last_us);
+    for ( i=0; i<len; i++ ) put(d[i]);
+
+    last_us = now;
+    if ( type < REC_NUM_TYPES ) type_counts[type]++;
+}
+
+
+void record_show()
+{
+    int i;
+
+    printf("Input recording: %i of %i bytes used, %li records dropped, "
+           "%li missed during dumps\n", used, RECORD_SIZE, dropped, missed);
+    if ( used > 0 ) {
+        printf("Covers the last %lli s\n", (time_us_64() - base_us)/1000000);
+    }
+    for ( i=0; i<REC_NUM_TYPES; i++ ) {
+        printf("  %-9s %li\n", type_names[i], type_counts[i]);
+    }
+}
+
+
+static void dump_hex(const char *what, const uint8_t *buf, size_t len)
+{
+    size_t i;
+    printf("@rec %s ", what);
+    for ( i=0; i<len; i++ ) printf("%02x", buf[i]);
+    printf("\n");
+}
+
+
+/* Starts printing the recording, for host/replay.c.  The lines start
+ * with '@rec', so that the rest of the console output can be left in.
+ * It's done a few lines at a time by record_poll(), so as not to hold up
+ * the main loop. */
+void record_dump()
+{
+    printf("@rec start %lli\n", base_us);
+    if ( have_start_settings ) {
+        const uint8_t *s = (const uint8_t *)&start_settings;
+        size_t i;
+        for ( i=0; i<sizeof(start_settings); i+=32 ) {
+            dump_hex("settings", s+i, 32);
+        }
+    }
+    dump_pos = tail;
+    dump_left = used;
+    dumping = 1;
+}
+
+
+void record_poll()
+{
+    uint8_t line[32];
+    int n;
+
+    if ( !dumping ) return;
+
+    for ( n=0; (n<DUMP_LINES) && (dump_left > 0); n++ ) {
+        size_t len = (dump_left > sizeof(line)) ? sizeof(line) : dump_left;
+        size_t i;
+        for ( i=0; i<len; i++ ) line[i] = get(&dump_pos);
+        dump_hex("data", line, len);
+        dump_left -= len;
+    }
+
+    if ( dump_left == 0 ) {
+        printf("@rec end\n");
+        dumping = 0;
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ * record.h
+ *
+ * Recording external inputs, for replay on the host
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Record types.  The data for each is little-endian. */
+#define REC_BOOT 0              /* (nothing) */
+#define REC_SETTINGS 1          /* struct mt_settings, after settings_read() */
+#define REC_DS3231 2            /* ok(1) duration_us(2) regs 0-6(7) */
+#define REC_NTP 3               /* addr(4) port(2) packet(48) */
+#define REC_PPS 4               /* us since the edge(4) */
+#define REC_BUTTON 5            /* level(1) */
+#define REC_TERMINAL 6          /* character(1) */
+#define REC_RETAINED 7          /* utc_us(8) error_us(4) */
+#define REC_LEDS 8              /* leds(1), the decision (for checking) */
+#define REC_NUM_TYPES 9
+
+extern void record_input(int type, const void *data, size_t len);
+extern void record_show(void);
+extern void record_dump(void);
+extern void record_poll(void);
@@ -0,0 +1,137 @@
+/*
+ * retain.c
+ *
+ * Keeping the time across warm restarts
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The RAM isn't cleared by a watchdog restart, so we keep a note of the
+ * UTC time at which time_us_64() was zero (according to the clock core),
+ * its error bound, and the last time we knew that to be right.  The timer
+ * starts again from zero at the restart, so after the restart, the time
+ * is (roughly) the old base plus the old uptime plus the new uptime.
+ *
+ * The note is only trusted after a watchdog restart, and only if its
+ * checksum is right.  After a power cut, the RAM contents are random.
+ */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+#include <hardware/watchdog.h>
+
+#include "clock.h"
+#include "supervisor.h"
+#include "retain.h"
+#include "record.h"
+
+#define RETAIN_MAGIC 0x4d54524e
+
+struct retained_time
+{
+    uint32_t magic;
+    uint32_t restarting;        /* Set just before a deliberate restart */
+    uint64_t utc_base_us;       /* UTC when time_us_64() was zero */
+    uint64_t last_us;           /* time_us_64() when last known good */
+    uint32_t error_us;          /* Error bound at last_us */
+    uint32_t check;
+};
+
+static struct retained_time __uninitialized_ram(retained);
+
+
+static uint32_t checksum(const struct retained_time *r)
+{
+    return r->magic ^ r->restarting
+         ^ (uint32_t)r->utc_base_us ^ (uint32_t)(r->utc_base_us >> 32)
+         ^ (uint32_t)r->last_us ^ (uint32_t)(r->last_us >> 32)
+         ^ r->error_us ^ 0xa5a5a5a5;
+}
+
+
+static void write_note(uint64_t now, int restarting)
+{
+    uint64_t utc = clock_utc_us(now);
+
+    if ( utc == 0 ) {
+        retained.magic = 0;
+        return;
+    }
+
+    retained.magic = RETAIN_MAGIC;
+    retained.restarting = restarting;
+    retained.utc_base_us = utc - now;
+    retained.last_us = now;
+    retained.error_us = clock_error_us();
+    retained.check = checksum(&retained);
+}
+
+
+/* Call early at startup.  Returns 0 if the time was restored */
+int retain_restore()
+{
+    uint64_t elapsed;
+    uint32_t slack_us;
+    struct __attribute__((packed)) {
+        uint64_t utc_us;
+        uint32_t error_us;
+    } rec;
+
+    if ( retained.magic != RETAIN_MAGIC ) return 1;
+    if ( retained.check != checksum(&retained) ) return 1;
+    retained.magic = 0;
+
+    if ( retained.restarting ) {
+        elapsed = retained.last_us;
+        slack_us = 0;
+    } else if ( watchdog_enable_caused_reboot() ) {
+        /* The last update was just after the last time the watchdog was
+         * fed, so it went off WATCHDOG_MS later, give or take a trip
+         * round the main loop */
+        elapsed = retained.last_us + WATCHDOG_MS*1000;
+        slack_us = 100000;
+    } else {
+        return 1;
+    }
+
+    rec.utc_us = retained.utc_base_us + elapsed;
+    rec.error_us = retained.error_us + slack_us;
+    record_input(REC_RETAINED, &rec, sizeof(rec));
+
+    clock_set(CLOCK_SRC_RETAINED, rec.utc_us, 0, rec.error_us);
+    printf("Time restored after restart (+/- %li ms)\n",
+           (retained.error_us + slack_us)/1000);
+    return 0;
+}
+
+
+/* Call from the main loop, just after feeding the watchdog */
+void retain_update()
+{
+    write_note(time_us_64(), 0);
+}
+
+
+/* Call just before a deliberate restart, so that the next boot knows
+ * exactly how long we were running for */
+void retain_restarting()
+{
+    write_note(time_us_64(), 1);
+}
@@ -0,0 +1,85 @@
+/*
+ * schedule.c
+ *
+ * Weekly LED schedule
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "settings.h"
+#include "schedule.h"
+
+
+/* One byte per minute of the (local) week, one bit per LED channel.
+ * 10 kB of RAM buys us a lookup which costs the same no matter how many
+ * events are configured. */
+static uint8_t schedule_map[MINUTES_PER_WEEK];
+
+
+void schedule_compile()
+{
+    int i;
+
+    memset(schedule_map, 0, sizeof(schedule_map));
+
+    for ( i=0; i<MAX_EVENTS; i++ ) {
+
+        const struct mt_event *e = &settings.events[i];
+        int day, len;
+
+        if ( e->days == 0 ) continue;
+        if ( e->channel >= MAX_CHANNELS ) continue;
+        if ( e->on_min >= MINUTES_PER_DAY ) continue;
+        if ( e->off_min >= MINUTES_PER_DAY ) continue;
+
+        /* Off time earlier than on time means "off the next day" */
+        len = (e->off_min - e->on_min + MINUTES_PER_DAY) % MINUTES_PER_DAY;
+
+        for ( day=0; day<7; day++ ) {
+            int start, m;
+            if ( !(e->days & 1<<day) ) continue;
+            start = day*MINUTES_PER_DAY + e->on_min;
+            for ( m=0; m<len; m++ ) {
+                schedule_map[(start+m) % MINUTES_PER_WEEK] |= 1<<e->channel;
+            }
+        }
+    }
+}
+
+
+/* Returns a bitmask of LED channels which should be lit */
+uint8_t schedule_lookup(int minute_of_week)
+{
+    if ( (minute_of_week < 0) || (minute_of_week >= MINUTES_PER_WEEK) ) return 0;
+    return schedule_map[minute_of_week];
+}
+
+
+/* Convert UTC (seconds since 1970) to the minute of the local week
+ * (0 = Sunday 00:00 local).  Working in minutes of the week takes care of
+ * the local day being different to the UTC day.  1970-01-01 was a
+ * Thursday. */
+int schedule_minute_of_week(uint32_t utc)
+{
+    int32_t local = utc/60 + (settings.utc_offset + dst(utc))*60;
+    return (local + 4*MINUTES_PER_DAY) % MINUTES_PER_WEEK;
+}
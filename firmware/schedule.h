@@ -0,0 +1,28 @@
+/*
+ * schedule.h
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define MINUTES_PER_DAY (24*60)
+#define MINUTES_PER_WEEK (7*MINUTES_PER_DAY)
+
+extern void schedule_compile(void);
+extern uint8_t schedule_lookup(int minute_of_week);
+extern int schedule_minute_of_week(uint32_t utc);
@@ -0,0 +1,368 @@
+/*
+ * serialctl.c
+ *
+ * Binary control protocol on the console link
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The same messages as over UDP (see ctl.h), for units on a USB cable.
+ * Each message is followed by its CRC-16 (CCITT: polynomial 0x1021,
+ * starting from 0xffff, little-endian), COBS-encoded so that there are
+ * no zero bytes in it, and sent with a zero byte before and after.
+ *
+ * Nobody can type a zero byte, so the terminal hands everything from one
+ * onwards to serialctl_input(), and goes back to normal if the rest of
+ * the frame doesn't arrive within half a second.  The firmware's printf()
+ * output carries on between frames, so the host should ignore anything
+ * which doesn't decode.
+ *
+ *  CTL_STATUS         -> struct mt_status
+ *  CTL_GET_SETTINGS   -> struct mt_settings (one flash page)
+ *  CTL_SET_SETTINGS   struct mt_settings -> (empty)
+ *  CTL_SAVE_SETTINGS  -> (empty)
+ *  CTL_SUBSCRIBE      struct ctl_subscribe -> (empty)
+ *
+ * After CTL_SUBSCRIBE, a CTL_TELEMETRY message (struct mt_status, with
+ * CTL_REPLY and the request's sequence number) comes every 'period_ms'
+ * for 'duration_s' seconds.  The host should subscribe again before then,
+ * so that the messages stop by themselves when it goes away.
+ *
+ * Failures are answered with CTL_ERROR and a one byte error code, as
+ * over UDP.  Whoever is at the other end of the cable could type commands
+ * anyway, so unlike over UDP, 'remote on' isn't needed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+#if LIB_PICO_STDIO_USB
+#include <pico/stdio_usb.h>
+#endif
+#if LIB_PICO_STDIO_UART
+#include <pico/stdio_uart.h>
+#endif
+
+#include "serialctl.h"
+#include "ctl.h"
+#include "status.h"
+#include "settings.h"
+
+#define FRAME_TIMEOUT_US 500000
+#define MIN_PERIOD_MS 100
+
+/* Message with the largest payload, plus the CRC */
+#define MSG_MAX (sizeof(struct ctl_header) + sizeof(struct mt_settings) + 2)
+
+/* COBS adds one byte per 254, and one more */
+#define ENCODED_MAX (MSG_MAX + MSG_MAX/254 + 1)
+
+_Static_assert(sizeof(struct mt_status) <= sizeof(struct mt_settings),
+               "Status must fit in the message buffer");
+
+struct __attribute__((packed)) ctl_subscribe
+{
+    uint16_t period_ms;         /* 0 = stop */
+    uint16_t duration_s;
+};
+
+/* The message being decoded or sent.  Aligned so that the payload, after
+ * the 8-byte header, can be used directly as struct mt_settings. */
+static uint8_t msg[MSG_MAX] __attribute__((aligned(4)));
+
+/* The frame being received, still encoded */
+static uint8_t rx[ENCODED_MAX];
+static size_t rx_len = 0;
+static int rx_overflow = 0;
+static int receiving = 0;
+static uint64_t last_rx_us;
+
+static uint64_t telemetry_period_us = 0;
+static uint64_t telemetry_next_us;
+static uint64_t telemetry_end_us;
+static uint32_t telemetry_seq;
+
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xffff;
+    size_t i;
+    int b;
+
+    for ( i=0; i<len; i++ ) {
+        crc ^= data[i] << 8;
+        for ( b=0; b<8; b++ ) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+
+/* Each zero is replaced by the distance to the next one, counting from a
+ * code byte at the start.  A run of 254 non-zero bytes needs another code
+ * byte.  Returns the encoded length. */
+static size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_pos = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    size_t i;
+
+    for ( i=0; i<len; i++ ) {
+        if ( in[i] != 0 ) {
+            out[o++] = in[i];
+            code++;
+        }
+        if ( (in[i] == 0) || (code == 0xff) ) {
+            out[code_pos] = code;
+            code_pos = o++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    return o;
+}
+
+
+/* Returns the decoded length, or -1 if it's not valid or longer than
+ * 'max' */
+static int cobs_decode(const uint8_t *in, size_t len, uint8_t *out, size_t max)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while ( i < len ) {
+        uint8_t code = in[i++];
+        int j;
+
+        if ( (code == 0) || (i + code - 1 > len) ) return -1;
+        if ( o + code - 1 > max ) return -1;
+        for ( j=1; j<code; j++ ) out[o++] = in[i++];
+        if ( (code != 0xff) && (i < len) ) {
+            if ( o == max ) return -1;
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+
+/* Newlines in text are sent as \r\n, which would break a frame */
+static void translate_crlf(bool on)
+{
+#if LIB_PICO_STDIO_USB
+    stdio_set_translate_crlf(&stdio_usb, on);
+#endif
+#if LIB_PICO_STDIO_UART
+    stdio_set_translate_crlf(&stdio_uart, on);
+#endif
+}
+
+
+/* Fills in the header, and returns where the payload goes */
+static void *reply(uint8_t op, uint32_t seq)
+{
+    struct ctl_header *h = (struct ctl_header *)msg;
+
+    h->magic = CTL_MAGIC;
+    h->version = CTL_VERSION;
+    h->op = op | CTL_REPLY;
+    h->seq = seq;
+    return msg + sizeof(struct ctl_header);
+}
+
+
+/* Sends the message in 'msg', with 'len' bytes after the header */
+static void send_msg(size_t len)
+{
+    static uint8_t frame[ENCODED_MAX+2];
+    uint16_t crc;
+    size_t n;
+
+    len += sizeof(struct ctl_header);
+    crc = crc16(msg, len);
+    msg[len++] = crc & 0xff;
+    msg[len++] = crc >> 8;
+
+    frame[0] = 0;
+    n = 1 + cobs_encode(msg, len, frame+1);
+    frame[n++] = 0;
+
+    fflush(stdout);
+    translate_crlf(false);
+    fwrite(frame, 1, n, stdout);
+    fflush(stdout);
+    translate_crlf(true);
+}
+
+
+static void send_error(uint32_t seq, uint8_t code)
+{
+    *(uint8_t *)reply(CTL_ERROR, seq) = code;
+    send_msg(1);
+}
+
+
+static void subscribe(const struct ctl_subscribe *sub, uint32_t seq)
+{
+    uint64_t now = time_us_64();
+
+    if ( sub->period_ms == 0 ) {
+        telemetry_period_us = 0;
+        return;
+    }
+
+    telemetry_period_us = 1000ULL * ((sub->period_ms < MIN_PERIOD_MS)
+                                     ? MIN_PERIOD_MS : sub->period_ms);
+    telemetry_next_us = now;
+    telemetry_end_us = now + 1000000ULL*sub->duration_s;
+    telemetry_seq = seq;
+}
+
+
+static void frame_received()
+{
+    struct ctl_header h;
+    void *payload = msg + sizeof(h);
+    int len;
+
+    len = cobs_decode(rx, rx_len, msg, sizeof(msg));
+    if ( len < (int)sizeof(h)+2 ) return;
+    if ( crc16(msg, len-2) != (msg[len-2] | (msg[len-1] << 8)) ) return;
+    memcpy(&h, msg, sizeof(h));
+    if ( h.magic != CTL_MAGIC ) return;
+    len -= sizeof(h) + 2;
+
+    counters.ctl_requests++;
+
+    if ( h.version != CTL_VERSION ) {
+        send_error(h.seq, CTL_ERR_BAD_VERSION);
+        return;
+    }
+
+    switch ( h.op ) {
+
+        case CTL_STATUS :
+        status_fill(reply(h.op, h.seq));
+        send_msg(sizeof(struct mt_status));
+        break;
+
+        case CTL_GET_SETTINGS :
+        memcpy(reply(h.op, h.seq), &settings, sizeof(struct mt_settings));
+        send_msg(sizeof(struct mt_settings));
+        break;
+
+        case CTL_SET_SETTINGS :
+        if ( len != sizeof(struct mt_settings) ) {
+            send_error(h.seq, CTL_ERR_BAD_REQUEST);
+        } else if ( settings_replace(payload) ) {
+            send_error(h.seq, CTL_ERR_BAD_SETTINGS);
+        } else {
+            reply(h.op, h.seq);
+            send_msg(0);
+        }
+        break;
+
+        case CTL_SAVE_SETTINGS :
+        settings_write();
+        reply(h.op, h.seq);
+        send_msg(0);
+        break;
+
+        case CTL_SUBSCRIBE :
+        if ( len != sizeof(struct ctl_subscribe) ) {
+            send_error(h.seq, CTL_ERR_BAD_REQUEST);
+            break;
+        }
+        subscribe(payload, h.seq);
+        reply(h.op, h.seq);
+        send_msg(0);
+        break;
+
+        default :
+        send_error(h.seq, CTL_ERR_BAD_REQUEST);
+        break;
+
+    }
+}
+
+
+/* Non-zero while in the middle of a frame */
+int serialctl_receiving()
+{
+    if ( receiving && (time_us_64() - last_rx_us > FRAME_TIMEOUT_US) ) {
+        receiving = 0;
+        rx_len = 0;
+        rx_overflow = 0;
+    }
+    return receiving;
+}
+
+
+/* Takes 'c', and then anything else which has already arrived, up to the
+ * end of the frame */
+void serialctl_input(int c)
+{
+    while ( c != PICO_ERROR_TIMEOUT ) {
+
+        last_rx_us = time_us_64();
+
+        if ( c != 0 ) {
+            if ( rx_len < sizeof(rx) ) {
+                rx[rx_len++] = c;
+            } else {
+                rx_overflow = 1;
+            }
+        } else if ( rx_len > 0 ) {
+            if ( !rx_overflow ) frame_received();
+            rx_len = 0;
+            rx_overflow = 0;
+            receiving = 0;
+            return;
+        } else {
+            /* Start of a frame, or several zeros in a row */
+            receiving = 1;
+        }
+
+        c = getchar_timeout_us(0);
+    }
+}
+
+
+void serialctl_poll()
+{
+    uint64_t now;
+
+    if ( telemetry_period_us == 0 ) return;
+
+    now = time_us_64();
+    if ( now < telemetry_next_us ) return;
+    if ( now >= telemetry_end_us ) {
+        telemetry_period_us = 0;
+        return;
+    }
+
+    status_fill(reply(CTL_TELEMETRY, telemetry_seq));
+    send_msg(sizeof(struct mt_status));
+
+    telemetry_next_us += telemetry_period_us;
+    if ( telemetry_next_us < now ) telemetry_next_us = now + telemetry_period_us;
+}
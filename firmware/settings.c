@@ -23,41 +23,216 @@
 
 #include <hardware/flash.h>
 #include <hardware/sync.h>
-#include <hardware/rtc.h>
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
 
+#include "calendar.h"
 #include "settings.h"
+#include "record.h"
+#include "schedule.h"
 
 
 struct mt_settings settings;
-const int signature = 0x4e54574d;   /* "MTWN" */
+const int signature = 0x3254574d;   /* "MWT2" */
+const int signature_v0 = 0x4e54574d;   /* "MWTN", before schedules */
 const size_t last_sector = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
 const int n_pages = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
 
+_Static_assert(sizeof(struct mt_settings) == FLASH_PAGE_SIZE,
+               "Settings must occupy exactly one flash page");
+
+
+/* Layout used before the weekly schedule was introduced */
+struct mt_settings_v0
+{
+    uint32_t signature;
+    uint32_t version;
+
+    uint32_t morning_hour;
+    uint32_t morning_min;
+    uint32_t late_hour;
+    uint32_t late_min;
+    uint32_t clear_hour;
+    int32_t utc_offset;
+    uint32_t morning_pin;
+    uint32_t late_pin;
+};
+
+
+static void set_event(struct mt_event *e, int channel, int on_min, int off_min)
+{
+    e->days = 0x7f;
+    e->channel = channel;
+    e->on_min = on_min;
+    e->off_min = off_min;
+}
+
+
 static void settings_default(struct mt_settings *s)
 {
+    int i;
+
+    memset(s, 0, sizeof(struct mt_settings));
     s->signature = signature;
     s->version = 0;
-    s->morning_hour = 7;
-    s->morning_min = 15;
-    s->late_hour = 8;
-    s->late_min = 0;
-    s->clear_hour = 12;
-    s->morning_pin = 19;  /* Use 21 for cheap and cheerful hardware */
-    s->late_pin = 22;
     s->utc_offset = 1;
+
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        s->channel_pin[i] = CHANNEL_UNUSED;
+    }
+    s->channel_pin[CH_WAKE] = 19;  /* Use 21 for cheap and cheerful hardware */
+    s->channel_pin[CH_RISE] = 22;
+
+    set_event(&s->events[0], CH_WAKE, 7*60+15, 12*60);
+    set_event(&s->events[1], CH_RISE, 8*60, 12*60);
+}
+
+
+static void settings_from_v0(struct mt_settings *s, const struct mt_settings_v0 *old)
+{
+    settings_default(s);
+    s->version = old->version;
+    s->utc_offset = old->utc_offset;
+    s->channel_pin[CH_WAKE] = old->morning_pin;
+    s->channel_pin[CH_RISE] = old->late_pin;
+    set_event(&s->events[0], CH_WAKE, old->morning_hour*60+old->morning_min,
+              old->clear_hour*60);
+    set_event(&s->events[1], CH_RISE, old->late_hour*60+old->late_min,
+              old->clear_hour*60);
+}
+
+
+/* GPIOs which LED channels can't have: the DS3231's I2C (ds3231.c) and
+ * 1 Hz output (pps.c), the test button (morningtown.c), the UART console
+ * if there is one, and the ones used inside the board (board LED, power
+ * supply, wireless chip) */
+#define NUM_GPIOS 30
+#define RESERVED_PINS_BOARD ((1u<<4) | (1u<<5) | (1u<<6) | (1u<<16) \
+                             | (1u<<23) | (1u<<24) | (1u<<25) | (1u<<29))
+#if LIB_PICO_STDIO_UART
+#define RESERVED_PINS (RESERVED_PINS_BOARD | (1u<<0) | (1u<<1))
+#else
+#define RESERVED_PINS RESERVED_PINS_BOARD
+#endif
+
+#define KNOWN_FLAGS (SETTING_NTP_BROADCAST | SETTING_NTP_SERVER \
+                     | SETTING_REMOTE_CONFIG)
+
+
+/* Returns NULL if 's' is fine, otherwise what's wrong with it.  The
+ * ranges are the same as the terminal commands allow.  Any current is
+ * allowed in energy_ua, as with the 'energy' command. */
+static const char *settings_problem(const struct mt_settings *s)
+{
+    int i;
+
+    if ( (s->utc_offset < -12) || (s->utc_offset > 14) ) return "UTC offset";
+
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        uint8_t pin = s->channel_pin[i];
+        if ( pin == CHANNEL_UNUSED ) continue;
+        if ( (pin >= NUM_GPIOS) || (RESERVED_PINS & (1u<<pin)) ) {
+            return "LED pin";
+        }
+    }
+
+    for ( i=0; i<MAX_EVENTS; i++ ) {
+        const struct mt_event *e = &s->events[i];
+        if ( e->days == 0 ) continue;
+        if ( (e->days > 0x7f) || (e->channel >= MAX_CHANNELS)
+          || (e->on_min >= MINUTES_PER_DAY)
+          || (e->off_min >= MINUTES_PER_DAY) ) return "schedule";
+    }
+
+    for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+        if ( memchr(s->ntp_server[i], '\0', sizeof(s->ntp_server[i])) == NULL ) {
+            return "NTP server name";
+        }
+    }
+
+    if ( s->net_channel > 14 ) return "network cache";
+    if ( s->flags & ~KNOWN_FLAGS ) return "flags";
+    if ( s->holdover_max_s > 3600 ) return "holdover time";
+    if ( s->holdover_policy > HOLDOVER_OFF ) return "holdover policy";
+    return NULL;
+}
+
+
+static const char *holdover_names[] = {"carry on, blink board LED",
+                                       "hold LEDs", "LEDs off"};
+
+
+/* Unknown values (from newer firmware) are treated as HOLDOVER_FLAG */
+int holdover_policy()
+{
+    if ( settings.holdover_policy > HOLDOVER_OFF ) return HOLDOVER_FLAG;
+    return settings.holdover_policy;
+}
+
+
+/* Error bounds are in microseconds, so this can't be much over an hour */
+uint32_t holdover_max_us()
+{
+    if ( settings.holdover_max_s == 0 ) return HOLDOVER_DEFAULT_S*1000000;
+    if ( settings.holdover_max_s > 4000 ) return 4000000000u;
+    return settings.holdover_max_s*1000000u;
+}
+
+
+static const char *days_str(uint8_t days)
+{
+    static char str[8];
+    const char *names = "SMTWTFS";
+    int i;
+    for ( i=0; i<7; i++ ) {
+        str[i] = (days & 1<<i) ? names[i] : '-';
+    }
+    str[7] = '\0';
+    return str;
 }
 
 
 void settings_show()
 {
+    int i;
+
     printf("Settings version %i\n", settings.version);
-    printf(" Wake after %02i:%02i\n", settings.morning_hour, settings.morning_min);
-    printf(" Rise before %02i:%02i\n", settings.late_hour, settings.late_min);
-    printf(" Clear LEDs at %02i:00\n", settings.clear_hour);
     printf(" Local time is UTC + %i hours\n", settings.utc_offset);
-    printf(" LED assignments wake=%i, rise=%i\n", settings.morning_pin, settings.late_pin);
+
+    printf(" LED channels:");
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        if ( settings.channel_pin[i] == CHANNEL_UNUSED ) continue;
+        printf(" %i=GPIO%i", i, settings.channel_pin[i]);
+    }
+    printf("\n");
+
+    if ( settings.flags & SETTING_NTP_BROADCAST ) {
+        printf(" Listening for NTP broadcasts\n");
+    }
+
+    if ( settings.flags & SETTING_NTP_SERVER ) {
+        printf(" Serving time via NTP\n");
+    }
+
+    if ( settings.flags & SETTING_REMOTE_CONFIG ) {
+        printf(" Settings can be changed via the network\n");
+    }
+
+    printf(" If the time might be more than %li s out: %s\n",
+           holdover_max_us()/1000000, holdover_names[holdover_policy()]);
+
+    for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+        if ( settings.ntp_server[i][0] == '\0' ) continue;
+        printf(" NTP server (if none from DHCP): %s\n", settings.ntp_server[i]);
+    }
+
+    for ( i=0; i<MAX_EVENTS; i++ ) {
+        const struct mt_event *e = &settings.events[i];
+        if ( e->days == 0 ) continue;
+        printf(" Event %2i: %s  channel %i  on %02i:%02i  off %02i:%02i\n",
+               i, days_str(e->days), e->channel,
+               e->on_min/60, e->on_min%60, e->off_min/60, e->off_min%60);
+    }
 }
 
 
@@ -65,6 +240,7 @@ int settings_read()
 {
     int i;
     struct mt_settings *sp = NULL;
+    struct mt_settings_v0 *sp0 = NULL;
     int max_version = 0;
 
     printf("Sector size = %li\n", FLASH_SECTOR_SIZE);
@@ -78,9 +254,17 @@ int settings_read()
 
         printf("Checking page %i (at %p) ... ", i, spm);
 
-        if ( (spm->signature == signature ) && (spm->version > max_version) ) {
+        if ( (spm->signature == signature) && (settings_problem(spm) != NULL) ) {
+            printf("version %i, bad %s\n", spm->version, settings_problem(spm));
+        } else if ( (spm->signature == signature ) && (spm->version > max_version) ) {
             printf("version %i\n", spm->version);
             sp = spm;
+            max_version = spm->version;
+        } else if ( spm->signature == signature_v0 ) {
+            printf(" (old format, version %i)\n", spm->version);
+            if ( (sp0 == NULL) || (spm->version > sp0->version) ) {
+                sp0 = (struct mt_settings_v0 *)spm;
+            }
         } else {
             if ( spm->signature != signature ) {
                 printf(" (no signature)\n");
@@ -93,21 +277,45 @@ int settings_read()
     if ( sp != NULL ) {
         printf("Found settings version %i at %p\n", sp->version, sp);
         settings = *sp;
+    } else if ( sp0 != NULL ) {
+        printf("Converting old settings version %i at %p\n", sp0->version, sp0);
+        settings_from_v0(&settings, sp0);
+        if ( settings_problem(&settings) != NULL ) {
+            printf("Bad %s in old settings, using defaults\n",
+                   settings_problem(&settings));
+            settings_default(&settings);
+        }
     } else {
         printf("No settings found, using defaults\n");
         settings_default(&settings);
     }
 
+    schedule_compile();
+    record_input(REC_SETTINGS, &settings, sizeof(settings));
     return 0;
 }
 
 
-int settings_write()
+static const struct mt_settings *latest_saved()
 {
     int i;
+    const struct mt_settings *sp = NULL;
+
+    for ( i=0; i<n_pages; i++ ) {
+        const struct mt_settings *spm = (struct mt_settings *)(XIP_BASE+last_sector+i*FLASH_PAGE_SIZE);
+        if ( spm->signature != signature ) continue;
+        if ( settings_problem(spm) != NULL ) continue;
+        if ( (sp == NULL) || (spm->version > sp->version) ) sp = spm;
+    }
+    return sp;
+}
+
+
+static int write_page(struct mt_settings *s)
+{
     uint32_t v;
 
-    if ( settings.version != 0 ) {
+    if ( s->version != 0 ) {
 
         int i;
 
@@ -115,11 +323,14 @@ int settings_write()
 
             struct mt_settings *spm = (struct mt_settings *)(XIP_BASE+last_sector+i*FLASH_PAGE_SIZE);
 
-            if ( spm->signature != signature ) {
-                settings.version++;
+            /* Only an erased page can be programmed */
+            if ( spm->signature == 0xffffffff ) {
+                s->version++;
                 printf("Saving settings version %i at %p (page %i)\n",
-                        settings.version, spm, i);
-                flash_range_program(last_sector+i*FLASH_PAGE_SIZE, (char *)&settings, FLASH_PAGE_SIZE);
+                        s->version, spm, i);
+                v = save_and_disable_interrupts();
+                flash_range_program(last_sector+i*FLASH_PAGE_SIZE, (char *)s, FLASH_PAGE_SIZE);
+                restore_interrupts(v);
                 return 0;
             }
 
@@ -132,60 +343,96 @@ int settings_write()
     v = save_and_disable_interrupts();
     flash_range_erase(PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE,
                       FLASH_SECTOR_SIZE);
-    settings.version++;
-    flash_range_program(last_sector, (char *)&settings, FLASH_PAGE_SIZE);
+    s->version++;
+    flash_range_program(last_sector, (char *)s, FLASH_PAGE_SIZE);
     restore_interrupts(v);
     return 0;
 }
 
 
-/* Hard-coded calculations because I can't be bothered to work out all the
- * special cases (leap years etc).  There's a decent chance that DST will have
- * been abolished in Europe by the time this table runs out, anyway.
- */
-static int last_sunday_in_march(time_t year)
-{
-    switch ( year ) {
-        case 2024: return 31;
-        case 2025: return 30;
-        case 2026: return 29;
-        case 2027: return 28;
-        case 2028: return 26;
-        case 2029: return 25;
-        case 2030: return 31;
-        default: return 28;  /* Guess! */
+int settings_write()
+{
+    return write_page(&settings);
+}
+
+
+/* Save the network cache on top of the last saved settings, so that any
+ * unsaved changes to the other settings don't get saved by accident. */
+int settings_write_netcache()
+{
+    struct mt_settings s;
+    const struct mt_settings *saved = latest_saved();
+    int r;
+
+    if ( saved != NULL ) {
+        s = *saved;
+    } else {
+        s = settings;
     }
+
+    memcpy(s.net_bssid, settings.net_bssid, sizeof(s.net_bssid));
+    s.net_channel = settings.net_channel;
+    s.net_ip = settings.net_ip;
+    s.net_netmask = settings.net_netmask;
+    s.net_gw = settings.net_gw;
+    s.net_lease_end = settings.net_lease_end;
+
+    r = write_page(&s);
+    settings.version = s.version;
+    return r;
 }
 
 
-static int last_sunday_in_october(time_t year)
+/* Take on settings sent by a remote control protocol (udpctl.c and
+ * serialctl.c), apart from our own version counter and network cache.
+ * Returns non-zero if 'ns' isn't valid settings. */
+int settings_replace(struct mt_settings *ns)
 {
-    switch ( year ) {
-        case 2024: return 27;
-        case 2025: return 26;
-        case 2026: return 25;
-        case 2027: return 31;
-        case 2028: return 29;
-        case 2029: return 28;
-        case 2030: return 27;
-        default: return 27;  /* Guess! */
+    const char *problem;
+    int i;
+
+    if ( ns->signature != settings.signature ) return 1;
+
+    ns->version = settings.version;
+    memcpy(ns->net_bssid, settings.net_bssid, sizeof(ns->net_bssid));
+    ns->net_channel = settings.net_channel;
+    ns->net_ip = settings.net_ip;
+    ns->net_netmask = settings.net_netmask;
+    ns->net_gw = settings.net_gw;
+    ns->net_lease_end = settings.net_lease_end;
+
+    for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+        ns->ntp_server[i][sizeof(ns->ntp_server[i])-1] = '\0';
+    }
+    problem = settings_problem(ns);
+    if ( problem != NULL ) {
+        printf("New settings rejected: bad %s\n", problem);
+        return 1;
     }
+
+    settings = *ns;
+    schedule_compile();
+    record_input(REC_SETTINGS, &settings, sizeof(settings));
+    return 0;
 }
 
 
-/* This is about the simplest possible case of local time handling, and it
- * still makes me want to hurl.  Ugh.
- *
- * Note that we don't care about the *time* of switching to/from DST (01:00 in
- * Europe), because the wakeup time is usually much later.
- */
-int32_t dst(datetime_t t)
+/* Daylight saving time, by the EU rule: from 01:00 UTC on the last Sunday
+ * in March until 01:00 UTC on the last Sunday in October.  Returns the
+ * number of hours to add. */
+int32_t dst(uint32_t utc)
 {
-    /* April to September inclusive. */
-    if ( (t.month >= 4) && (t.month <= 9) ) return 1;
+    int y, m, d;
 
-    if ( (t.month == 3) && (t.day >= last_sunday_in_march(t.year)) ) return 1;
-    if ( (t.month == 10) && (t.day < last_sunday_in_october(t.year)) ) return 1;
+    civil_from_days(utc / 86400, &y, &m, &d);
+    if ( (m > 3) && (m < 10) ) return 1;
 
+    /* Unsigned like utc, or the day number times 86400 overflows in 2038 */
+    if ( m == 3 ) {
+        return utc >= (uint32_t)last_weekday_of_month(y, 3, 0)*86400 + 3600;
+    }
+    if ( m == 10 ) {
+        return utc < (uint32_t)last_weekday_of_month(y, 10, 0)*86400 + 3600;
+    }
     return 0;
 }
@@ -20,26 +20,77 @@
  *
  */
 
+#define MAX_CHANNELS 8
+#define MAX_EVENTS 12
+#define NTP_MAX_SERVERS 2
+
+/* Bits in mt_settings.flags */
+#define SETTING_NTP_BROADCAST (1<<0)
+#define SETTING_NTP_SERVER (1<<1)
+#define SETTING_REMOTE_CONFIG (1<<2)
+#define CHANNEL_UNUSED 0xff
+
+/* What to do with the LEDs when the time might be further out than
+ * mt_settings.holdover_max_s (0 = HOLDOVER_DEFAULT_S) */
+#define HOLDOVER_FLAG 0         /* Follow the schedule, blink board LED */
+#define HOLDOVER_HOLD 1         /* Leave the LEDs as they are */
+#define HOLDOVER_OFF 2          /* Turn all the LEDs off */
+#define HOLDOVER_DEFAULT_S 300
+
+/* Channels used by the legacy wake/rise commands and the test button */
+#define CH_WAKE 0
+#define CH_RISE 1
+
+struct mt_event
+{
+    uint8_t days;       /* Bit 0 = Sunday ... bit 6 = Saturday.  0 = unused */
+    uint8_t channel;
+    uint16_t on_min;    /* Local time, minutes after midnight */
+    uint16_t off_min;   /* Ditto.  Earlier than on_min means next day */
+};
+
+
 struct mt_settings
 {
     uint32_t signature;
     uint32_t version;
 
-    uint32_t morning_hour;
-    uint32_t morning_min;
-    uint32_t late_hour;
-    uint32_t late_min;
-    uint32_t clear_hour;
     int32_t utc_offset;
-    uint32_t morning_pin;
-    uint32_t late_pin;
+    uint8_t channel_pin[MAX_CHANNELS];
+    struct mt_event events[MAX_EVENTS];
+
+    /* Last successful WLAN connection, for fast reconnection */
+    uint8_t net_bssid[6];
+    uint8_t net_channel;        /* 0 = nothing cached */
+    uint8_t net_reserved;
+    uint32_t net_ip;
+    uint32_t net_netmask;
+    uint32_t net_gw;
+    uint32_t net_lease_end;     /* UTC seconds since 1970 */
+
+    /* NTP servers to use if DHCP doesn't tell us.  Empty = unused */
+    char ntp_server[NTP_MAX_SERVERS][32];
+
+    uint32_t flags;
+
+    uint16_t holdover_max_s;
+    uint8_t holdover_policy;
+    uint8_t holdover_reserved;
+
+    /* Current (uA) when asleep, then extra for each ENERGY_xxx state (see
+     * energy.h).  0 = default */
+    uint16_t energy_ua[6];
 
-    char pad[54];  /* Pad to at least FLASH_PAGE_SIZE */
+    char pad[56];  /* Pad to FLASH_PAGE_SIZE */
 };
 
 
 extern struct mt_settings settings;
 extern int settings_read(void);
 extern int settings_write(void);
+extern int settings_write_netcache(void);
+extern int settings_replace(struct mt_settings *ns);
 extern void settings_show(void);
-extern int32_t dst(datetime_t t);
+extern int32_t dst(uint32_t utc);
+extern int holdover_policy(void);
+extern uint32_t holdover_max_us(void);
@@ -0,0 +1,35 @@
+/*
+ * sha256.h
+ *
+ * SHA-256, for checking firmware images
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+struct sha256
+{
+    uint32_t h[8];
+    uint64_t len;
+    uint8_t buf[64];
+    int nbuf;
+};
+
+extern void sha256_init(struct sha256 *s);
+extern void sha256_update(struct sha256 *s, const void *data, size_t len);
+extern void sha256_final(struct sha256 *s, uint8_t digest[32]);
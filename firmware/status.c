@@ -0,0 +1,78 @@
+/*
+ * status.c
+ *
+ * Status snapshot for the remote protocols
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+#include "status.h"
+#include "settings.h"
+#include "clock.h"
+#include "ds3231.h"
+#include "ota.h"
+#include "energy.h"
+
+_Static_assert(sizeof(((struct mt_status *)0)->residency_s)
+               == ENERGY_NUM_STATES*sizeof(uint32_t),
+               "Status must have room for each energy state");
+
+struct mt_counters counters;
+static uint8_t current_leds = 0;
+
+
+void status_set_leds(uint8_t leds)
+{
+    current_leds = leds;
+}
+
+
+/* Fills in 'st' in place, which may be directly inside a packet buffer.
+ * The structure is packed, so the compiler takes care of alignment. */
+void status_fill(struct mt_status *st)
+{
+    struct clock_status cs;
+    int16_t temp;
+    int osf, i;
+
+    clock_get_status(&cs);
+
+    st->uptime_ms = time_us_64() / 1000;
+    st->utc_us = clock_utc_us(time_us_64());
+    st->root_disp_us = cs.root_disp_us;
+    st->synced = cs.synced;
+    st->stratum = cs.stratum;
+    st->leds = current_leds;
+    st->ds3231 = 0;
+    st->temperature = 0;
+    st->ota = ota_state();
+    st->source = cs.source;
+    if ( ds3231_get_flags(&osf, &temp) == 0 ) {
+        st->ds3231 = STATUS_DS3231_FOUND | (osf ? STATUS_DS3231_OSF : 0);
+        st->temperature = temp;
+    }
+    st->settings_version = settings.version;
+    st->counters = counters;
+    st->uah_per_day = energy_uah_per_day();
+    for ( i=0; i<ENERGY_NUM_STATES; i++ ) {
+        st->residency_s[i] = energy_residency_us(i) / 1000000;
+    }
+}
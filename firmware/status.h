@@ -0,0 +1,62 @@
+/*
+ * status.h
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Event counters, incremented by whichever module sees the event */
+struct mt_counters
+{
+    uint32_t ntp_syncs;
+    uint32_t ntp_failures;
+    uint32_t ntp_served;
+    uint32_t ntp_limited;
+    uint32_t wifi_joins;
+    uint32_t ctl_requests;
+    uint32_t i2c_errors;        /* DS3231 transactions failed */
+    uint32_t check_max_us;      /* Slowest check_clock() */
+    uint32_t leds_held;         /* LED changes held back */
+};
+
+/* Bits in mt_status.ds3231 */
+#define STATUS_DS3231_FOUND (1<<0)
+#define STATUS_DS3231_OSF (1<<1)
+
+/* Status snapshot, as sent over the wire (little-endian, packed) */
+struct __attribute__((packed)) mt_status
+{
+    uint32_t uptime_ms;
+    uint64_t utc_us;            /* 0 = unknown */
+    uint32_t root_disp_us;
+    uint8_t synced;
+    uint8_t stratum;
+    uint8_t leds;               /* Bit n = channel n lit */
+    uint8_t ds3231;
+    int16_t temperature;        /* DS3231 temperature in 1/100 degC */
+    uint8_t ota;                /* ota_state() */
+    uint8_t source;             /* clock_source() */
+    uint32_t settings_version;
+    struct mt_counters counters;
+    uint32_t uah_per_day;       /* energy_uah_per_day() */
+    uint32_t residency_s[5];    /* Time in each ENERGY_xxx state */
+};
+
+extern struct mt_counters counters;
+extern void status_set_leds(uint8_t leds);
+extern void status_fill(struct mt_status *st);
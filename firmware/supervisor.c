@@ -0,0 +1,209 @@
+/*
+ * supervisor.c
+ *
+ * Main loop supervision and the hardware watchdog
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The tasks all run one after the other in the same main loop, so a
+ * limit for each would never be reached before the one for the whole
+ * loop.  Instead, each task only calls supervisor_checkin() just before
+ * it starts its work, so that we know which one was running, and
+ * supervisor_poll() is called once per pass of the loop.
+ *
+ * If supervisor_poll() isn't called for ALARM_US, hardware alarm 2 goes
+ * off a little before the watchdog would.  Its interrupt has the highest
+ * priority, so it also catches a stuck interrupt handler.  It records the
+ * task which was running, with the PC and LR from the exception frame, in
+ * watchdog scratch registers 0-3 (the SDK uses 4-7), then restarts
+ * immediately.  If interrupts are disabled, the watchdog itself restarts
+ * the board without a record.  That is the whole mechanism.
+ */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+#include <hardware/watchdog.h>
+#include <hardware/structs/watchdog.h>
+#include <hardware/timer.h>
+#include <hardware/irq.h>
+
+#include "supervisor.h"
+#include "retain.h"
+
+#define ALARM_NUM 2
+#define ALARM_US ((WATCHDOG_MS - 500) * 1000)
+
+/* In scratch[0] when scratch[1-3] hold a record */
+#define RECORD_MAGIC 0x5344574d
+#define NO_TASK 0xff
+
+static const char *task_names[] = {"LED", "terminal", "network", "I2C"};
+
+static volatile uint8_t running = NO_TASK;
+static uint64_t last_poll;
+static int started = 0;
+
+/* What happened before the last restart */
+static int prev_watchdog = 0;
+static int prev_have_record = 0;
+static uint32_t prev_task;
+static uint32_t prev_pc;
+static uint32_t prev_lr;
+
+
+static void record_and_restart(uint32_t task, uint32_t pc, uint32_t lr)
+{
+    retain_restarting();
+    watchdog_hw->scratch[1] = task;
+    watchdog_hw->scratch[2] = pc;
+    watchdog_hw->scratch[3] = lr;
+    watchdog_hw->scratch[0] = RECORD_MAGIC;
+    watchdog_hw->ctrl = WATCHDOG_CTRL_TRIGGER_BITS;
+    while ( 1 );
+}
+
+
+/* Called with the stacked exception frame: r0-r3, r12, lr, pc, xpsr */
+static void __attribute__((used)) stalled(uint32_t *frame)
+{
+    record_and_restart(running, frame[6], frame[5]);
+}
+
+
+/* Finds the exception frame on whichever stack was in use, and passes
+ * it to stalled() */
+static void __attribute__((naked)) alarm_irq()
+{
+    __asm volatile (
+        ".syntax unified\n"
+        "    movs r0, #4\n"
+        "    mov r1, lr\n"
+        "    tst r0, r1\n"
+        "    bne 1f\n"
+        "    mrs r0, msp\n"
+        "    b 2f\n"
+        "1:  mrs r0, psp\n"
+        "2:  ldr r1, 3f\n"
+        "    bx r1\n"
+        "    .align 2\n"
+        "3:  .word stalled\n"
+    );
+}
+
+
+static void arm_alarm()
+{
+    timer_hw->alarm[ALARM_NUM] = timer_hw->timerawl + ALARM_US;
+}
+
+
+static void show_record()
+{
+    if ( prev_task < NUM_TASKS ) {
+        printf("task '%s' stalled", task_names[prev_task]);
+    } else {
+        printf("stalled before any task started");
+    }
+    printf(" at PC %08lx, LR %08lx\n", prev_pc, prev_lr);
+}
+
+
+/* Must be called before anything else touches the watchdog */
+void supervisor_init()
+{
+    prev_watchdog = watchdog_enable_caused_reboot();
+    if ( watchdog_hw->scratch[0] == RECORD_MAGIC ) {
+        prev_have_record = 1;
+        prev_task = watchdog_hw->scratch[1];
+        prev_pc = watchdog_hw->scratch[2];
+        prev_lr = watchdog_hw->scratch[3];
+        watchdog_hw->scratch[0] = 0;
+    }
+
+    if ( prev_have_record ) {
+        printf("Restarted by the supervisor: ");
+        show_record();
+    } else if ( prev_watchdog ) {
+        printf("Restarted by the watchdog (interrupts blocked?)\n");
+    }
+}
+
+
+void supervisor_start()
+{
+    last_poll = time_us_64();
+
+    hardware_alarm_claim(ALARM_NUM);
+    irq_set_exclusive_handler(TIMER_IRQ_2, alarm_irq);
+    irq_set_priority(TIMER_IRQ_2, 0);
+    arm_alarm();
+    hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM);
+    irq_set_enabled(TIMER_IRQ_2, true);
+
+    watchdog_enable(WATCHDOG_MS, 1);
+    started = 1;
+}
+
+
+void supervisor_checkin(int task)
+{
+    running = task;
+}
+
+
+void supervisor_poll()
+{
+    if ( !started ) return;
+    last_poll = time_us_64();
+    arm_alarm();
+    watchdog_update();
+}
+
+
+/* Stop feeding the watchdog, and let it restart the board without a
+ * record.  Used to roll back new firmware which didn't confirm itself. */
+void supervisor_stop()
+{
+    if ( !started ) return;
+    irq_set_enabled(TIMER_IRQ_2, false);
+    started = 0;
+}
+
+
+void supervisor_show()
+{
+    if ( prev_have_record ) {
+        printf("Last restart by the supervisor: ");
+        show_record();
+    } else if ( prev_watchdog ) {
+        printf("Last restart by the watchdog, with no record\n");
+    } else {
+        printf("Last restart was not caused by the watchdog\n");
+    }
+
+    if ( !started ) {
+        printf("Supervisor not running\n");
+        return;
+    }
+    printf("Main loop passed %lli ms ago (limit %i ms), last task '%s'\n",
+           (time_us_64() - last_poll)/1000, ALARM_US/1000,
+           (running < NUM_TASKS) ? task_names[running] : "none");
+}
@@ -0,0 +1,40 @@
+/*
+ * supervisor.h
+ *
+ * Main loop supervision and the hardware watchdog
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Restart if the main loop doesn't call supervisor_poll() for this long */
+#define WATCHDOG_MS 2000
+
+/* Parts of the main loop which check in with the supervisor */
+#define TASK_LED 0
+#define TASK_TERMINAL 1
+#define TASK_NET 2
+#define TASK_I2C 3
+#define NUM_TASKS 4
+
+extern void supervisor_init(void);
+extern void supervisor_start(void);
+extern void supervisor_checkin(int task);
+extern void supervisor_poll(void);
+extern void supervisor_stop(void);
+extern void supervisor_show(void);
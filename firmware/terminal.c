@@ -21,13 +21,22 @@
  */
 
 #include <pico/stdlib.h>
-#include <hardware/rtc.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "clock.h"
 #include "ds3231.h"
+#include "pps.h"
+#include "energy.h"
+#include "record.h"
+#include "ntp_client.h"
+#include "ntp_server.h"
 #include "terminal.h"
+#include "ota.h"
+#include "supervisor.h"
 #include "settings.h"
+#include "schedule.h"
+#include "serialctl.h"
 
 struct terminal
 {
@@ -40,39 +49,116 @@ struct terminal terminal_data;
 
 static void set_pins(const char *str)
 {
-    int morning, late;
-    if ( sscanf(str, "%i %i", &morning, &late) == 2 ) {
-        settings.morning_pin = morning;
-        settings.late_pin = late;
-    } else {
-        printf("Syntax: leds <morning> <late>\n");
+    int i, pin, n;
+
+    for ( i=0; i<MAX_CHANNELS; i++ ) {
+        if ( sscanf(str, "%i%n", &pin, &n) != 1 ) break;
+        settings.channel_pin[i] = pin;
+        str += n;
+    }
+
+    if ( i == 0 ) {
+        printf("Syntax: leds <channel 0 pin> [<channel 1 pin> ...]\n");
         printf("Default: leds 19 22\n");
+        return;
+    }
+
+    for ( ; i<MAX_CHANNELS; i++ ) {
+        settings.channel_pin[i] = CHANNEL_UNUSED;
     }
+    printf("Save settings and restart for new LED pins to take effect\n");
 }
 
 
-static void set_wake(const char *str)
+static int valid_time(int hours, int mins)
+{
+    return (hours >= 0) && (hours < 24) && (mins >= 0) && (mins < 60);
+}
+
+
+/* Set the on time of all events for a channel */
+static void set_channel_on(const char *str, int channel, const char *name,
+                           const char *def)
 {
     int hours, mins;
-    if ( sscanf(str, "%i %i", &hours, &mins) == 2 ) {
-        settings.morning_hour = hours;
-        settings.morning_min = mins;
+    if ( (sscanf(str, "%i %i", &hours, &mins) == 2)
+      && valid_time(hours, mins) )
+    {
+        int i;
+        for ( i=0; i<MAX_EVENTS; i++ ) {
+            if ( settings.events[i].days == 0 ) continue;
+            if ( settings.events[i].channel != channel ) continue;
+            settings.events[i].on_min = (hours*60 + mins) % MINUTES_PER_DAY;
+        }
+        schedule_compile();
     } else {
-        printf("Syntax: wake <hh> <mm>\n");
-        printf("Default: wake 7 15\n");
+        printf("Syntax: %s <hh> <mm>\n", name);
+        printf("Default: %s %s\n", name, def);
     }
 }
 
 
+static void set_wake(const char *str)
+{
+    set_channel_on(str, CH_WAKE, "wake", "7 15");
+}
+
+
 static void set_rise(const char *str)
 {
-    int hours, mins;
-    if ( sscanf(str, "%i %i", &hours, &mins) == 2 ) {
-        settings.late_hour = hours;
-        settings.late_min = mins;
+    set_channel_on(str, CH_RISE, "rise", "8 0");
+}
+
+
+static int parse_days(const char *str)
+{
+    const char *names = "SMTWTFS";
+    int i;
+    int days = 0;
+
+    if ( strlen(str) != 7 ) return -1;
+    for ( i=0; i<7; i++ ) {
+        if ( str[i] == names[i] ) {
+            days |= 1<<i;
+        } else if ( str[i] != '-' ) {
+            return -1;
+        }
+    }
+    return days;
+}
+
+
+static void set_event(const char *str)
+{
+    int n, channel, on_h, on_m, off_h, off_m, days;
+    char days_str[8];
+
+    if ( (sscanf(str, "%i %7s", &n, days_str) == 2)
+      && (strcmp(days_str, "off") == 0)
+      && (n >= 0) && (n < MAX_EVENTS) )
+    {
+        settings.events[n].days = 0;
+        schedule_compile();
+        return;
+    }
+
+    if ( (sscanf(str, "%i %7s %i %i:%i %i:%i", &n, days_str, &channel,
+                 &on_h, &on_m, &off_h, &off_m) == 7)
+      && (n >= 0) && (n < MAX_EVENTS)
+      && (channel >= 0) && (channel < MAX_CHANNELS)
+      && valid_time(on_h, on_m) && valid_time(off_h, off_m)
+      && ((days = parse_days(days_str)) > 0) )
+    {
+        settings.events[n].days = days;
+        settings.events[n].channel = channel;
+        settings.events[n].on_min = (on_h*60 + on_m) % MINUTES_PER_DAY;
+        settings.events[n].off_min = (off_h*60 + off_m) % MINUTES_PER_DAY;
+        schedule_compile();
     } else {
-        printf("Syntax: rise <hh> <mm>\n");
-        printf("Default: wake 8 0\n");
+        printf("Syntax: event <n> <days> <channel> <on hh:mm> <off hh:mm>\n");
+        printf("    or: event <n> off\n");
+        printf("<n> = 0..%i, <days> like SMTWTFS or -MTWTF-\n", MAX_EVENTS-1);
+        printf("Example: event 2 S-----S 0 9:00 12:00\n");
     }
 }
 
@@ -80,7 +166,7 @@ static void set_rise(const char *str)
 static void set_utc_offset(const char *str)
 {
     int hours;
-    if ( sscanf(str, "%i", &hours) == 1 ) {
+    if ( (sscanf(str, "%i", &hours) == 1) && (hours >= -12) && (hours <= 14) ) {
         settings.utc_offset = hours;
     } else {
         printf("Syntax: tz <hours>\n");
@@ -89,11 +175,61 @@ static void set_utc_offset(const char *str)
 }
 
 
+static void set_holdover(const char *str)
+{
+    const char *names[] = {"flag", "hold", "off"};
+    char policy[8];
+    int secs, i;
+
+    if ( (sscanf(str, "%i %7s", &secs, policy) == 2)
+      && (secs >= 1) && (secs <= 3600) )
+    {
+        for ( i=0; i<3; i++ ) {
+            if ( strcmp(policy, names[i]) == 0 ) {
+                settings.holdover_max_s = secs;
+                settings.holdover_policy = i;
+                return;
+            }
+        }
+    }
+    printf("Syntax: holdover <seconds> <flag|hold|off>\n");
+    printf("When the time might be further out than this, carry on but\n");
+    printf("blink the board LED, leave the LEDs as they are, or turn them off\n");
+    printf("Default: holdover %i flag\n", HOLDOVER_DEFAULT_S);
+}
+
+
+static void energy_command(const char *str)
+{
+    char name[16];
+    int ua;
+
+    if ( strcmp(str, "reset") == 0 ) {
+        energy_reset();
+        return;
+    }
+    if ( (sscanf(str, "%15s %i", name, &ua) == 2) && (ua >= 0) && (ua <= 65535)
+      && (energy_set_current(name, ua) == 0) ) return;
+
+    printf("Syntax: energy reset\n");
+    printf("    or: energy <state> <microamps>\n");
+    printf("States: asleep awake usb joining wifi leds (per channel lit)\n");
+    printf("Each state's current is on top of 'asleep'.  0 = default\n");
+}
+
+
 static void set_clear_time(const char *str)
 {
     int hours;
-    if ( sscanf(str, "%i", &hours) == 1 ) {
-        settings.clear_hour = hours;
+    if ( (sscanf(str, "%i", &hours) == 1) && valid_time(hours, 0) ) {
+        int i;
+        for ( i=0; i<MAX_EVENTS; i++ ) {
+            if ( settings.events[i].days == 0 ) continue;
+            if ( (settings.events[i].channel != CH_WAKE)
+              && (settings.events[i].channel != CH_RISE) ) continue;
+            settings.events[i].off_min = (hours*60) % MINUTES_PER_DAY;
+        }
+        schedule_compile();
     } else {
         printf("Syntax: clear <hours>\n");
         printf("Default: clear 12\n");
@@ -101,13 +237,88 @@ static void set_clear_time(const char *str)
 }
 
 
+static void set_ntp_servers(const char *str)
+{
+    char name[NTP_MAX_SERVERS][32];
+    int i, n;
+
+    n = sscanf(str, "%31s %31s", name[0], name[1]);
+    if ( n < 1 ) {
+        printf("Syntax: ntp <server> [<server>]\n");
+        printf("    or: ntp none\n");
+        printf("Servers from DHCP are used first, and pool.ntp.org last\n");
+        return;
+    }
+
+    for ( i=0; i<NTP_MAX_SERVERS; i++ ) {
+        if ( (i < n) && (strcmp(name[0], "none") != 0) ) {
+            strcpy(settings.ntp_server[i], name[i]);
+        } else {
+            settings.ntp_server[i][0] = '\0';
+        }
+    }
+}
+
+
+static void set_ntp_mode(const char *str)
+{
+    if ( strcmp(str, "broadcast") == 0 ) {
+        settings.flags |= SETTING_NTP_BROADCAST;
+    } else if ( strcmp(str, "unicast") == 0 ) {
+        settings.flags &= ~SETTING_NTP_BROADCAST;
+    } else {
+        printf("Syntax: ntpmode <unicast|broadcast>\n");
+        printf("Default: ntpmode unicast\n");
+        return;
+    }
+    printf("Save settings and restart for this to take effect\n");
+}
+
+
+static void set_ntp_server(const char *str)
+{
+    if ( strcmp(str, "on") == 0 ) {
+        settings.flags |= SETTING_NTP_SERVER;
+    } else if ( strcmp(str, "off") == 0 ) {
+        settings.flags &= ~SETTING_NTP_SERVER;
+    } else {
+        printf("Syntax: ntpserver <on|off>\n");
+        return;
+    }
+    printf("Save settings and restart for this to take effect\n");
+}
+
+
+static void set_remote(const char *str)
+{
+    if ( strcmp(str, "on") == 0 ) {
+        settings.flags |= SETTING_REMOTE_CONFIG;
+    } else if ( strcmp(str, "off") == 0 ) {
+        settings.flags &= ~SETTING_REMOTE_CONFIG;
+    } else {
+        printf("Syntax: remote <on|off>\n");
+        printf("Default: remote off\n");
+    }
+}
+
+
+static int valid_datetime(const datetime_t *t)
+{
+    return (t->year >= 2000) && (t->year <= 2099)
+        && (t->month >= 1) && (t->month <= 12)
+        && (t->day >= 1) && (t->day <= 31)
+        && (t->hour >= 0) && (t->hour <= 23)
+        && (t->min >= 0) && (t->min <= 59)
+        && (t->sec >= 0) && (t->sec <= 59);
+}
+
+
 static void set_clock(const char *str)
 {
     int dow, d, mon, y, h, m, s;
     if ( sscanf(str, "%i %i %i %i %i %i %i", &dow, &d, &mon, &y, &h, &m, &s) == 7 ) {
 
         datetime_t t;
-        bool r;
 
         printf("OK %i-%i-%i (%i), %i:%i:%i\n", d, mon, y, dow, h, m, s);
 
@@ -118,9 +329,12 @@ static void set_clock(const char *str)
         t.hour = h;
         t.min = m;
         t.sec = s;
-        if ( !rtc_set_datetime(&t) ) {
-            printf("RTC set failed\n");
+        if ( !valid_datetime(&t) ) {
+            printf("Invalid date or time\n");
         } else {
+            /* Typed in by a human, so good to a second or so */
+            clock_set(CLOCK_SRC_CONSOLE, clock_from_datetime(&t),
+                      time_us_64(), 1000000);
             printf("OK!\n");
         }
 
@@ -149,16 +363,19 @@ static const char *dotw_pico(int n)
 
 static void print_datetime()
 {
-    datetime_t t = {0};
-    int r;
-    r = rtc_get_datetime(&t);
-    if ( r ) {
-        printf("Pico RTC date/time (UTC): %i-%i-%i (%s)  %i:%i:%i\n",
+    datetime_t t;
+    uint64_t utc = clock_now_us();
+
+    if ( utc != 0 ) {
+        clock_to_datetime(utc, &t);
+        printf("Date/time (UTC): %i-%i-%i (%s)  %i:%i:%i\n",
                t.day, t.month, t.year, dotw_pico(t.dotw), t.hour, t.min, t.sec);
     } else {
-        printf("Pico RTC not running.\n");
+        printf("Time not known.\n");
     }
-    printf("Offset to local time: %i + %i\n", settings.utc_offset, dst(t));
+    clock_show();
+    printf("Offset to local time: %i + %i\n", settings.utc_offset,
+           dst(utc/1000000));
 }
 
 
@@ -170,6 +387,7 @@ static void run_command(struct terminal *trm)
 
     if ( strcmp(trm->c, "ds") == 0 ) {
         ds3231_status();
+        pps_show();
 
     } else if ( strcmp(trm->c, "tt") == 0 ) {
         print_datetime();
@@ -178,7 +396,11 @@ static void run_command(struct terminal *trm)
         set_clock(trm->c+4);
 
     } else if ( strcmp(trm->c, "setds") == 0 ) {
-        set_ds3231_from_picortc();
+        if ( ds3231_from_clock() ) {
+            printf("Couldn't set the DS3231\n");
+        } else {
+            printf("DS3231 will be set at the start of the next second\n");
+        }
 
     } else if ( strcmp(trm->c, "osf") == 0 ) {
         ds3231_reset_osf();
@@ -201,28 +423,77 @@ static void run_command(struct terminal *trm)
     } else if ( strncmp(trm->c, "rise ", 5) == 0 ) {
         set_rise(trm->c+5);
 
+    } else if ( strncmp(trm->c, "event ", 6) == 0 ) {
+        set_event(trm->c+6);
+
     } else if ( strncmp(trm->c, "tz ", 3) == 0 ) {
         set_utc_offset(trm->c+3);
 
+    } else if ( strcmp(trm->c, "ntpserver") == 0 ) {
+        ntp_server_stats();
+
+    } else if ( strncmp(trm->c, "ntpserver ", 10) == 0 ) {
+        set_ntp_server(trm->c+10);
+
+    } else if ( strncmp(trm->c, "remote ", 7) == 0 ) {
+        set_remote(trm->c+7);
+
+    } else if ( strncmp(trm->c, "ntpmode ", 8) == 0 ) {
+        set_ntp_mode(trm->c+8);
+
+    } else if ( strncmp(trm->c, "ntp ", 4) == 0 ) {
+        set_ntp_servers(trm->c+4);
+
+    } else if ( strncmp(trm->c, "holdover ", 9) == 0 ) {
+        set_holdover(trm->c+9);
+
     } else if ( strncmp(trm->c, "clear ", 6) == 0 ) {
         set_clear_time(trm->c+6);
 
+    } else if ( strcmp(trm->c, "ota") == 0 ) {
+        ota_show();
+
+    } else if ( strcmp(trm->c, "energy") == 0 ) {
+        energy_show();
+
+    } else if ( strncmp(trm->c, "energy ", 7) == 0 ) {
+        energy_command(trm->c+7);
+
+    } else if ( strcmp(trm->c, "record") == 0 ) {
+        record_show();
+
+    } else if ( strcmp(trm->c, "record dump") == 0 ) {
+        record_dump();
+
+    } else if ( strcmp(trm->c, "watchdog") == 0 ) {
+        supervisor_show();
+
     } else if ( strcmp(trm->c, "help") == 0 ) {
         printf("Commands:\n");
         printf("  help     : Show this help message\n");
-        printf("  tt       : Show Pico RTC date/time\n");
+        printf("  tt       : Show date/time and its sources\n");
         printf("  set      : Set UTC date/time\n");
         printf("  ds       : Show DS3231 date/time and status\n");
-        printf("  setds    : Set DS3231 from Pico RTC\n");
+        printf("  setds    : Set DS3231 from current time\n");
         printf("  osf      : Reset DS3231 stop flag\n");
         printf("  load     : Load settings\n");
         printf("  save     : Save settings\n");
         printf("  settings : Show settings\n");
-        printf("  leds     : Set wake LED pin assignments\n");
-        printf("  wake     : Set waking time (green)\n");
-        printf("  rise     : Set rise/late time (red)\n");
+        printf("  leds     : Set LED channel pin assignments\n");
+        printf("  wake     : Set waking time (green) for every day\n");
+        printf("  rise     : Set rise/late time (red) for every day\n");
+        printf("  event    : Set schedule entry\n");
         printf("  tz       : Set UTC offset\n");
-        printf("  clear    : Set wake LED reset time\n");
+        printf("  clear    : Set wake LED reset time for every day\n");
+        printf("  holdover : Set what to do if the time is too uncertain\n");
+        printf("  ntp      : Set fallback NTP servers\n");
+        printf("  ntpmode  : Poll NTP server, or listen for broadcasts\n");
+        printf("  ntpserver: Show or set NTP server status\n");
+        printf("  remote   : Allow settings/firmware changes via network\n");
+        printf("  ota      : Show firmware update status\n");
+        printf("  watchdog : Show the main loop supervisor and last restart\n");
+        printf("  energy   : Show or configure the power use estimate\n");
+        printf("  record   : Show or dump ('record dump') recorded inputs\n");
 
     } else {
         printf("Command not recognised.  Try 'help'\n");
@@ -237,7 +508,13 @@ void terminal_poll(Terminal *trm)
 
     i = getchar_timeout_us(0);
     if ( i == PICO_ERROR_TIMEOUT ) return;
-    if ( i == 0 ) return;
+
+    /* Nobody can type a zero byte, so it's the start of a binary frame */
+    if ( (i == 0) || serialctl_receiving() ) {
+        serialctl_input(i);
+        return;
+    }
+    record_input(REC_TERMINAL, &i, 1);
 
     if ( (i == 13) || (i == 10) ) {
         printf("\n");
@@ -254,12 +531,14 @@ void terminal_poll(Terminal *trm)
     }
 
     if ( i == 8 ) {
+        if ( trm->nchar == 0 ) return;
         printf("%c %c", i, i);
         trm->nchar--;
         return;
     }
 
-    if ( trm->nchar == 256 ) return;
+    /* Leave room for the terminating zero */
+    if ( trm->nchar == sizeof(trm->c)-1 ) return;
     trm->c[trm->nchar++] = i;
     printf("%c", i);
 }
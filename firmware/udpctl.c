@@ -0,0 +1,234 @@
+/*
+ * udpctl.c
+ *
+ * Binary status and control protocol over UDP
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Every datagram starts with struct ctl_header (see ctl.h).
+ *
+ *  CTL_STATUS         -> struct mt_status
+ *  CTL_GET_SETTINGS   -> struct mt_settings (one flash page)
+ *  CTL_SET_SETTINGS   struct mt_settings -> (empty)
+ *  CTL_SAVE_SETTINGS  -> (empty)
+ *  CTL_OTA_START      struct ctl_ota_start -> (empty), needs LWIP_TCP
+ *
+ * Failures are answered with CTL_ERROR and a one byte error code, and
+ * requests with the wrong CTL_VERSION get CTL_ERR_BAD_VERSION.
+ * Changing settings or firmware is only allowed after 'remote on' at the
+ * terminal.
+ * The network cache fields are never overwritten, and new LED pins only
+ * take effect after a restart.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "udpctl.h"
+#include "ctl.h"
+#include "status.h"
+#include "settings.h"
+#if LWIP_TCP
+#include "ota_net.h"
+#endif
+
+/* The update server at the request's source address is listening on
+ * 'port', and will send 'size' bytes (see ota_net.c) */
+struct __attribute__((packed)) ctl_ota_start
+{
+    uint16_t port;
+    uint16_t reserved;
+    uint32_t size;
+    uint8_t sha256[32];
+};
+
+static struct udp_pcb *ctl_pcb;
+
+
+/* Allocates a reply with room for 'len' bytes after the header, and
+ * fills in the header.  The caller writes the rest directly into the
+ * payload, which is contiguous because it's PBUF_RAM. */
+static struct pbuf *reply_alloc(uint8_t op, uint32_t seq, size_t len)
+{
+    struct pbuf *p;
+    struct ctl_header *h;
+
+    p = pbuf_alloc(PBUF_TRANSPORT, sizeof(struct ctl_header)+len, PBUF_RAM);
+    if ( p == NULL ) return NULL;
+
+    h = (struct ctl_header *)p->payload;
+    h->magic = CTL_MAGIC;
+    h->version = CTL_VERSION;
+    h->op = op | CTL_REPLY;
+    h->seq = seq;
+    return p;
+}
+
+
+static void *reply_payload(struct pbuf *p)
+{
+    return (uint8_t *)p->payload + sizeof(struct ctl_header);
+}
+
+
+static struct pbuf *error_reply(uint32_t seq, uint8_t code)
+{
+    struct pbuf *p = reply_alloc(CTL_ERROR, seq, 1);
+    if ( p != NULL ) *(uint8_t *)reply_payload(p) = code;
+    return p;
+}
+
+
+static struct pbuf *set_settings(struct pbuf *req, uint32_t seq)
+{
+    struct mt_settings ns;
+
+    if ( !(settings.flags & SETTING_REMOTE_CONFIG) ) {
+        return error_reply(seq, CTL_ERR_NOT_PERMITTED);
+    }
+
+    if ( req->tot_len != sizeof(struct ctl_header)+sizeof(ns) ) {
+        return error_reply(seq, CTL_ERR_BAD_REQUEST);
+    }
+    pbuf_copy_partial(req, &ns, sizeof(ns), sizeof(struct ctl_header));
+    if ( settings_replace(&ns) ) {
+        return error_reply(seq, CTL_ERR_BAD_SETTINGS);
+    }
+
+    printf("Settings changed via network\n");
+    return reply_alloc(CTL_SET_SETTINGS, seq, 0);
+}
+
+
+#if LWIP_TCP
+static struct pbuf *ota_start(struct pbuf *req, uint32_t seq,
+                              const ip_addr_t *addr)
+{
+    struct ctl_ota_start os;
+
+    if ( !(settings.flags & SETTING_REMOTE_CONFIG) ) {
+        return error_reply(seq, CTL_ERR_NOT_PERMITTED);
+    }
+
+    if ( req->tot_len != sizeof(struct ctl_header)+sizeof(os) ) {
+        return error_reply(seq, CTL_ERR_BAD_REQUEST);
+    }
+    pbuf_copy_partial(req, &os, sizeof(os), sizeof(struct ctl_header));
+
+    if ( ota_fetch(addr, os.port, os.size, os.sha256) ) {
+        return error_reply(seq, CTL_ERR_OTA_REFUSED);
+    }
+    return reply_alloc(CTL_OTA_START, seq, 0);
+}
+#endif
+
+
+static struct pbuf *handle_request(struct pbuf *req, const struct ctl_header *h,
+                                   const ip_addr_t *addr)
+{
+    struct pbuf *p = NULL;
+
+    switch ( h->op ) {
+
+        case CTL_STATUS :
+        p = reply_alloc(h->op, h->seq, sizeof(struct mt_status));
+        if ( p != NULL ) status_fill(reply_payload(p));
+        break;
+
+        case CTL_GET_SETTINGS :
+        p = reply_alloc(h->op, h->seq, sizeof(struct mt_settings));
+        if ( p != NULL ) memcpy(reply_payload(p), &settings, sizeof(struct mt_settings));
+        break;
+
+        case CTL_SET_SETTINGS :
+        p = set_settings(req, h->seq);
+        break;
+
+        case CTL_SAVE_SETTINGS :
+        if ( settings.flags & SETTING_REMOTE_CONFIG ) {
+            settings_write();
+            p = reply_alloc(h->op, h->seq, 0);
+        } else {
+            p = error_reply(h->seq, CTL_ERR_NOT_PERMITTED);
+        }
+        break;
+
+#if LWIP_TCP
+        case CTL_OTA_START :
+        p = ota_start(req, h->seq, addr);
+        break;
+#endif
+
+        default :
+        p = error_reply(h->seq, CTL_ERR_BAD_REQUEST);
+        break;
+
+    }
+
+    return p;
+}
+
+
+static void ctl_recv(void *arg, struct udp_pcb *pcb, struct pbuf *req,
+                     const ip_addr_t *addr, u16_t port)
+{
+    struct ctl_header h;
+    struct pbuf *p;
+
+    if ( pbuf_copy_partial(req, &h, sizeof(h), 0) != sizeof(h)
+      || h.magic != CTL_MAGIC )
+    {
+        pbuf_free(req);
+        return;
+    }
+
+    counters.ctl_requests++;
+
+    /* Anything else would be misunderstood */
+    if ( h.version != CTL_VERSION ) {
+        p = error_reply(h.seq, CTL_ERR_BAD_VERSION);
+    } else {
+        p = handle_request(req, &h, addr);
+    }
+
+    pbuf_free(req);
+
+    if ( p != NULL ) {
+        udp_sendto(pcb, p, addr, port);
+        pbuf_free(p);
+    }
+}
+
+
+void udpctl_init()
+{
+    ctl_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if ( ctl_pcb == NULL ) {
+        printf("Failed to create control socket\n");
+        return;
+    }
+    udp_bind(ctl_pcb, IP_ANY_TYPE, CTL_PORT);
+    udp_recv(ctl_pcb, ctl_recv, NULL);
+}
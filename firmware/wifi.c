@@ -0,0 +1,321 @@
+/*
+ * wifi.c
+ *
+ * WLAN connection handling
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+
+#include "lwip/netif.h"
+#include "lwip/dhcp.h"
+
+#include "settings.h"
+#include "ntp_client.h"
+#include "clock.h"
+#include "status.h"
+#include "energy.h"
+#include "wifi.h"
+
+/* How long to wait for a join before giving up on it (in milliseconds) */
+#define CACHED_JOIN_TIMEOUT (2 * 1000)
+#define SCAN_JOIN_TIMEOUT (15 * 1000)
+
+/* Limits for the delay between failed connection attempts (milliseconds) */
+#define MIN_BACKOFF (1 * 1000)
+#define MAX_BACKOFF (5 * 60 * 1000)
+
+/* Longest lease to cache (seconds).  DHCP servers can hand out infinite
+ * (0xffffffff) leases, which would overflow the lease end. */
+#define MAX_CACHED_LEASE (24 * 60 * 60)
+
+enum wifi_state
+{
+    WIFI_DOWN,
+    WIFI_JOINING,
+    WIFI_JOINED
+};
+
+static enum wifi_state state = WIFI_DOWN;
+static NTP_T *ntp_state = NULL;
+static int cached_attempt = 0;
+static int have_address = 0;
+static int have_lease = 0;
+static uint32_t backoff = MIN_BACKOFF;
+static uint64_t connect_start;
+static alarm_id_t timer = 0;
+
+/* Set from alarm callbacks, acted on in wifi_poll() */
+static volatile int join_timed_out = 0;
+static volatile int reconnect_due = 0;
+static int cache_due = 0;
+
+
+static void set_state(enum wifi_state new_state)
+{
+    state = new_state;
+    energy_set(ENERGY_JOINING, state == WIFI_JOINING);
+    energy_set(ENERGY_WIFI, state == WIFI_JOINED);
+}
+
+
+static struct netif *sta_netif()
+{
+    return &cyw43_state.netif[CYW43_ITF_STA];
+}
+
+
+static uint32_t epoch_now()
+{
+    return clock_now_us() / 1000000;
+}
+
+
+static int64_t join_timeout_handler(alarm_id_t id, void *user_data)
+{
+    timer = 0;
+    join_timed_out = 1;
+    return 0;
+}
+
+
+static int64_t reconnect_handler(alarm_id_t id, void *user_data)
+{
+    timer = 0;
+    reconnect_due = 1;
+    return 0;
+}
+
+
+static void set_timer(uint32_t ms, alarm_callback_t cb)
+{
+    if ( timer > 0 ) cancel_alarm(timer);
+    timer = add_alarm_in_ms(ms, cb, NULL, true);
+}
+
+
+static void connect_scan()
+{
+    printf("connecting to wifi...\n");
+    cached_attempt = 0;
+    set_state(WIFI_JOINING);
+    set_timer(SCAN_JOIN_TIMEOUT, join_timeout_handler);
+    cyw43_arch_wifi_connect_async(WIFI_SSID,
+                                  WIFI_PASSWORD,
+                                  CYW43_AUTH_WPA2_AES_PSK);
+}
+
+
+/* Join the last known access point directly, skipping the scan */
+static void connect_cached()
+{
+    printf("connecting to wifi (cached BSSID "
+           "%02x:%02x:%02x:%02x:%02x:%02x, channel %i)...\n",
+           settings.net_bssid[0], settings.net_bssid[1],
+           settings.net_bssid[2], settings.net_bssid[3],
+           settings.net_bssid[4], settings.net_bssid[5],
+           settings.net_channel);
+    cached_attempt = 1;
+    set_state(WIFI_JOINING);
+    set_timer(CACHED_JOIN_TIMEOUT, join_timeout_handler);
+    cyw43_wifi_join(&cyw43_state,
+                    strlen(WIFI_SSID), (const uint8_t *)WIFI_SSID,
+                    strlen(WIFI_PASSWORD), (const uint8_t *)WIFI_PASSWORD,
+                    CYW43_AUTH_WPA2_AES_PSK,
+                    settings.net_bssid, settings.net_channel);
+}
+
+
+static void connect()
+{
+    connect_start = time_us_64();
+    have_address = 0;
+    have_lease = 0;
+    ntp_forget_dhcp_servers();
+    if ( settings.net_channel != 0 ) {
+        connect_cached();
+    } else {
+        connect_scan();
+    }
+}
+
+
+/* If our previous lease hasn't expired yet, the address is still ours to
+ * use.  Put it on the interface straight away, so that NTP can start
+ * while DHCP renews the lease in the background. */
+static void apply_cached_lease()
+{
+    ip4_addr_t ip, mask, gw;
+    uint32_t now = epoch_now();
+
+    if ( settings.net_ip == 0 ) return;
+    if ( (now == 0) || (now >= settings.net_lease_end) ) return;
+    if ( !ip4_addr_isany_val(*netif_ip4_addr(sta_netif())) ) return;
+
+    ip4_addr_set_u32(&ip, settings.net_ip);
+    ip4_addr_set_u32(&mask, settings.net_netmask);
+    ip4_addr_set_u32(&gw, settings.net_gw);
+    netif_set_addr(sta_netif(), &ip, &mask, &gw);
+    printf("using cached address %s (lease has %li s left)\n",
+           ip4addr_ntoa(&ip), settings.net_lease_end - now);
+}
+
+
+static void update_cache()
+{
+    struct netif *n = sta_netif();
+    struct dhcp *dhcp = netif_dhcp_data(n);
+    uint8_t bssid[6];
+    uint32_t chan[3] = {0};
+    uint32_t ip, mask, gw;
+    uint32_t now = epoch_now();
+    uint32_t lease = (dhcp != NULL) ? dhcp->offered_t0_lease : 0;
+    int changed;
+
+    if ( cyw43_wifi_get_bssid(&cyw43_state, bssid) != 0 ) return;
+    cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(chan),
+                (uint8_t *)chan, CYW43_ITF_STA);
+
+    ip = ip4_addr_get_u32(netif_ip4_addr(n));
+    mask = ip4_addr_get_u32(netif_ip4_netmask(n));
+    gw = ip4_addr_get_u32(netif_ip4_gw(n));
+
+    changed = (memcmp(bssid, settings.net_bssid, 6) != 0)
+           || (chan[0] != settings.net_channel)
+           || (ip != settings.net_ip)
+           || (mask != settings.net_netmask)
+           || (gw != settings.net_gw);
+
+    memcpy(settings.net_bssid, bssid, 6);
+    settings.net_channel = chan[0];
+    settings.net_ip = ip;
+    settings.net_netmask = mask;
+    settings.net_gw = gw;
+
+    if ( (now == 0) || (lease == 0) ) {
+        settings.net_lease_end = 0;
+    } else {
+        if ( lease > MAX_CACHED_LEASE ) lease = MAX_CACHED_LEASE;
+        /* Saving the lease every time would wear out the flash.  Only
+         * bother once less than half of the saved lease remains. */
+        if ( (uint64_t)now + lease/2 > settings.net_lease_end ) changed = 1;
+        settings.net_lease_end = now + lease;
+    }
+
+    if ( changed ) settings_write_netcache();
+}
+
+
+static void link_callback(struct netif *n)
+{
+    if ( netif_is_link_up(n) ) {
+
+        if ( state == WIFI_JOINED ) return;
+        if ( timer > 0 ) cancel_alarm(timer);
+        timer = 0;
+        set_state(WIFI_JOINED);
+        cached_attempt = 0;
+        backoff = MIN_BACKOFF;
+        counters.wifi_joins++;
+        printf("wifi joined after %lli ms\n",
+               (time_us_64() - connect_start)/1000);
+        apply_cached_lease();
+
+    } else {
+
+        if ( state != WIFI_JOINED ) return;
+        printf("wifi link lost\n");
+        set_state(WIFI_DOWN);
+        have_address = 0;
+        have_lease = 0;
+        connect();
+
+    }
+}
+
+
+static void status_callback(struct netif *n)
+{
+    if ( state != WIFI_JOINED ) return;
+
+    if ( !have_address && !ip4_addr_isany_val(*netif_ip4_addr(n)) ) {
+        have_address = 1;
+        printf("network ready after %lli ms\n",
+               (time_us_64() - connect_start)/1000);
+        ntp_sync_now(ntp_state);
+    }
+
+    /* Saving needs a flash write, so don't do it from inside lwIP */
+    if ( !have_lease && dhcp_supplied_address(n) ) {
+        have_lease = 1;
+        cache_due = 1;
+    }
+}
+
+
+void wifi_init(NTP_T *ntp)
+{
+    struct netif *n = sta_netif();
+    ntp_state = ntp;
+    netif_set_link_callback(n, link_callback);
+    netif_set_status_callback(n, status_callback);
+    connect();
+}
+
+
+/* Handles things which the callbacks and alarms have left for us to do */
+void wifi_poll()
+{
+    if ( join_timed_out ) {
+        join_timed_out = 0;
+        if ( state != WIFI_JOINING ) return;
+        if ( cached_attempt ) {
+            printf("cached BSSID didn't work\n");
+            connect_scan();
+        } else {
+            printf("wifi connection failed, retrying in %li s\n",
+                   backoff/1000);
+            set_state(WIFI_DOWN);
+            set_timer(backoff, reconnect_handler);
+            backoff *= 2;
+            if ( backoff > MAX_BACKOFF ) backoff = MAX_BACKOFF;
+        }
+    }
+
+    if ( reconnect_due ) {
+        reconnect_due = 0;
+        if ( state == WIFI_DOWN ) connect();
+    }
+
+    if ( cache_due ) {
+        cache_due = 0;
+        update_cache();
+    }
+}
+
+
+int wifi_connected()
+{
+    return state == WIFI_JOINED;
+}
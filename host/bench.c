@@ -0,0 +1,728 @@
+/*
+ * bench.c
+ *
+ * Micro-benchmarks and exhaustive sweeps of the time and schedule code
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Runs the firmware's time, schedule, DS3231, settings and terminal code
+ * natively, and reports ns/call for each, so that changes to them can be
+ * compared.  Also:
+ *
+ *  - evaluates the schedule for every minute over a range of years, and
+ *    compares dst() with the EU rule (via the C library) for every day,
+ *  - feeds the 1 Hz input with a simulated crystal error, and checks how
+ *    well the clock core extrapolates with the estimated correction,
+ *  - counts the I2C traffic to the (simulated) DS3231 over some days,
+ *  - runs the energy estimate over a simulated day, for comparing ways of
+ *    saving power,
+ *  - feeds random input to the terminal (build with MT_SANITIZE=ON to
+ *    catch memory errors).
+ *
+ * Most numbers are printed, not judged: they are a baseline for comparing
+ * changes.  The exceptions are dst() against the EU rule, and converting
+ * the DS3231's BCD time and temperature registers, which have to be
+ * exactly right.  The exit status is 1 if any of those are wrong.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <pico/stdlib.h>
+
+#include "settings.h"
+#include "schedule.h"
+#include "calendar.h"
+#include "clock.h"
+#include "ds3231.h"
+#include "pps.h"
+#include "energy.h"
+#include "terminal.h"
+#include "status.h"
+#include "host.h"
+
+static volatile unsigned int sink;
+static int failed = 0;
+
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+
+static void report(const char *name, double ns, long n)
+{
+    printf("%-32s %10.1f ns/call  (%li calls)\n", name, ns/n, n);
+}
+
+
+static time_t year_start(int year)
+{
+    struct tm tm = {0};
+    tm.tm_year = year - 1900;
+    tm.tm_mday = 1;
+    return timegm(&tm);
+}
+
+
+/* A spread of times to benchmark with, so that branches aren't all
+ * predicted the same way */
+#define N_SAMPLES 4096
+static uint32_t samples[N_SAMPLES];
+
+static void make_samples()
+{
+    int i;
+    srand(1);
+    for ( i=0; i<N_SAMPLES; i++ ) {
+        samples[i] = year_start(2024) + (rand() % (7*366)) * 86400
+                                      + rand() % 86400;
+    }
+}
+
+
+static void bench_dst(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) s += dst(samples[i % N_SAMPLES]);
+    report("dst", now_ns()-t0, n);
+    sink = s;
+}
+
+
+/* The firmware's calendar against the C library's */
+static void bench_calendar(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0;
+
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        int y, m, d;
+        int32_t days = samples[i % N_SAMPLES] / 86400;
+        civil_from_days(days, &y, &m, &d);
+        s += y + m + d + weekday_from_days(days);
+    }
+    report("civil_from_days + weekday", now_ns()-t0, n);
+
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        struct tm tm;
+        time_t t = samples[i % N_SAMPLES];
+        gmtime_r(&t, &tm);
+        s += tm.tm_year + tm.tm_mon + tm.tm_mday + tm.tm_wday;
+    }
+    report("  libc gmtime_r", now_ns()-t0, n);
+
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        s += days_from_civil(2000 + i%100, 1 + i%12, 1 + i%28);
+    }
+    report("days_from_civil", now_ns()-t0, n);
+
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        struct tm tm = {0};
+        tm.tm_year = 100 + i%100;
+        tm.tm_mon = i%12;
+        tm.tm_mday = 1 + i%28;
+        s += timegm(&tm);
+    }
+    report("  libc timegm", now_ns()-t0, n);
+
+    sink = s;
+}
+
+
+static void bench_minute_of_week(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) s += schedule_minute_of_week(samples[i % N_SAMPLES]);
+    report("schedule_minute_of_week", now_ns()-t0, n);
+    sink = s;
+}
+
+
+static void bench_lookup(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) s += schedule_lookup((i*7919) % MINUTES_PER_WEEK);
+    report("schedule_lookup", now_ns()-t0, n);
+    sink = s;
+}
+
+
+static void bench_compile(long n)
+{
+    long i;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) schedule_compile();
+    report("schedule_compile", now_ns()-t0, n);
+}
+
+
+/* What check_clock() in morningtown.c does: take the clock core's time,
+ * then look up the schedule */
+static void bench_check_clock(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        s += schedule_lookup(schedule_minute_of_week(clock_now_us()/1000000));
+    }
+    report("check_clock", now_ns()-t0, n);
+    sink = s;
+}
+
+
+/* Reading the DS3231 (BCD conversion included) for the clock core */
+static void bench_ds3231_to_clock(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0, t1;
+
+    host_quiet(1);
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) s += ds3231_to_clock();
+    t1 = now_ns();
+    host_quiet(0);
+    report("ds3231_to_clock", t1-t0, n);
+    sink = s;
+}
+
+
+/* The same with every I2C transaction timing out, in simulated time
+ * (the host doesn't really wait) */
+static void bench_ds3231_fault(long n)
+{
+    long i;
+    uint32_t errors = counters.i2c_errors;
+    uint64_t t0;
+    uint64_t worst = 0;
+
+    host_i2c_fault = HOST_I2C_TIMEOUT;
+    for ( i=0; i<n; i++ ) {
+        t0 = time_us_64();
+        sink = ds3231_to_clock();
+        if ( time_us_64() - t0 > worst ) worst = time_us_64() - t0;
+    }
+    host_i2c_fault = HOST_I2C_OK;
+    printf("%-32s %10lu us worst case  (%u I2C errors)\n",
+           "ds3231_to_clock (I2C timing out)", (unsigned long)worst,
+           counters.i2c_errors - errors);
+}
+
+
+static void bench_ds3231_roundtrip(long n)
+{
+    long i;
+    double t0, t1;
+
+    host_quiet(1);
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        clock_set(CLOCK_SRC_CONSOLE,
+                  (uint64_t)samples[i % N_SAMPLES]*1000000,
+                  time_us_64(), 1000000);
+        ds3231_from_clock();
+        host_advance_us(1000000);
+    }
+    t1 = now_ns();
+    host_quiet(0);
+    report("clock_set + aligned DS3231 write", t1-t0, n);
+}
+
+
+/* Set the time to part way through a second, and check that the DS3231
+ * starts its new second at the same time as ours */
+static void check_aligned_write()
+{
+    uint64_t boundary;
+    uint8_t sec;
+    int64_t lead;
+
+    host_quiet(1);
+    clock_set(CLOCK_SRC_CONSOLE, 1791000000300000ULL, time_us_64(), 10);
+    boundary = time_us_64() + 700000;
+    ds3231_from_clock();
+    host_advance_us(699000);
+    while ( time_us_64() < boundary ) host_advance_us(10);
+    host_quiet(0);
+
+    host_ds3231_update();
+    sec = host_ds3231.regs[0];
+    lead = boundary - host_ds3231.set_us;
+    printf("%-32s %10lli us before the second  (seconds register %02x)\n",
+           "DS3231 countdown restarted", (long long)lead, sec);
+}
+
+
+static void bench_ds3231_flags(long n)
+{
+    long i;
+    unsigned int s = 0;
+    double t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        int osf;
+        int16_t temp;
+        ds3231_get_flags(&osf, &temp);
+        s += temp;
+    }
+    report("ds3231_get_flags", now_ns()-t0, n);
+    sink = s;
+}
+
+
+static uint8_t bcd(int n)
+{
+    return (n/10)<<4 | (n%10);
+}
+
+
+/* Set the DS3231 to times which between them have every value of each
+ * field, and read them back */
+static void check_bcd()
+{
+    int k;
+    int wrong = 0;
+
+    host_quiet(1);
+    for ( k=0; k<2400; k++ ) {
+
+        struct tm tm = {0};
+        datetime_t dt;
+        uint64_t boundary;
+        time_t t;
+
+        tm.tm_year = 100 + k%100;
+        tm.tm_mon = k%12;
+        tm.tm_mday = 1 + k%31;
+        if ( tm.tm_mday > 28 ) tm.tm_mon = 0;
+        tm.tm_hour = k%24;
+        tm.tm_min = k%60;
+        tm.tm_sec = (k*7)%60;
+        t = timegm(&tm);
+
+        /* The write happens at the start of the next second */
+        clock_set(CLOCK_SRC_CONSOLE, (uint64_t)t*1000000 - 500000,
+                  time_us_64(), 10);
+        boundary = time_us_64() + 500000;
+        ds3231_from_clock();
+        while ( time_us_64() < boundary + 1000 ) host_advance_us(1000);
+        host_ds3231_update();
+
+        if ( (host_ds3231.regs[0] != bcd(tm.tm_sec))
+          || (host_ds3231.regs[1] != bcd(tm.tm_min))
+          || (host_ds3231.regs[2] != bcd(tm.tm_hour))
+          || (host_ds3231.regs[4] != bcd(tm.tm_mday))
+          || ((host_ds3231.regs[5] & 0x1f) != bcd(tm.tm_mon+1))
+          || (host_ds3231.regs[6] != bcd(tm.tm_year-100)) )
+        {
+            wrong++;
+            continue;
+        }
+
+        if ( ds3231_get_datetime(&dt)
+          || (dt.sec != tm.tm_sec) || (dt.min != tm.tm_min)
+          || (dt.hour != tm.tm_hour) || (dt.day != tm.tm_mday)
+          || (dt.month != tm.tm_mon+1) || (dt.year != tm.tm_year+1900) )
+        {
+            wrong++;
+        }
+    }
+    host_quiet(0);
+
+    printf("%-32s %10i of 2400 times wrong\n", "DS3231 BCD time registers", wrong);
+    if ( wrong ) failed = 1;
+}
+
+
+/* Every quarter degree the DS3231 can measure, straight into the
+ * registers: two's complement, with the fraction in the top two bits of
+ * the second one */
+static void check_temperature()
+{
+    int q;
+    int wrong = 0;
+
+    for ( q=-40*4; q<=85*4; q++ ) {
+        int osf;
+        int16_t temp;
+        host_ds3231.regs[0x11] = (uint8_t)(q >> 2);
+        host_ds3231.regs[0x12] = (q & 3) << 6;
+        if ( ds3231_get_flags(&osf, &temp) || (temp != q*25) ) wrong++;
+    }
+
+    printf("%-32s %10i of %i wrong\n", "DS3231 temperature conversion",
+           wrong, 125*4+1);
+    if ( wrong ) failed = 1;
+}
+
+
+/* Edges from a perfect DS3231, with the Pico's timer running 'ppm' fast.
+ * After locking, a second should still be a second. */
+static void check_pps(int ppm, int n)
+{
+    int i;
+    uint64_t t, u0, u1;
+    const uint64_t span = 100 * (1000000 + ppm);
+
+    /* The DS3231 changes speed at its next temperature conversion */
+    host_ds3231.ppm = -ppm;
+    host_advance_us(64000000);
+
+    host_quiet(1);
+    pps_init();
+    for ( i=0; i<n; i++ ) {
+        host_advance_us(1000000);
+        pps_poll();
+    }
+    host_quiet(0);
+
+    t = time_us_64();
+    u0 = clock_utc_us(t);
+    u1 = clock_utc_us(t + span);
+    printf("%-32s %+10lli us after 100 s  (crystal %+i ppm, %s)\n",
+           "1 Hz extrapolation error", (long long)(u1 - u0) - 100000000,
+           ppm, pps_locked() ? "locked" : "not locked");
+}
+
+
+/* The main loop's use of the DS3231 over some days, with the room
+ * warming and cooling by 3 degC every day.  Counts the I2C transactions,
+ * and checks how well the 1 Hz calibration follows the DS3231's speed. */
+static void check_ds3231_days(int days, double p_nak, double p_stall)
+{
+    const uint64_t span = 100000000;
+    uint32_t n0 = host_ds3231.reads + host_ds3231.writes;
+    uint32_t b0 = host_ds3231.bytes;
+    uint32_t naks0 = host_ds3231.naks;
+    uint32_t timeouts0 = host_ds3231.timeouts;
+    uint32_t clears0 = host_ds3231.bus_clears;
+    uint64_t next_read = 0;
+    double worst = 0.0;
+    long s;
+
+    host_quiet(1);
+    host_ds3231.ppm = 1.5;
+    host_ds3231.p_nak = p_nak;
+    host_ds3231.p_stall = p_stall;
+    pps_init();
+    for ( s=0; s<days*86400L; s++ ) {
+        host_ds3231.temp_c = 22.0 + 3.0*sin(2*M_PI*s/86400.0);
+        host_advance_us(1000000);
+        pps_poll();
+        if ( !pps_locked() && (time_us_64() > next_read) ) {
+            ds3231_to_clock();
+            next_read = time_us_64() + 60000000;
+        }
+        if ( pps_locked() && (s % 600 == 0) ) {
+            uint64_t t = time_us_64();
+            double err = (double)(clock_utc_us(t+span) - clock_utc_us(t))
+                         - span*(1.0 + host_ds3231.speed_ppm*1e-6);
+            if ( fabs(err) > worst ) worst = fabs(err);
+        }
+    }
+    host_quiet(0);
+
+    if ( (p_nak > 0.0) || (p_stall > 0.0) ) {
+        printf("%-32s %10.1f us worst over 100 s  (%u NAKs, %u timeouts, "
+               "%u bus clears)\n", "1 Hz tracking, bad I2C bus", worst,
+               host_ds3231.naks - naks0, host_ds3231.timeouts - timeouts0,
+               host_ds3231.bus_clears - clears0);
+    } else {
+        printf("%-32s %10.1f per day  (%.0f bytes per day, %i days)\n",
+               "DS3231 I2C transactions",
+               (double)(host_ds3231.reads + host_ds3231.writes - n0)/days,
+               (double)(host_ds3231.bytes - b0)/days, days);
+        printf("%-32s %10.1f us worst over 100 s  (%.2f to %.2f ppm)\n",
+               "1 Hz tracking, temperature", worst,
+               1.5 + host_ds3231.tempco*9, 1.5);
+    }
+    host_ds3231.p_nak = 0.0;
+    host_ds3231.p_stall = 0.0;
+    host_ds3231.ppm = 0.0;
+    host_ds3231.temp_c = 25.0;
+}
+
+
+/* A day of something like the main loop: awake for 'awake_us' out of
+ * every 'loop_us', with the LEDs following the schedule and the radio
+ * associated throughout */
+static void check_energy(const char *name, uint32_t loop_us,
+                         uint32_t awake_us, int usb)
+{
+    uint32_t utc = days_from_civil(2026, 10, 12) * 86400;
+    uint64_t end = time_us_64() + 86400ULL*1000000;
+    uint64_t next_minute = 0;
+
+    energy_reset();
+    energy_set(ENERGY_WIFI, 1);
+    energy_set(ENERGY_USB, usb);
+    while ( time_us_64() < end ) {
+        if ( time_us_64() >= next_minute ) {
+            uint8_t leds = schedule_lookup(schedule_minute_of_week(utc));
+            energy_set(ENERGY_LEDS, __builtin_popcount(leds));
+            utc += 60;
+            next_minute = time_us_64() + 60000000;
+        }
+        energy_set(ENERGY_AWAKE, 1);
+        host_advance_us(awake_us);
+        energy_set(ENERGY_AWAKE, 0);
+        host_advance_us(loop_us - awake_us);
+    }
+
+    printf("%-32s %10.1f mAh per day  (awake %.1f%%, LEDs %.1f%%)\n",
+           name, energy_uah_per_day()/1000.0,
+           energy_residency_us(ENERGY_AWAKE)/864e6,
+           energy_residency_us(ENERGY_LEDS)/864e6);
+
+    energy_set(ENERGY_WIFI, 0);
+    energy_set(ENERGY_USB, 0);
+    energy_set(ENERGY_LEDS, 0);
+    energy_reset();
+}
+
+
+/* settings_read() scans the settings sector.  Fill it with 'pages'
+ * saved versions first. */
+static void bench_settings_read(long n, int pages)
+{
+    long i;
+    char name[64];
+    double t0;
+
+    host_quiet(1);
+    memset(host_flash+PICO_FLASH_SIZE_BYTES-4096, 0xff, 4096);
+    settings_read();
+    for ( i=0; i<pages; i++ ) settings_write();
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) settings_read();
+    host_quiet(0);
+    snprintf(name, sizeof(name), "settings_read (%i saved)", pages);
+    report(name, now_ns()-t0, n);
+}
+
+
+static void type_line(Terminal *trm, const char *line)
+{
+    host_input(line, strlen(line));
+    while ( host_input_pending() ) terminal_poll(trm);
+}
+
+
+static void bench_terminal(Terminal *trm, long n)
+{
+    static const char *lines[] = {
+        "event 3 -MTWTF- 1 6:45 7:30\r",
+        "wake 7 15\r",
+        "leds 19 22 3\r",
+        "tz 1\r",
+    };
+    long i;
+    double t0;
+
+    host_quiet(1);
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) type_line(trm, lines[i % 4]);
+    host_quiet(0);
+    report("terminal (one command line)", now_ns()-t0, n);
+}
+
+
+/* Every minute from 'y0' to 'y1' (exclusive), through the same path as
+ * the firmware */
+static void sweep(int y0, int y1)
+{
+    time_t t, end = year_start(y1);
+    long minutes = 0;
+    long lit[MAX_CHANNELS] = {0};
+    double t0 = now_ns();
+    int c;
+
+    for ( t=year_start(y0); t<end; t+=60 ) {
+        uint8_t leds = schedule_lookup(schedule_minute_of_week(t));
+        for ( c=0; c<MAX_CHANNELS; c++ ) {
+            if ( leds & 1<<c ) lit[c]++;
+        }
+        minutes++;
+    }
+
+    printf("\nSchedule for every minute of %i-%i:\n", y0, y1-1);
+    report("  minute_of_week + lookup", now_ns()-t0, minutes);
+    for ( c=0; c<MAX_CHANNELS; c++ ) {
+        if ( lit[c] == 0 ) continue;
+        printf("  channel %i lit for %.1f hours per year\n",
+               c, lit[c]/60.0/(y1-y0));
+    }
+}
+
+
+/* Compare dst() with the EU rule at every hour */
+static void check_dst(int y0, int y1)
+{
+    int y;
+    int total = 0;
+    int years_wrong = 0;
+
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+
+    printf("\ndst() against the EU rule, %i-%i:\n", y0, y1-1);
+    for ( y=y0; y<y1; y++ ) {
+        time_t t;
+        int wrong = 0;
+        for ( t=year_start(y)+1800; t<year_start(y+1); t+=3600 ) {
+            struct tm tm;
+            localtime_r(&t, &tm);
+            if ( dst(t) != (tm.tm_isdst > 0) ) wrong++;
+        }
+        if ( wrong ) years_wrong++;
+        total += wrong;
+    }
+    printf("  %i hours wrong, in %i of %i years\n", total, years_wrong, y1-y0);
+    if ( total > 0 ) failed = 1;
+
+    setenv("TZ", "UTC0", 1);
+    tzset();
+}
+
+
+static void fuzz_terminal(Terminal *trm, long n, unsigned int seed)
+{
+    static const char *cmds[] = {
+        "ds", "tt", "set ", "setds", "osf", "load", "settings", "leds ",
+        "wake ", "rise ", "event ", "tz ", "clear ", "ntp ", "ntpmode ",
+        "ntpserver", "ntpserver ", "remote ", "ota", "help", ""
+    };
+    const int n_cmds = sizeof(cmds)/sizeof(cmds[0]);
+    static const char alphabet[] = "0123456789 :-SMTWFoffn\x08\x15\x00\xff%";
+    long i;
+    double t0;
+    char line[400];
+
+    srand(seed);
+    host_quiet(1);
+    t0 = now_ns();
+    for ( i=0; i<n; i++ ) {
+        const char *cmd = cmds[rand() % n_cmds];
+        int len = strlen(cmd);
+        int extra = rand() % 300;
+        int j;
+        memcpy(line, cmd, len);
+        for ( j=0; j<extra; j++ ) {
+            line[len++] = alphabet[rand() % (sizeof(alphabet)-1)];
+        }
+        line[len++] = '\r';
+        host_input(line, len);
+        while ( host_input_pending() ) terminal_poll(trm);
+    }
+    host_quiet(0);
+    printf("\nTerminal fuzzing (seed %u):\n", seed);
+    report("  random command line", now_ns()-t0, n);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Terminal *trm;
+    long scale = 1000000;
+    int y0 = 2000;
+    int y1 = 2100;
+    long n_fuzz = 100000;
+    unsigned int seed = 1;
+    int days = 30;
+    int c;
+
+    while ( (c = getopt(argc, argv, "qy:f:s:")) != -1 ) {
+        switch ( c ) {
+            case 'q' : scale = 10000; y1 = 2030; n_fuzz = 1000; days = 2; break;
+            case 'y' : y1 = y0 + atoi(optarg); break;
+            case 'f' : n_fuzz = atol(optarg); break;
+            case 's' : seed = atoi(optarg); break;
+            default :
+            fprintf(stderr, "Usage: %s [-q] [-y years] [-f fuzz lines] "
+                            "[-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* The firmware's calendar conversions assume UTC, like newlib */
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    host_quiet(1);
+    ds3231_init();
+    settings_read();
+    trm = terminal_init();
+    host_quiet(0);
+    make_samples();
+
+    bench_calendar(scale*10);
+    bench_dst(scale*10);
+    bench_minute_of_week(scale*10);
+    bench_lookup(scale*10);
+    bench_compile(scale/100);
+    bench_ds3231_roundtrip(scale);
+    bench_ds3231_to_clock(scale);
+    bench_ds3231_fault(100);
+    bench_check_clock(scale);
+    bench_ds3231_flags(scale);
+    bench_settings_read(scale/10, 1);
+    bench_settings_read(scale/10, 16);
+    bench_terminal(trm, scale/10);
+
+    /* Back to the default schedule for the sweep */
+    memset(host_flash+PICO_FLASH_SIZE_BYTES-4096, 0xff, 4096);
+    host_quiet(1);
+    settings_read();
+    host_quiet(0);
+    sweep(y0, y1);
+    check_dst(y0, y1);
+    check_aligned_write();
+    check_bcd();
+    check_temperature();
+    check_pps(20, 64);
+    check_ds3231_days(days, 0.0, 0.0);
+    check_ds3231_days(1, 0.05, 0.01);
+    check_energy("Energy, 100 ms loop", 100000, 500, 0);
+    check_energy("Energy, 10 ms loop with USB", 10000, 500, 1);
+
+    fuzz_terminal(trm, n_fuzz, seed);
+
+    if ( failed ) printf("\nFAILED: see above\n");
+    return failed;
+}
@@ -0,0 +1,242 @@
+/*
+ * cyw43.c
+ *
+ * Host implementation of the wireless chip and DHCP client, for wifi.c
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Only the fleet simulator (fleet.c) builds this, along with wifi.c and
+ * morningtown.c.  There is no radio: joining asks whatever is playing
+ * the access point, which calls host_wifi_link() some time later if it
+ * worked.  Like lwIP's, the DHCP client starts when the link comes up,
+ * tries again after 4, 8, 16... seconds until it gets an answer, and
+ * renews the lease half way through. */
+
+#include <string.h>
+
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+
+#include "lwip/netif.h"
+#include "lwip/dhcp.h"
+
+#include "host.h"
+
+#define DHCP_FIRST_TIMEOUT_US 4000000
+#define DHCP_MAX_TIMEOUT_US 64000000
+
+void (*host_wifi_join_hook)(const uint8_t *bssid, uint32_t channel);
+
+static uint8_t link_bssid[6];
+static uint32_t link_channel;
+static struct dhcp dhcp;
+static alarm_id_t dhcp_alarm = 0;
+static uint64_t dhcp_timeout;
+
+
+static struct netif *sta_netif()
+{
+    return &cyw43_state.netif[CYW43_ITF_STA];
+}
+
+
+/* ---------------------------- Driver ---------------------------- */
+
+int cyw43_arch_init()
+{
+    return 0;
+}
+
+
+void cyw43_arch_enable_sta_mode() {}
+void cyw43_arch_gpio_put(uint wl_gpio, bool value) {}
+
+
+/* Packets are handed over as they arrive, so there's nothing to do */
+void cyw43_arch_poll() {}
+
+
+void cyw43_arch_wait_for_work_until(absolute_time_t until)
+{
+    if ( until > time_us_64() ) host_advance_us(until - time_us_64());
+}
+
+
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw,
+                                  uint32_t auth)
+{
+    if ( host_wifi_join_hook != NULL ) host_wifi_join_hook(NULL, 0);
+    return 0;
+}
+
+
+int cyw43_wifi_join(cyw43_t *self, size_t ssid_len, const uint8_t *ssid,
+                    size_t key_len, const uint8_t *key, uint32_t auth_type,
+                    const uint8_t *bssid, uint32_t channel)
+{
+    if ( host_wifi_join_hook != NULL ) host_wifi_join_hook(bssid, channel);
+    return 0;
+}
+
+
+int cyw43_wifi_get_bssid(cyw43_t *self, uint8_t bssid[6])
+{
+    if ( !netif_is_link_up(sta_netif()) ) return -1;
+    memcpy(bssid, link_bssid, 6);
+    return 0;
+}
+
+
+int cyw43_ioctl(cyw43_t *self, uint32_t cmd, size_t len, uint8_t *buf,
+                uint32_t iface)
+{
+    if ( (cmd != CYW43_IOCTL_GET_CHANNEL) || (len < 4) ) return -1;
+    memcpy(buf, &link_channel, 4);
+    return 0;
+}
+
+
+/* ---------------------------- netif ---------------------------- */
+
+void netif_set_addr(struct netif *netif, const ip4_addr_t *ipaddr,
+                    const ip4_addr_t *netmask, const ip4_addr_t *gw)
+{
+    netif->ip_addr = *ipaddr;
+    netif->netmask = *netmask;
+    netif->gw = *gw;
+    if ( netif->status_callback != NULL ) netif->status_callback(netif);
+}
+
+
+void netif_set_status_callback(struct netif *netif,
+                               netif_status_callback_fn cb)
+{
+    netif->status_callback = cb;
+}
+
+
+void netif_set_link_callback(struct netif *netif, netif_status_callback_fn cb)
+{
+    netif->link_callback = cb;
+}
+
+
+/* ---------------------------- DHCP ---------------------------- */
+
+u8_t dhcp_supplied_address(const struct netif *netif)
+{
+    return (netif->dhcp != NULL) && netif->dhcp->bound;
+}
+
+
+static void dhcp_send(uint8_t type)
+{
+    if ( host_udp_send_hook == NULL ) return;
+    host_udp_send_hook(68, 0xffffffff, 67, &type, 1);
+}
+
+
+static int64_t dhcp_handler(alarm_id_t id, void *user_data)
+{
+    if ( !netif_is_link_up(sta_netif()) ) {
+        dhcp_alarm = 0;
+        return 0;
+    }
+
+    /* Renewing the lease */
+    if ( dhcp.bound ) {
+        dhcp_send(HOST_DHCP_REQUEST);
+        dhcp_timeout = DHCP_FIRST_TIMEOUT_US;
+        return dhcp_timeout;
+    }
+
+    dhcp_send(HOST_DHCP_DISCOVER);
+    if ( dhcp_timeout < DHCP_MAX_TIMEOUT_US ) dhcp_timeout *= 2;
+    return dhcp_timeout;
+}
+
+
+static void dhcp_stop()
+{
+    if ( dhcp_alarm > 0 ) cancel_alarm(dhcp_alarm);
+    dhcp_alarm = 0;
+    dhcp.bound = 0;
+    dhcp.offered_t0_lease = 0;
+}
+
+
+static void dhcp_start()
+{
+    dhcp_stop();
+    sta_netif()->dhcp = &dhcp;
+    dhcp_timeout = DHCP_FIRST_TIMEOUT_US;
+    dhcp_send(HOST_DHCP_DISCOVER);
+    dhcp_alarm = add_alarm_in_us(dhcp_timeout, dhcp_handler, NULL, true);
+}
+
+
+void host_dhcp_lease(uint32_t addr, uint32_t netmask, uint32_t gw,
+                     uint32_t lease_s, const uint32_t *ntp, int n_ntp)
+{
+    struct netif *n = sta_netif();
+    ip4_addr_t ip, mask, router;
+    ip4_addr_t servers[LWIP_DHCP_MAX_NTP_SERVERS];
+    int i;
+
+    if ( !netif_is_link_up(n) ) return;
+
+    if ( dhcp_alarm > 0 ) cancel_alarm(dhcp_alarm);
+    dhcp.bound = 1;
+    dhcp.offered_t0_lease = lease_s;
+    dhcp_alarm = add_alarm_in_us(lease_s*500000ULL, dhcp_handler, NULL, true);
+
+    /* Options come before the address, as in lwIP */
+    if ( n_ntp > LWIP_DHCP_MAX_NTP_SERVERS ) n_ntp = LWIP_DHCP_MAX_NTP_SERVERS;
+    for ( i=0; i<n_ntp; i++ ) servers[i].addr = ntp[i];
+    if ( n_ntp > 0 ) dhcp_set_ntp_servers(n_ntp, servers);
+
+    ip.addr = addr;
+    mask.addr = netmask;
+    router.addr = gw;
+    netif_set_addr(n, &ip, &mask, &router);
+}
+
+
+/* ---------------------------- Link ---------------------------- */
+
+void host_wifi_link(int up, const uint8_t *bssid, uint32_t channel)
+{
+    struct netif *n = sta_netif();
+
+    if ( up ) {
+        memcpy(link_bssid, bssid, 6);
+        link_channel = channel;
+        n->flags |= NETIF_FLAG_LINK_UP;
+        if ( n->link_callback != NULL ) n->link_callback(n);
+        dhcp_start();
+    } else {
+        dhcp_stop();
+        n->flags &= ~NETIF_FLAG_LINK_UP;
+        n->ip_addr.addr = 0;
+        n->netmask.addr = 0;
+        n->gw.addr = 0;
+        if ( n->link_callback != NULL ) n->link_callback(n);
+    }
+}
@@ -0,0 +1,554 @@
+/*
+ * ds3231_model.c
+ *
+ * Behavioural model of the DS3231, on a simulated I2C bus
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The only thing on the I2C bus.  Modelled:
+ *
+ *  - the time and date registers, in BCD and 12 or 24 hour mode, counted
+ *    by an oscillator with a temperature-dependent error and the aging
+ *    offset, and restarted by writing the seconds register,
+ *  - temperature conversions every 64 s or on request (CONV, BSY and the
+ *    temperature registers), which is also when the aging offset and the
+ *    temperature take effect,
+ *  - both alarms, with their flags and INT, or the 1 Hz square wave,
+ *    either of them as falling edges on host_ds3231.sqw_gpio,
+ *  - OSF, EN32KHZ and the other flags which can only be cleared,
+ *  - transactions taking the right number of bit times at the bus speed,
+ *  - NAKs, and SDA getting stuck low until the bus is cleared.
+ *
+ * The square wave is only modelled at 1 Hz, and the oscillator never
+ * stops (EOSC only matters on battery power).
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <pico/stdlib.h>
+#include <hardware/i2c.h>
+
+#include "host.h"
+
+#define DS3231_ADDR 0x68
+#define PIN_SDA 4
+#define PIN_SCL 5
+#define NUM_REGS 19
+
+#define REG_CONTROL 0x0e
+#define REG_STATUS 0x0f
+#define REG_AGING 0x10
+#define REG_TEMP 0x11
+
+#define CTRL_CONV (1<<5)
+#define CTRL_RS (3<<3)
+#define CTRL_INTCN (1<<2)
+#define CTRL_A2IE (1<<1)
+#define CTRL_A1IE (1<<0)
+
+#define STAT_OSF (1<<7)
+#define STAT_EN32KHZ (1<<3)
+#define STAT_BSY (1<<2)
+#define STAT_A2F (1<<1)
+#define STAT_A1F (1<<0)
+
+/* Datasheet: a conversion takes 125 to 200 ms */
+#define CONV_US 200000
+
+struct host_ds3231 host_ds3231 = {
+    .present = 1,
+    .sqw_gpio = 6,
+    .ppm = 0.0,
+    .tempco = -0.004,
+    .temp_c = 25.0,
+    .regs = {
+        0x00, 0x15, 0x07, 0x02, 0x12, 0x10, 0x26,   /* 07:15:00 Mon 12/10/2026 */
+        0, 0, 0, 0, 0, 0, 0,
+        0x1c, 0x88, 0x00, 0x19, 0x00                /* OSF set, 25 degC */
+    },
+};
+
+static int started = 0;
+static double next_tick;        /* time_us_64() of the next second */
+static uint32_t n_ticks = 0;
+static uint64_t conv_end = 0;   /* Conversion in progress until then */
+static int converting = 0;
+static int int_low = 0;
+static int ptr = 0;
+static uint bit_us = 10;
+static alarm_id_t tick_alarm = 0;
+
+static int stalled = 0;
+static int stall_clocks;
+
+
+static int from_bcd(uint8_t n)
+{
+    return ((n & 0xf0)>>4)*10 + (n & 0x0f);
+}
+
+
+static uint8_t to_bcd(int n)
+{
+    return (n/10)<<4 | (n%10);
+}
+
+
+static double chance()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+
+static double oscillator_ppm()
+{
+    double dt = host_ds3231.temp_c - 25.0;
+    int8_t aging = host_ds3231.regs[REG_AGING];
+    return host_ds3231.ppm + host_ds3231.tempco*dt*dt - 0.1*aging;
+}
+
+
+static double period_us()
+{
+    return 1e6 / (1.0 + host_ds3231.speed_ppm*1e-6);
+}
+
+
+static void finish_conversion()
+{
+    int q = lround(host_ds3231.temp_c * 4.0);   /* Quarter degrees */
+
+    host_ds3231.regs[REG_TEMP] = (uint8_t)(q >> 2);
+    host_ds3231.regs[REG_TEMP+1] = (q & 3) << 6;
+    host_ds3231.regs[REG_CONTROL] &= ~CTRL_CONV;
+    host_ds3231.speed_ppm = oscillator_ppm();
+    converting = 0;
+    host_ds3231.conversions++;
+}
+
+
+static void start_conversion(uint64_t t)
+{
+    if ( converting ) return;
+    converting = 1;
+    conv_end = t + CONV_US;
+}
+
+
+/* INT goes low when an enabled alarm flag is set (with INTCN=1) */
+static void update_int()
+{
+    uint8_t ctrl = host_ds3231.regs[REG_CONTROL];
+    uint8_t stat = host_ds3231.regs[REG_STATUS];
+    int low = (ctrl & CTRL_INTCN)
+           && (((ctrl & CTRL_A1IE) && (stat & STAT_A1F))
+            || ((ctrl & CTRL_A2IE) && (stat & STAT_A2F)));
+
+    if ( low && !int_low && (host_ds3231.sqw_gpio >= 0) ) {
+        host_gpio_event(host_ds3231.sqw_gpio, GPIO_IRQ_EDGE_FALL);
+    }
+    int_low = low;
+}
+
+
+static int field_matches(uint8_t alarm, uint8_t now, uint8_t mask)
+{
+    return (alarm & 0x80) || ((alarm & mask) == now);
+}
+
+
+/* The day/date alarm field compares with the day (DY/DT=1) or date */
+static int day_matches(uint8_t alarm, const uint8_t *r)
+{
+    if ( alarm & 0x80 ) return 1;
+    if ( alarm & 0x40 ) return (alarm & 0x0f) == r[3];
+    return (alarm & 0x3f) == r[4];
+}
+
+
+static void check_alarms()
+{
+    const uint8_t *r = host_ds3231.regs;
+
+    if ( field_matches(r[7], r[0], 0x7f)
+      && field_matches(r[8], r[1], 0x7f)
+      && field_matches(r[9], r[2], 0x7f)
+      && day_matches(r[10], r) )
+    {
+        host_ds3231.regs[REG_STATUS] |= STAT_A1F;
+    }
+
+    /* Alarm 2 has no seconds: it goes off at 00 */
+    if ( (r[0] == 0)
+      && field_matches(r[11], r[1], 0x7f)
+      && field_matches(r[12], r[2], 0x7f)
+      && day_matches(r[13], r) )
+    {
+        host_ds3231.regs[REG_STATUS] |= STAT_A2F;
+    }
+}
+
+
+static int days_in_month(int month, int year)
+{
+    const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if ( (month == 2) && (year % 4 == 0) ) return 29;   /* Until 2100 */
+    return days[(month-1) % 12];
+}
+
+
+/* One second on, with all the carries */
+static void count_second()
+{
+    uint8_t *r = host_ds3231.regs;
+    int sec = from_bcd(r[0] & 0x7f);
+    int min = from_bcd(r[1] & 0x7f);
+    int h12 = r[2] & 0x40;
+    int hour;
+    int date, month, year;
+
+    if ( h12 ) {
+        hour = from_bcd(r[2] & 0x1f) % 12 + ((r[2] & 0x20) ? 12 : 0);
+    } else {
+        hour = from_bcd(r[2] & 0x3f);
+    }
+
+    if ( ++sec < 60 ) goto done;
+    sec = 0;
+    if ( ++min < 60 ) goto done;
+    min = 0;
+    if ( ++hour < 24 ) goto done;
+    hour = 0;
+
+    r[3] = (r[3] % 7) + 1;
+    date = from_bcd(r[4] & 0x3f);
+    month = from_bcd(r[5] & 0x1f);
+    year = from_bcd(r[6]);
+    if ( ++date > days_in_month(month, year) ) {
+        date = 1;
+        if ( ++month > 12 ) {
+            month = 1;
+            if ( ++year > 99 ) {
+                year = 0;
+                r[5] ^= 0x80;   /* Century */
+            }
+        }
+    }
+    r[4] = to_bcd(date);
+    r[5] = (r[5] & 0x80) | to_bcd(month);
+    r[6] = to_bcd(year);
+
+done:
+    r[0] = to_bcd(sec);
+    r[1] = to_bcd(min);
+    if ( h12 ) {
+        int h = hour % 12;
+        r[2] = 0x40 | ((hour >= 12) ? 0x20 : 0) | to_bcd(h ? h : 12);
+    } else {
+        r[2] = to_bcd(hour);
+    }
+}
+
+
+static void tick()
+{
+    uint8_t ctrl = host_ds3231.regs[REG_CONTROL];
+
+    count_second();
+    if ( ++n_ticks % 64 == 0 ) start_conversion(next_tick);
+    check_alarms();
+
+    if ( !(ctrl & CTRL_INTCN) ) {
+        /* The 1 Hz square wave falls as the seconds change */
+        if ( ((ctrl & CTRL_RS) == 0) && (host_ds3231.sqw_gpio >= 0) ) {
+            host_gpio_event(host_ds3231.sqw_gpio, GPIO_IRQ_EDGE_FALL);
+        }
+    } else {
+        update_int();
+    }
+}
+
+
+void host_ds3231_update()
+{
+    uint64_t now = time_us_64();
+
+    if ( !started ) {
+        started = 1;
+        host_ds3231.speed_ppm = oscillator_ppm();
+        next_tick = now + period_us();
+    }
+
+    while ( next_tick <= now ) {
+        if ( converting && (conv_end <= next_tick) ) finish_conversion();
+        tick();
+        next_tick += period_us();
+    }
+    if ( converting && (conv_end <= now) ) finish_conversion();
+}
+
+
+/* Goes off at each second, so that the edges come at the right times */
+static int64_t tick_handler(alarm_id_t id, void *user_data)
+{
+    uint64_t now = time_us_64();
+    uint64_t t;
+
+    host_ds3231_update();
+    t = ceil(next_tick);
+    if ( host_ds3231.sqw_gpio < 0 ) {
+        tick_alarm = 0;
+        return 0;
+    }
+    return -(int64_t)((t > now) ? t - now : 1);
+}
+
+
+static void start_ticking()
+{
+    uint64_t now = time_us_64();
+    uint64_t t = ceil(next_tick);
+
+    if ( (tick_alarm > 0) || (host_ds3231.sqw_gpio < 0) ) return;
+    tick_alarm = add_alarm_in_us((t > now) ? t - now : 1, tick_handler,
+                                 NULL, true);
+}
+
+
+static void write_reg(int reg, uint8_t v, uint64_t t)
+{
+    uint8_t *r = host_ds3231.regs;
+
+    switch ( reg ) {
+
+        case 0x00 :
+        /* The countdown restarts as the seconds byte is acknowledged */
+        r[0] = v & 0x7f;
+        next_tick = t + period_us();
+        host_ds3231.set_us = t;
+        break;
+
+        case REG_CONTROL :
+        r[REG_CONTROL] = (r[REG_CONTROL] & CTRL_CONV) | v;
+        if ( v & CTRL_CONV ) start_conversion(t);
+        break;
+
+        case REG_STATUS :
+        /* OSF, A2F and A1F can only be cleared, and BSY is read-only */
+        r[REG_STATUS] = (r[REG_STATUS] & v & (STAT_OSF|STAT_A2F|STAT_A1F))
+                      | (v & STAT_EN32KHZ);
+        break;
+
+        case REG_TEMP :
+        case REG_TEMP+1 :
+        break;
+
+        default :
+        r[reg] = v;
+        break;
+
+    }
+}
+
+
+/* A START, the address and 'len' bytes, each acknowledged, and a STOP */
+static uint64_t transaction_us(size_t len)
+{
+    return (2 + 9*(1+len)) * bit_us;
+}
+
+
+/* Returns non-zero (and the return value for the SDK) if the transaction
+ * doesn't get through */
+static int bus_trouble(uint timeout_us, int *r)
+{
+    if ( stalled ) {
+        host_ds3231.timeouts++;
+        host_advance_us(timeout_us);
+        *r = PICO_ERROR_TIMEOUT;
+        return 1;
+    }
+
+    if ( (host_ds3231.p_stall > 0.0) && (chance() < host_ds3231.p_stall) ) {
+        stalled = 1;
+        stall_clocks = 1 + rand() % 9;
+        host_ds3231.timeouts++;
+        host_advance_us(timeout_us);
+        *r = PICO_ERROR_TIMEOUT;
+        return 1;
+    }
+
+    if ( (host_ds3231.p_nak > 0.0) && (chance() < host_ds3231.p_nak) ) {
+        host_ds3231.naks++;
+        host_advance_us(10*bit_us);
+        *r = PICO_ERROR_GENERIC;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static int ds3231_write(const uint8_t *src, size_t len, uint timeout_us)
+{
+    uint64_t t0;
+    size_t i;
+    int r;
+
+    if ( !host_ds3231.present ) return PICO_ERROR_GENERIC;
+    if ( bus_trouble(timeout_us, &r) ) return r;
+    if ( len == 0 ) return 0;
+
+    host_ds3231_update();
+    t0 = time_us_64();
+    ptr = src[0] % NUM_REGS;
+    for ( i=1; i<len; i++ ) {
+        /* Byte i is acknowledged after the START, address and i+1 more */
+        write_reg(ptr, src[i], t0 + (1 + 9*(i+2))*bit_us);
+        ptr = (ptr+1) % NUM_REGS;
+    }
+    update_int();
+
+    host_ds3231.writes++;
+    host_ds3231.bytes += len;
+    host_advance_us(transaction_us(len));
+    start_ticking();
+    return len;
+}
+
+
+static int ds3231_read(uint8_t *dst, size_t len, uint timeout_us)
+{
+    size_t i;
+    int r;
+
+    if ( !host_ds3231.present ) return PICO_ERROR_GENERIC;
+    if ( bus_trouble(timeout_us, &r) ) return r;
+
+    /* The time registers are copied at the START */
+    host_ds3231_update();
+    for ( i=0; i<len; i++ ) {
+        dst[i] = host_ds3231.regs[ptr];
+        if ( (ptr == REG_STATUS) && converting ) dst[i] |= STAT_BSY;
+        ptr = (ptr+1) % NUM_REGS;
+    }
+
+    host_ds3231.reads++;
+    host_ds3231.bytes += len;
+    host_advance_us(transaction_us(len));
+    start_ticking();
+    return len;
+}
+
+
+/* SCL let go during a bus clear.  Enough clocks and the DS3231 finishes
+ * the byte it was sending, and lets go of SDA. */
+void host_i2c_pin_released(uint gpio)
+{
+    if ( (gpio != PIN_SCL) || !stalled ) return;
+    if ( --stall_clocks == 0 ) {
+        stalled = 0;
+        host_ds3231.bus_clears++;
+    }
+}
+
+
+int host_i2c_pin_level(uint gpio, int *level)
+{
+    if ( gpio == PIN_SDA ) {
+        *level = !stalled;
+        return 1;
+    }
+    if ( gpio == PIN_SCL ) {
+        *level = 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* ---------------------------- SDK ---------------------------- */
+
+struct i2c_inst { int n; };
+static struct i2c_inst i2c0_inst;
+i2c_inst_t *i2c0 = &i2c0_inst;
+
+int host_i2c_fault = HOST_I2C_OK;
+int (*host_i2c_read_hook)(int reg, uint8_t *dst, size_t len, int *result);
+
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    bit_us = (1000000 + baudrate/2) / baudrate;
+    if ( bit_us == 0 ) bit_us = 1;
+    return baudrate;
+}
+
+
+void i2c_deinit(i2c_inst_t *i2c)
+{
+}
+
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src,
+                       size_t len, bool nostop)
+{
+    if ( addr != DS3231_ADDR ) return PICO_ERROR_GENERIC;
+    return ds3231_write(src, len, 0);
+}
+
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst,
+                      size_t len, bool nostop)
+{
+    if ( addr != DS3231_ADDR ) return PICO_ERROR_GENERIC;
+    return ds3231_read(dst, len, 0);
+}
+
+
+int i2c_write_timeout_us(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src,
+                         size_t len, bool nostop, uint timeout_us)
+{
+    if ( host_i2c_fault == HOST_I2C_NAK ) return PICO_ERROR_GENERIC;
+    if ( host_i2c_fault == HOST_I2C_TIMEOUT ) {
+        host_advance_us(timeout_us);
+        return PICO_ERROR_TIMEOUT;
+    }
+    if ( addr != DS3231_ADDR ) return PICO_ERROR_GENERIC;
+    return ds3231_write(src, len, timeout_us);
+}
+
+
+int i2c_read_timeout_us(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst,
+                        size_t len, bool nostop, uint timeout_us)
+{
+    int r;
+
+    if ( host_i2c_fault == HOST_I2C_NAK ) return PICO_ERROR_GENERIC;
+    if ( host_i2c_fault == HOST_I2C_TIMEOUT ) {
+        host_advance_us(timeout_us);
+        return PICO_ERROR_TIMEOUT;
+    }
+    if ( (host_i2c_read_hook != NULL)
+      && host_i2c_read_hook(ptr, dst, len, &r) ) return r;
+    if ( addr != DS3231_ADDR ) return PICO_ERROR_GENERIC;
+    return ds3231_read(dst, len, timeout_us);
+}
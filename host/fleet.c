@@ -0,0 +1,1121 @@
+/*
+ * fleet.c
+ *
+ * Many units sharing a simulated network and time server
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Runs hundreds of units, each with the firmware's main loop
+ * (morningtown.c), wifi.c, ntp_client.c and settings.c, against one
+ * simulated access point, DHCP server, DNS server and NTP server, all on
+ * the same simulated clock.  Half way through, the power goes off and
+ * comes back on, for the units and the network alike.
+ *
+ * The firmware keeps its state in file-scope variables, so each unit is
+ * its own copy of mtunit.so, loaded with dlopen() from its own file.  The
+ * units are shared out between worker threads.  Time moves on in steps
+ * of the shortest network delay: nothing a unit does during a step can
+ * reach the servers (or another unit) before the next one, so the
+ * threads only need to meet at the end of each step, when the servers
+ * deal with whatever was sent.
+ *
+ * At the end comes:
+ *
+ *  - the requests per second at each server, on average and in the
+ *    busiest second, and how many were dropped,
+ *  - how long the units took to join, get an address and synchronise
+ *    after each power-up,
+ *  - how far out their clocks were at the end,
+ *  - their estimated charge per day (see energy.c).
+ *
+ * With -d, the first unit's input record (see record.c) is saved at the
+ * end, as if typed 'record dump' on its console, for mtreplay.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
+#include <pico/stdlib.h>
+
+#include "clock.h"
+#include "status.h"
+#include "energy.h"
+#include "ntp_client.h"
+#include "host.h"
+#include "netsim.h"
+
+/* 2026-10-18 00:00:00 UTC */
+#define UTC_START 1792281600ULL
+
+#define SERVER_NAME "pool.ntp.org"
+#define SERVER_ADDR "10.0.0.123"
+#define GATEWAY_ADDR "10.0.0.1"
+#define NETMASK "255.255.0.0"
+#define LEASE_S 86400
+#define WIFI_CHANNEL 6
+
+/* Scanning all the channels, before asking to join */
+#define SCAN_US 2500000
+
+/* How long lwIP keeps trying before giving up on a DNS lookup */
+#define DNS_TIMEOUT_US 10000000
+
+/* How long a DNS answer stays in lwIP's cache */
+#define DNS_TTL_US (300ULL*1000000)
+
+static const uint8_t ap_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+enum service
+{
+    S_ASSOC,
+    S_DHCP,
+    S_DNS,
+    S_NTP,
+    NUM_SERVICES
+};
+
+/* Each server deals with one request at a time, and drops requests when
+ * too many are waiting */
+struct server
+{
+    const char *name;
+    double rate;                /* Requests per second */
+    int max_queue;
+    uint64_t busy_until;
+    uint64_t requests;
+    uint64_t dropped;
+    uint64_t wait_max;
+    uint32_t *per_second;       /* Arrivals in each second */
+};
+
+static struct server servers[NUM_SERVICES] = {
+    {"Wi-Fi association", 20.0, 50},
+    {"DHCP", 100.0, 50},
+    {"DNS", 1000.0, 100},
+    {"NTP", 200.0, 64},
+};
+
+/* A request on its way to one of the servers */
+struct request
+{
+    uint64_t t;                 /* Arrival, in global time */
+    int unit;
+    int generation;
+    enum service service;
+    int type;                   /* Join number, or HOST_DHCP_xxx */
+    uint16_t port;
+    uint8_t data[64];
+};
+
+/* Something on its way to a unit */
+enum event_type
+{
+    EV_LINK,
+    EV_LEASE,
+    EV_DNS,
+    EV_NTP
+};
+
+struct event
+{
+    uint64_t t;                 /* Global time */
+    enum event_type type;
+    int ok;
+    uint16_t port;
+    uint8_t data[NTP_MSG_LEN];
+};
+
+struct unit
+{
+    int id;
+    int generation;             /* Counts power cuts */
+    char path[PATH_MAX];
+    void *lib;
+    unsigned int seed;
+    double ppm;                 /* Crystal error */
+    int powered;
+    uint64_t boot;              /* Global time of the last power-up */
+    uint64_t next_poll;         /* Local time of the next main loop pass */
+    uint64_t next_action;       /* Global time of the next thing to do */
+    uint8_t *saved_flash;
+
+    /* In this unit's copy of the firmware */
+    void (*init)(void);
+    int (*poll)(void);
+    uint64_t (*now)(void);
+    void (*advance)(uint64_t us);
+    int (*next_alarm)(uint64_t *t);
+    int (*udp_deliver)(uint32_t addr, uint16_t port, uint16_t dst_port,
+                       const uint8_t *data, size_t len);
+    void (*dns_answer)(const char *name, const uint32_t *addr);
+    void (*wifi_link)(int up, const uint8_t *bssid, uint32_t channel);
+    void (*dhcp_lease)(uint32_t addr, uint32_t netmask, uint32_t gw,
+                       uint32_t lease_s, const uint32_t *ntp, int n_ntp);
+    uint64_t (*clock_utc_us)(uint64_t local_us);
+    int (*clock_source)(void);
+    uint32_t (*uah_per_day)(void);
+    uint64_t (*residency_us)(int state);
+    struct mt_counters *counters;
+    uint8_t *flash;
+
+    /* Sorted by time */
+    struct event *inbox;
+    int n_inbox;
+    int max_inbox;
+
+    /* As the network sees it */
+    int associated;
+    int join;                   /* Latest join attempt */
+    uint64_t dns_until;         /* End of lwIP's DNS cache */
+
+    /* Time from power-up (zero if it hasn't happened), for each
+     * generation */
+    uint64_t t_link[2];
+    uint64_t t_lease[2];
+    uint64_t t_sync[2];
+};
+
+struct worker
+{
+    pthread_t thread;
+    int idx;
+    uint64_t next_action;       /* Earliest of its units' */
+    struct request *out;
+    int n_out;
+    int max_out;
+};
+
+/* Options */
+static int n_units = 200;
+static int n_workers = 0;
+static uint64_t duration = 3600ULL*1000000;
+static uint64_t cut_at = 1800ULL*1000000;
+static uint64_t cut_off = 30ULL*1000000;
+static uint64_t ap_boot = 45ULL*1000000;
+static uint32_t spread_us = 500000;
+static uint32_t latency_us = 5000;
+static uint32_t jitter_us = 2000;
+static int dhcp_ntp = 1;
+static double max_ppm = 30.0;
+
+static struct unit *units;
+static struct worker *workers;
+static uint32_t server_addr;
+static uint32_t gateway_addr;
+static uint32_t netmask;
+static int n_generations = 1;
+static uint64_t net_down = UINT64_MAX;
+static uint64_t net_up = 0;
+
+/* The heap of requests, ordered by arrival time */
+static struct request *heap;
+static int n_heap = 0;
+static int max_heap = 0;
+static uint64_t first_delivery;
+
+static pthread_barrier_t step_start;
+static pthread_barrier_t step_done;
+static uint64_t step_end;
+static int finished = 0;
+
+static __thread struct unit *current;
+static __thread struct worker *current_worker;
+
+
+/* ---------------------------- Time ---------------------------- */
+
+static uint64_t to_local(struct unit *u, uint64_t t)
+{
+    if ( t <= u->boot ) return 0;
+    return (t - u->boot) * (1.0 + u->ppm*1e-6);
+}
+
+
+static uint64_t to_global(struct unit *u, uint64_t local)
+{
+    return u->boot + local / (1.0 + u->ppm*1e-6);
+}
+
+
+static uint64_t global_now(struct unit *u)
+{
+    return to_global(u, u->now());
+}
+
+
+static uint64_t one_way_us(struct unit *u)
+{
+    return latency_us + rand_r(&u->seed) % (jitter_us+1);
+}
+
+
+static uint64_t to_utc(uint64_t t)
+{
+    return UTC_START*1000000 + t;
+}
+
+
+/* ---------------------------- The units' side ---------------------------- */
+
+static void submit(enum service service, int type, uint64_t t, uint16_t port,
+                   const void *data, size_t len)
+{
+    struct worker *w = current_worker;
+    struct request *r;
+
+    if ( w->n_out == w->max_out ) {
+        w->max_out = w->max_out ? 2*w->max_out : 256;
+        w->out = realloc(w->out, w->max_out*sizeof(struct request));
+        if ( w->out == NULL ) abort();
+    }
+    r = &w->out[w->n_out++];
+    r->t = t;
+    r->unit = current->id;
+    r->generation = current->generation;
+    r->service = service;
+    r->type = type;
+    r->port = port;
+    if ( len > sizeof(r->data) ) len = sizeof(r->data);
+    if ( len > 0 ) memcpy(r->data, data, len);
+}
+
+
+static void dhcp_hook(uint16_t src_port, int type)
+{
+    uint64_t t = global_now(current) + one_way_us(current);
+    submit(S_DHCP, type, t, src_port, NULL, 0);
+}
+
+
+static void ntp_hook(uint16_t src_port, const uint8_t *req)
+{
+    uint64_t t = global_now(current) + one_way_us(current);
+    submit(S_NTP, 0, t, src_port, req, NTP_MSG_LEN);
+}
+
+
+static void join_hook(const uint8_t *bssid, uint32_t channel)
+{
+    uint64_t t = global_now(current) + one_way_us(current);
+    if ( bssid == NULL ) t += SCAN_US;
+    current->join++;
+    submit(S_ASSOC, current->join, t, 0, NULL, 0);
+}
+
+
+static int dns_cached_hook(const char *name)
+{
+    return global_now(current) < current->dns_until;
+}
+
+
+static void dns_hook(const char *name)
+{
+    uint64_t t = global_now(current) + one_way_us(current);
+    submit(S_DNS, 0, t, 0, name, strlen(name)+1);
+}
+
+
+static void *sym(struct unit *u, const char *name)
+{
+    void *p = dlsym(u->lib, name);
+    if ( p == NULL ) {
+        fprintf(stderr, "%s: %s\n", u->path, dlerror());
+        exit(1);
+    }
+    return p;
+}
+
+
+/* The unit prints the record, so send our stdout to the file meanwhile.
+ * record_poll() prints 256 bytes of the 16 kB ring at a time, and does
+ * nothing once it's finished. */
+static int dump_record(struct unit *u, const char *filename)
+{
+    void (*dump)(void) = sym(u, "record_dump");
+    void (*poll)(void) = sym(u, "record_poll");
+    int fd, saved, i;
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 ) {
+        perror(filename);
+        return 1;
+    }
+    fflush(stdout);
+    saved = dup(1);
+    dup2(fd, 1);
+    close(fd);
+    dump();
+    for ( i=0; i<128; i++ ) poll();
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    return 0;
+}
+
+
+static void power_on(struct unit *u)
+{
+    void (**send)(uint16_t, uint32_t, uint16_t, const uint8_t *, size_t);
+    void (**join)(const uint8_t *, uint32_t);
+    int (**dns)(const char *, uint32_t *);
+    void (*freeze)(void);
+    struct host_ds3231 *ds;
+
+    u->lib = dlopen(u->path, RTLD_NOW | RTLD_LOCAL);
+    if ( u->lib == NULL ) {
+        fprintf(stderr, "%s\n", dlerror());
+        exit(1);
+    }
+
+    u->init = sym(u, "morningtown_init");
+    u->poll = sym(u, "morningtown_poll");
+    u->now = sym(u, "time_us_64");
+    u->advance = sym(u, "host_advance_us");
+    u->next_alarm = sym(u, "host_next_alarm");
+    u->udp_deliver = sym(u, "host_udp_deliver");
+    u->dns_answer = sym(u, "host_dns_answer");
+    u->wifi_link = sym(u, "host_wifi_link");
+    u->dhcp_lease = sym(u, "host_dhcp_lease");
+    u->clock_utc_us = sym(u, "clock_utc_us");
+    u->clock_source = sym(u, "clock_source");
+    u->uah_per_day = sym(u, "energy_uah_per_day");
+    u->residency_us = sym(u, "energy_residency_us");
+    u->counters = sym(u, "counters");
+    u->flash = sym(u, "host_flash");
+
+    send = sym(u, "host_udp_send_hook");
+    join = sym(u, "host_wifi_join_hook");
+    dns = sym(u, "host_dns_hook");
+    *send = netsim_send_hook;
+    *join = join_hook;
+    *dns = netsim_dns_hook;
+
+    /* Pico Ws on their own, without a DS3231 */
+    ds = sym(u, "host_ds3231");
+    ds->present = 0;
+    ds->sqw_gpio = -1;
+
+    freeze = sym(u, "host_freeze_time");
+    freeze();
+
+    /* Only the flash survives */
+    if ( u->saved_flash != NULL ) {
+        memcpy(u->flash, u->saved_flash, MT_UNIT_FLASH_SIZE);
+    }
+
+    u->powered = 1;
+    u->next_poll = 0;
+    current = u;
+    u->init();
+}
+
+
+static void handle_event(struct unit *u, const struct event *e)
+{
+    int g = u->generation;
+
+    switch ( e->type ) {
+
+        case EV_LINK :
+        u->wifi_link(1, ap_bssid, WIFI_CHANNEL);
+        if ( u->t_link[g] == 0 ) u->t_link[g] = e->t - u->boot;
+        break;
+
+        case EV_LEASE :
+        u->dhcp_lease(htonl(ntohl(gateway_addr) + 1 + u->id), netmask,
+                      gateway_addr, LEASE_S, &server_addr, dhcp_ntp);
+        if ( u->t_lease[g] == 0 ) u->t_lease[g] = e->t - u->boot;
+        break;
+
+        case EV_DNS :
+        if ( e->ok ) u->dns_until = e->t + DNS_TTL_US;
+        u->dns_answer(SERVER_NAME, e->ok ? &server_addr : NULL);
+        break;
+
+        case EV_NTP :
+        u->udp_deliver(server_addr, NTP_PORT, e->port, e->data, NTP_MSG_LEN);
+        break;
+
+    }
+
+    if ( (u->t_sync[g] == 0) && (u->counters->ntp_syncs > 0) ) {
+        u->t_sync[g] = e->t - u->boot;
+    }
+}
+
+
+/* Runs the unit's main loop, alarms and incoming packets in order, up to
+ * (but not including) global time 'end' */
+static void run_unit(struct unit *u, uint64_t end)
+{
+    uint64_t local_end;
+
+    if ( u->next_action >= end ) return;
+    if ( !u->powered ) power_on(u);
+
+    current = u;
+    local_end = to_local(u, end);
+    while ( 1 ) {
+
+        uint64_t now = u->now();
+        uint64_t t = u->next_poll;
+        uint64_t a;
+        int what = 0;
+
+        if ( (u->n_inbox > 0) && (to_local(u, u->inbox[0].t) <= t) ) {
+            t = to_local(u, u->inbox[0].t);
+            what = 1;
+        }
+        if ( u->next_alarm(&a) && (a < t) ) {
+            t = a;
+            what = 2;
+        }
+        if ( t >= local_end ) {
+            u->next_action = to_global(u, t);
+            break;
+        }
+
+        /* Alarms which are due go off on the way */
+        u->advance((t > now) ? t - now : 0);
+
+        if ( what == 0 ) {
+            u->next_poll = u->now() + u->poll()*1000ULL;
+        } else if ( what == 1 ) {
+            struct event e = u->inbox[0];
+            u->n_inbox--;
+            memmove(u->inbox, u->inbox+1, u->n_inbox*sizeof(struct event));
+            handle_event(u, &e);
+
+            /* The main loop wakes up when the network has something */
+            u->next_poll = u->now();
+        }
+
+    }
+}
+
+
+static void run_step(struct worker *w)
+{
+    int i;
+
+    current_worker = w;
+    w->next_action = UINT64_MAX;
+    for ( i=w->idx; i<n_units; i+=n_workers ) {
+        run_unit(&units[i], step_end);
+        if ( units[i].next_action < w->next_action ) {
+            w->next_action = units[i].next_action;
+        }
+    }
+}
+
+
+/* The main thread is worker zero, and deals with the servers */
+static void *worker_main(void *arg)
+{
+    while ( 1 ) {
+        pthread_barrier_wait(&step_start);
+        if ( finished ) break;
+        run_step(arg);
+        pthread_barrier_wait(&step_done);
+    }
+    return NULL;
+}
+
+
+/* ---------------------------- The network's side ---------------------------- */
+
+static int heap_before(const struct request *a, const struct request *b)
+{
+    if ( a->t != b->t ) return a->t < b->t;
+    return a->unit < b->unit;
+}
+
+
+static void heap_swap(int i, int j)
+{
+    struct request tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+}
+
+
+static void heap_push(const struct request *r)
+{
+    int i;
+
+    if ( n_heap == max_heap ) {
+        max_heap = max_heap ? 2*max_heap : 1024;
+        heap = realloc(heap, max_heap*sizeof(struct request));
+        if ( heap == NULL ) abort();
+    }
+
+    i = n_heap++;
+    heap[i] = *r;
+    while ( (i > 0) && heap_before(&heap[i], &heap[(i-1)/2]) ) {
+        heap_swap(i, (i-1)/2);
+        i = (i-1)/2;
+    }
+}
+
+
+static void heap_pop(struct request *r)
+{
+    int i = 0;
+
+    *r = heap[0];
+    heap[0] = heap[--n_heap];
+    while ( 1 ) {
+        int l = 2*i+1;
+        int m = i;
+        if ( (l < n_heap) && heap_before(&heap[l], &heap[m]) ) m = l;
+        if ( (l+1 < n_heap) && heap_before(&heap[l+1], &heap[m]) ) m = l+1;
+        if ( m == i ) break;
+        heap_swap(i, m);
+        i = m;
+    }
+}
+
+
+static void deliver(struct unit *u, const struct event *e)
+{
+    int i;
+
+    if ( u->n_inbox == u->max_inbox ) {
+        u->max_inbox = u->max_inbox ? 2*u->max_inbox : 8;
+        u->inbox = realloc(u->inbox, u->max_inbox*sizeof(struct event));
+        if ( u->inbox == NULL ) abort();
+    }
+
+    i = u->n_inbox++;
+    while ( (i > 0) && (u->inbox[i-1].t > e->t) ) {
+        u->inbox[i] = u->inbox[i-1];
+        i--;
+    }
+    u->inbox[i] = *e;
+    if ( e->t < u->next_action ) u->next_action = e->t;
+    if ( e->t < first_delivery ) first_delivery = e->t;
+}
+
+
+/* Returns zero if the request is dropped, otherwise puts the time when the
+ * server has finished with it in 'done' */
+static int take(struct server *s, uint64_t t, int cost, uint64_t *done)
+{
+    uint64_t start = (s->busy_until > t) ? s->busy_until : t;
+
+    if ( (t >= net_down) && (t < net_up) ) {
+        s->dropped++;
+        return 0;
+    }
+    if ( start - t > s->max_queue*1e6/s->rate ) {
+        s->dropped++;
+        return 0;
+    }
+
+    if ( start - t > s->wait_max ) s->wait_max = start - t;
+    s->busy_until = start + cost*1e6/s->rate;
+    *done = s->busy_until;
+    return 1;
+}
+
+
+static void ntp_reply(const struct request *r, uint64_t done,
+                      struct event *e)
+{
+    netsim_ntp_reply(e->data, r->data, to_utc(r->t), to_utc(done));
+    e->port = r->port;
+}
+
+
+static void serve(const struct request *r)
+{
+    struct unit *u = &units[r->unit];
+    struct server *s = &servers[r->service];
+    uint64_t done;
+    struct event e;
+    int ok;
+
+    /* Nothing but joining works without being associated */
+    if ( (r->service != S_ASSOC) && !u->associated ) {
+        if ( r->service == S_DNS ) {
+            e.t = r->t + DNS_TIMEOUT_US;
+            e.type = EV_DNS;
+            e.ok = 0;
+            if ( r->generation == u->generation ) deliver(u, &e);
+        }
+        return;
+    }
+
+    s->requests++;
+    if ( r->t/1000000 < duration/1000000 + 1 ) s->per_second[r->t/1000000]++;
+
+    /* A lease takes DISCOVER and REQUEST, renewing just the REQUEST */
+    ok = take(s, r->t, (r->service == S_DHCP)
+                         && (r->type == HOST_DHCP_DISCOVER) ? 2 : 1, &done);
+
+    /* Replies to a unit which has been restarted since go nowhere */
+    if ( r->generation != u->generation ) return;
+    e.t = done + one_way_us(u);
+    e.ok = ok;
+
+    switch ( r->service ) {
+
+        case S_ASSOC :
+        if ( !ok || (r->type != u->join) ) return;
+        u->associated = 1;
+        e.type = EV_LINK;
+        break;
+
+        case S_DHCP :
+        if ( !ok ) return;
+        if ( r->type == HOST_DHCP_DISCOVER ) e.t += one_way_us(u)*2;
+        e.type = EV_LEASE;
+        break;
+
+        case S_DNS :
+        if ( !ok ) e.t = r->t + DNS_TIMEOUT_US;
+        e.type = EV_DNS;
+        break;
+
+        case S_NTP :
+        if ( !ok ) return;
+        ntp_reply(r, done, &e);
+        e.type = EV_NTP;
+        break;
+
+        default :
+        return;
+
+    }
+    deliver(u, &e);
+}
+
+
+static uint32_t boot_spread(struct unit *u)
+{
+    return spread_us ? rand_r(&u->seed) % spread_us : 0;
+}
+
+
+/* Everything loses power, and comes back 'cut_off' later, except that
+ * the network takes another 'ap_boot' to start up */
+static void power_cut(uint64_t t)
+{
+    int i, j;
+
+    for ( i=0; i<n_units; i++ ) {
+
+        struct unit *u = &units[i];
+
+        if ( u->powered ) {
+            if ( u->saved_flash == NULL ) {
+                u->saved_flash = malloc(MT_UNIT_FLASH_SIZE);
+                if ( u->saved_flash == NULL ) abort();
+            }
+            memcpy(u->saved_flash, u->flash, MT_UNIT_FLASH_SIZE);
+            dlclose(u->lib);
+            u->powered = 0;
+        }
+
+        u->generation++;
+        u->boot = t + cut_off + boot_spread(u);
+        u->next_action = u->boot;
+        u->n_inbox = 0;
+        u->associated = 0;
+        u->dns_until = 0;
+
+    }
+
+    for ( j=0; j<NUM_SERVICES; j++ ) servers[j].busy_until = 0;
+    net_down = t;
+    net_up = t + cut_off + ap_boot;
+    n_generations = 2;
+}
+
+
+/* ---------------------------- Results ---------------------------- */
+
+static int cmp_double(const void *av, const void *bv)
+{
+    double a = *(const double *)av;
+    double b = *(const double *)bv;
+    return (a > b) - (a < b);
+}
+
+
+/* 'v' has 'n' values, sorted */
+static double percentile(const double *v, int n, double p)
+{
+    int i = ceil(p*n/100.0) - 1;
+    if ( i < 0 ) i = 0;
+    return v[i];
+}
+
+
+static void show_distribution(const char *name, const double *v, int n,
+                              int never, int decimals, const char *units_name)
+{
+    if ( n == 0 ) {
+        printf("  %-24s %10s %10s %10s %10s %7i\n", name,
+               "-", "-", "-", "-", never);
+        return;
+    }
+    printf("  %-24s %10.*f %10.*f %10.*f %10.*f %7i  %s\n", name,
+           decimals, percentile(v, n, 50), decimals, percentile(v, n, 90),
+           decimals, percentile(v, n, 99), decimals, v[n-1], never,
+           units_name);
+}
+
+
+/* Seconds from power-up, for generation 'g' */
+static void show_times(const char *name, size_t offset, int g, double *v)
+{
+    int i;
+    int n = 0;
+
+    for ( i=0; i<n_units; i++ ) {
+        const uint64_t *t = (const uint64_t *)((const char *)&units[i] + offset);
+        if ( t[g] != 0 ) v[n++] = t[g]/1e6;
+    }
+    qsort(v, n, sizeof(double), cmp_double);
+    show_distribution(name, v, n, n_units - n, 2, "s");
+}
+
+
+static void show_results(double wall)
+{
+    double *v = malloc(n_units*sizeof(double));
+    double mah_sum = 0.0;
+    double joining_sum = 0.0;
+    double wifi_sum = 0.0;
+    uint32_t uah_min = UINT32_MAX;
+    uint32_t uah_max = 0;
+    int n_powered = 0;
+    int n = 0;
+    int i, g;
+
+    if ( v == NULL ) abort();
+
+    printf("%i units for %.0f s, in %.1f s with %i threads\n",
+           n_units, duration/1e6, wall, n_workers);
+    if ( cut_at < duration ) {
+        printf("Power cut at %.0f s for %.0f s, network back %.0f s "
+               "after that\n", cut_at/1e6, cut_off/1e6, ap_boot/1e6);
+    }
+
+    printf("\n%-20s %10s %10s %10s %12s\n", "Requests", "per s",
+           "busiest s", "dropped", "worst wait");
+    for ( i=0; i<NUM_SERVICES; i++ ) {
+        struct server *s = &servers[i];
+        uint32_t peak = 0;
+        uint64_t sec;
+        for ( sec=0; sec<=duration/1000000; sec++ ) {
+            if ( s->per_second[sec] > peak ) peak = s->per_second[sec];
+        }
+        printf("%-20s %10.2f %10u %10llu %9.1f ms\n", s->name,
+               s->requests/(duration/1e6), peak,
+               (unsigned long long)s->dropped, s->wait_max/1e3);
+    }
+
+    for ( g=0; g<n_generations; g++ ) {
+        printf("\n%-26s %10s %10s %10s %10s %7s\n",
+               (g == 0) ? "After the first power-up" : "After the power cut",
+               "median", "90%", "99%", "worst", "never");
+        show_times("Wi-Fi joined", offsetof(struct unit, t_link), g, v);
+        show_times("Address from DHCP", offsetof(struct unit, t_lease), g, v);
+        show_times("First NTP sync", offsetof(struct unit, t_sync), g, v);
+    }
+
+    for ( i=0; i<n_units; i++ ) {
+
+        struct unit *u = &units[i];
+        uint64_t local;
+        uint32_t uah;
+
+        if ( !u->powered ) continue;
+        n_powered++;
+        local = u->now();
+
+        if ( u->clock_source() != CLOCK_SRC_NONE ) {
+            int64_t err = u->clock_utc_us(local) - to_utc(global_now(u));
+            v[n++] = llabs(err);
+        }
+
+        uah = u->uah_per_day();
+        mah_sum += uah/1000.0;
+        if ( uah < uah_min ) uah_min = uah;
+        if ( uah > uah_max ) uah_max = uah;
+        joining_sum += (double)u->residency_us(ENERGY_JOINING) / local;
+        wifi_sum += (double)u->residency_us(ENERGY_WIFI) / local;
+
+    }
+
+    printf("\n%-26s %10s %10s %10s %10s %7s\n", "At the end",
+           "median", "90%", "99%", "worst", "no time");
+    qsort(v, n, sizeof(double), cmp_double);
+    show_distribution("Clock error", v, n, n_units - n, 0, "us");
+
+    if ( n_powered > 0 ) {
+        printf("\n%-26s %10.1f mAh per day  (%.1f to %.1f, joining %.1f%%, "
+               "associated %.1f%%)\n", "Charge since power-up",
+               mah_sum/n_powered, uah_min/1000.0, uah_max/1000.0,
+               100.0*joining_sum/n_powered, 100.0*wifi_sum/n_powered);
+    }
+
+    free(v);
+}
+
+
+/* ---------------------------- Setting up ---------------------------- */
+
+static int copy_file(const char *from, const char *to)
+{
+    char buf[65536];
+    ssize_t r;
+    int in, out;
+
+    in = open(from, O_RDONLY);
+    if ( in < 0 ) return 1;
+    out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0700);
+    if ( out < 0 ) {
+        close(in);
+        return 1;
+    }
+
+    while ( (r = read(in, buf, sizeof(buf))) > 0 ) {
+        if ( write(out, buf, r) != r ) {
+            r = -1;
+            break;
+        }
+    }
+
+    close(in);
+    close(out);
+    return r < 0;
+}
+
+
+static int quiet_fd = -1;
+
+
+/* Hundreds of units printing at once is no use to anyone */
+static void quiet(int on)
+{
+    if ( on ) {
+        int null = open("/dev/null", O_WRONLY);
+        fflush(stdout);
+        quiet_fd = dup(1);
+        dup2(null, 1);
+        close(null);
+    } else {
+        fflush(stdout);
+        dup2(quiet_fd, 1);
+        close(quiet_fd);
+    }
+}
+
+
+static double wall_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+static void show_help(const char *s)
+{
+    printf("Syntax: %s [options]\n\n", s);
+    printf("Runs many units against a simulated network and time server.\n"
+           "\n"
+           "  -n <units>      Number of units (default 200)\n"
+           "  -t <seconds>    Simulated time (default 3600)\n"
+           "  -j <threads>    Worker threads (default: one per CPU)\n"
+           "  -c <seconds>    Power cut at this time (default 1800,\n"
+           "                   0 for none)\n"
+           "  -o <seconds>    Power off for this long (default 30)\n"
+           "  -a <seconds>    Network starts this long after the power\n"
+           "                   comes back (default 45)\n"
+           "  -b <ms>         Units start within this long of each other\n"
+           "                   (default 500)\n"
+           "  -r <req/s>      NTP server capacity (default 200)\n"
+           "  -q <requests>   NTP server queue length (default 64)\n"
+           "  -l <ms>         One-way network delay (default 5)\n"
+           "  -k <ppm>        Crystal errors up to this (default 30)\n"
+           "  -D              DHCP doesn't offer an NTP server, so units\n"
+           "                   look up pool.ntp.org instead\n"
+           "  -s <seed>       Random seed (default 1)\n"
+           "  -d <file>       Save the first unit's input record to this\n"
+           "                   file at the end, for mtreplay\n"
+           "  -h              Show this help\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/mtfleet.XXXXXX";
+    unsigned int seed = 1;
+    const char *dump_file = NULL;
+    uint64_t t;
+    double wall;
+    int c, i;
+
+    while ( (c = getopt(argc, argv, "n:t:j:c:o:a:b:r:q:l:k:Ds:d:h")) != -1 ) {
+        switch ( c ) {
+            case 'n' : n_units = atoi(optarg); break;
+            case 't' : duration = atof(optarg)*1e6; break;
+            case 'j' : n_workers = atoi(optarg); break;
+            case 'c' : cut_at = atof(optarg)*1e6; break;
+            case 'o' : cut_off = atof(optarg)*1e6; break;
+            case 'a' : ap_boot = atof(optarg)*1e6; break;
+            case 'b' : spread_us = atof(optarg)*1e3; break;
+            case 'r' : servers[S_NTP].rate = atof(optarg); break;
+            case 'q' : servers[S_NTP].max_queue = atoi(optarg); break;
+            case 'l' : latency_us = atof(optarg)*1e3; break;
+            case 'k' : max_ppm = atof(optarg); break;
+            case 'D' : dhcp_ntp = 0; break;
+            case 's' : seed = strtoul(optarg, NULL, 10); break;
+            case 'd' : dump_file = optarg; break;
+            case 'h' : show_help(argv[0]); return 0;
+            default : return 1;
+        }
+    }
+    if ( (n_units < 1) || (duration == 0) || (latency_us == 0)
+      || (servers[S_NTP].rate <= 0.0) )
+    {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+    if ( cut_at == 0 ) cut_at = UINT64_MAX;
+    if ( n_workers < 1 ) n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( n_workers > n_units ) n_workers = n_units;
+
+    server_addr = inet_addr(SERVER_ADDR);
+    gateway_addr = inet_addr(GATEWAY_ADDR);
+    netmask = inet_addr(NETMASK);
+    netsim.server_addr = server_addr;
+    netsim.ntp = ntp_hook;
+    netsim.dhcp = dhcp_hook;
+    netsim.dns_cached = dns_cached_hook;
+    netsim.dns = dns_hook;
+
+    for ( i=0; i<NUM_SERVICES; i++ ) {
+        servers[i].per_second = calloc(duration/1000000 + 1,
+                                       sizeof(uint32_t));
+        if ( servers[i].per_second == NULL ) return 1;
+    }
+
+    /* A separate file for each unit, or dlopen() would give us the same
+     * copy every time */
+    if ( mkdtemp(dir) == NULL ) {
+        perror("mkdtemp");
+        return 1;
+    }
+    units = calloc(n_units, sizeof(struct unit));
+    if ( units == NULL ) return 1;
+    srand(seed);
+    for ( i=0; i<n_units; i++ ) {
+        struct unit *u = &units[i];
+        u->id = i;
+        u->seed = rand();
+        u->ppm = max_ppm * (2.0*rand_r(&u->seed)/RAND_MAX - 1.0);
+        u->boot = boot_spread(u);
+        u->next_action = u->boot;
+        snprintf(u->path, sizeof(u->path), "%s/unit%i.so", dir, i);
+        if ( copy_file(MT_UNIT_PATH, u->path) ) {
+            fprintf(stderr, "Couldn't copy %s to %s\n", MT_UNIT_PATH, u->path);
+            return 1;
+        }
+    }
+
+    workers = calloc(n_workers, sizeof(struct worker));
+    if ( workers == NULL ) return 1;
+    pthread_barrier_init(&step_start, NULL, n_workers);
+    pthread_barrier_init(&step_done, NULL, n_workers);
+    for ( i=0; i<n_workers; i++ ) workers[i].idx = i;
+    for ( i=1; i<n_workers; i++ ) {
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+
+    quiet(1);
+    wall = wall_time();
+    t = 0;
+    while ( t < duration ) {
+
+        struct request r;
+        uint64_t next = UINT64_MAX;
+
+        if ( (t >= cut_at) && (n_generations == 1) ) power_cut(t);
+
+        step_end = t + latency_us;
+        pthread_barrier_wait(&step_start);
+        run_step(&workers[0]);
+        pthread_barrier_wait(&step_done);
+
+        for ( i=0; i<n_workers; i++ ) {
+            int j;
+            for ( j=0; j<workers[i].n_out; j++ ) heap_push(&workers[i].out[j]);
+            workers[i].n_out = 0;
+        }
+
+        /* Anything sent from now on arrives after step_end+latency_us */
+        first_delivery = UINT64_MAX;
+        while ( (n_heap > 0) && (heap[0].t < step_end + latency_us) ) {
+            heap_pop(&r);
+            serve(&r);
+        }
+
+        /* Skip the steps in which nothing happens */
+        for ( i=0; i<n_workers; i++ ) {
+            if ( workers[i].next_action < next ) next = workers[i].next_action;
+        }
+        if ( first_delivery < next ) next = first_delivery;
+        if ( (n_heap > 0) && (heap[0].t - latency_us < next) ) {
+            next = heap[0].t - latency_us;
+        }
+        if ( (n_generations == 1) && (cut_at < next) ) next = cut_at;
+        t = (next > step_end) ? next : step_end;
+
+    }
+    finished = 1;
+    pthread_barrier_wait(&step_start);
+    for ( i=1; i<n_workers; i++ ) pthread_join(workers[i].thread, NULL);
+    wall = wall_time() - wall;
+    quiet(0);
+
+    show_results(wall);
+    fflush(stdout);
+    if ( (dump_file != NULL) && dump_record(&units[0], dump_file) ) return 1;
+
+    for ( i=0; i<n_units; i++ ) unlink(units[i].path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * host.h
+ *
+ * Controls for the simulated hardware of the host build
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Flash contents, erased (0xff) at startup */
+extern uint8_t host_flash[];
+
+/* Queue characters for the terminal to read */
+extern void host_input(const char *str, size_t len);
+extern size_t host_input_pending(void);
+
+/* Send the firmware's output to /dev/null (on=1) or back again */
+extern void host_quiet(int on);
+
+/* Simulated time: time_us_64() runs from zero, and can be moved on.
+ * Alarms which are due go off when it is. */
+extern void host_advance_us(uint64_t us);
+extern void host_freeze_time(void);
+extern int host_next_alarm(uint64_t *t);
+
+/* Signal GPIO events (GPIO_IRQ_xxx), calling the raw handler if the
+ * events are enabled */
+extern void host_gpio_event(uint gpio, uint32_t events);
+
+/* The DS3231 (see ds3231_model.c).  Its oscillator runs 'ppm' fast
+ * compared with time_us_64(), plus 'tempco' times the square of the
+ * distance from 25 degC, less 0.1 ppm per step of the aging offset, and
+ * it changes speed after each temperature conversion like the real one. */
+struct host_ds3231
+{
+    int present;            /* Zero to make it not answer at all */
+    int sqw_gpio;           /* Where INT/SQW is connected, or -1 */
+    double ppm;
+    double tempco;
+    double temp_c;
+    double p_nak;           /* Chance of each transaction being NAKed */
+    double p_stall;         /* ... or of SDA getting stuck low */
+
+    /* Registers 0x00-0x12, as of the last host_ds3231_update() */
+    uint8_t regs[19];
+
+    /* time_us_64() when writing the seconds restarted the countdown */
+    uint64_t set_us;
+
+    /* How fast it's running now, as of the last conversion */
+    double speed_ppm;
+
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes;
+    uint32_t naks;
+    uint32_t timeouts;
+    uint32_t bus_clears;
+    uint32_t conversions;
+};
+
+extern struct host_ds3231 host_ds3231;
+
+/* Brings the registers up to date */
+extern void host_ds3231_update(void);
+
+/* For sdk.c: the bus clear in ds3231.c bit-bangs the I2C pins */
+extern void host_i2c_pin_released(uint gpio);
+extern int host_i2c_pin_level(uint gpio, int *level);
+
+/* Make I2C transactions fail: HOST_I2C_TIMEOUT uses up the whole timeout
+ * (in simulated time) before giving up */
+#define HOST_I2C_OK 0
+#define HOST_I2C_NAK 1
+#define HOST_I2C_TIMEOUT 2
+extern int host_i2c_fault;
+
+/* If set, called for each I2C read with the register pointer.  Returns
+ * non-zero if it has dealt with the read, with the return value for
+ * i2c_read_timeout_us() in 'result' */
+extern int (*host_i2c_read_hook)(int reg, uint8_t *dst, size_t len,
+                                 int *result);
+
+/* The network, for ntp_client.c (see net.c).  Packets sent with
+ * udp_sendto() go to host_udp_send_hook, and host_udp_deliver() gives one
+ * to whichever pcb has 'dst_port'.  Addresses are in network order. */
+extern void (*host_udp_send_hook)(uint16_t src_port, uint32_t addr,
+                                  uint16_t port, const uint8_t *data,
+                                  size_t len);
+extern int host_udp_deliver(uint32_t addr, uint16_t port, uint16_t dst_port,
+                            const uint8_t *data, size_t len);
+
+/* Wi-Fi and DHCP for wifi.c (see cyw43.c, only in the fleet simulator).
+ * Joining calls host_wifi_join_hook, with 'bssid' NULL if it has to scan
+ * first.  The access point calls host_wifi_link() when the link comes up
+ * or goes down.  The DHCP client sends a one-byte packet (HOST_DHCP_xxx)
+ * to port 67 for each request, and host_dhcp_lease() is the answer. */
+#define HOST_DHCP_DISCOVER 1
+#define HOST_DHCP_REQUEST 3
+extern void (*host_wifi_join_hook)(const uint8_t *bssid, uint32_t channel);
+extern void host_wifi_link(int up, const uint8_t *bssid, uint32_t channel);
+extern void host_dhcp_lease(uint32_t addr, uint32_t netmask, uint32_t gw,
+                            uint32_t lease_s, const uint32_t *ntp, int n_ntp);
+
+/* dns_gethostbyname() asks host_dns_hook first, which returns non-zero
+ * (with the address) if the answer is cached.  Otherwise the lookup waits
+ * for host_dns_answer(), with NULL meaning that there's no such name. */
+extern int (*host_dns_hook)(const char *name, uint32_t *addr);
+extern void host_dns_answer(const char *name, const uint32_t *addr);
@@ -0,0 +1,266 @@
+/*
+ * net.c
+ *
+ * Host implementation of the lwIP functions used by the firmware
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Just enough of lwIP's raw API for ntp_client.c and ntp_server.c.  There
+ * is no real network: whatever is on the other end (see ntpsim.c) gets
+ * the packets through the hooks in host.h, and answers them by calling
+ * host_udp_deliver() and host_dns_answer(). */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+#include <pico/cyw43_arch.h>
+
+#include "lwip/dns.h"
+#include "lwip/igmp.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "host.h"
+
+cyw43_t cyw43_state;
+const ip_addr_t ip_addr_any = {0};
+
+void (*host_udp_send_hook)(uint16_t src_port, uint32_t addr, uint16_t port,
+                           const uint8_t *data, size_t len);
+int (*host_dns_hook)(const char *name, uint32_t *addr);
+
+
+/* ---------------------------- Addresses ---------------------------- */
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr)
+{
+    unsigned int a, b, c, d;
+    uint8_t *bytes = (uint8_t *)&addr->addr;
+
+    if ( sscanf(cp, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 ) return 0;
+    if ( (a > 255) || (b > 255) || (c > 255) || (d > 255) ) return 0;
+    bytes[0] = a;
+    bytes[1] = b;
+    bytes[2] = c;
+    bytes[3] = d;
+    return 1;
+}
+
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+    static char str[16];
+    const uint8_t *bytes = (const uint8_t *)&addr->addr;
+    snprintf(str, sizeof(str), "%u.%u.%u.%u",
+             bytes[0], bytes[1], bytes[2], bytes[3]);
+    return str;
+}
+
+
+/* ---------------------------- Packet buffers ---------------------------- */
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+    struct pbuf *p = malloc(sizeof(struct pbuf) + length);
+    if ( p == NULL ) return NULL;
+    p->next = NULL;
+    p->payload = p+1;
+    p->tot_len = length;
+    p->len = length;
+    return p;
+}
+
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    free(p);
+    return 1;
+}
+
+
+u8_t pbuf_get_at(const struct pbuf *p, u16_t offset)
+{
+    if ( offset >= p->len ) return 0;
+    return ((const uint8_t *)p->payload)[offset];
+}
+
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len,
+                        u16_t offset)
+{
+    if ( offset >= p->len ) return 0;
+    if ( len > p->len - offset ) len = p->len - offset;
+    memcpy(dataptr, (const uint8_t *)p->payload + offset, len);
+    return len;
+}
+
+
+/* ---------------------------- UDP ---------------------------- */
+
+#define MAX_PCBS 4
+
+static struct udp_pcb *pcbs[MAX_PCBS];
+static u16_t next_port = 49152;
+
+
+struct udp_pcb *udp_new()
+{
+    int i;
+
+    for ( i=0; i<MAX_PCBS; i++ ) {
+        if ( pcbs[i] != NULL ) continue;
+        pcbs[i] = calloc(1, sizeof(struct udp_pcb));
+        return pcbs[i];
+    }
+    return NULL;
+}
+
+
+struct udp_pcb *udp_new_ip_type(u8_t type)
+{
+    return udp_new();
+}
+
+
+void udp_remove(struct udp_pcb *pcb)
+{
+    int i;
+
+    for ( i=0; i<MAX_PCBS; i++ ) {
+        if ( pcbs[i] == pcb ) pcbs[i] = NULL;
+    }
+    free(pcb);
+}
+
+
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+    pcb->local_port = port;
+    return ERR_OK;
+}
+
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg)
+{
+    pcb->recv = recv;
+    pcb->recv_arg = recv_arg;
+}
+
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p,
+                 const ip_addr_t *dst_ip, u16_t dst_port)
+{
+    if ( pcb->local_port == 0 ) pcb->local_port = next_port++;
+    if ( host_udp_send_hook != NULL ) {
+        host_udp_send_hook(pcb->local_port, dst_ip->addr, dst_port,
+                           p->payload, p->len);
+    }
+    return ERR_OK;
+}
+
+
+/* Returns zero if nothing is listening on 'port' */
+int host_udp_deliver(uint32_t addr, uint16_t port, uint16_t dst_port,
+                     const uint8_t *data, size_t len)
+{
+    int i;
+
+    for ( i=0; i<MAX_PCBS; i++ ) {
+
+        struct udp_pcb *pcb = pcbs[i];
+        struct pbuf *p;
+        ip_addr_t src;
+
+        if ( (pcb == NULL) || (pcb->local_port != dst_port) ) continue;
+        if ( pcb->recv == NULL ) return 0;
+
+        /* The callback frees it */
+        p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+        memcpy(p->payload, data, len);
+        src.addr = addr;
+        pcb->recv(pcb->recv_arg, pcb, p, &src, port);
+        return 1;
+
+    }
+    return 0;
+}
+
+
+/* ---------------------------- DNS ---------------------------- */
+
+#define MAX_LOOKUPS 4
+
+struct lookup
+{
+    char name[64];
+    dns_found_callback found;
+    void *arg;
+};
+
+static struct lookup lookups[MAX_LOOKUPS];
+
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr,
+                        dns_found_callback found, void *callback_arg)
+{
+    int i;
+
+    if ( strlen(hostname) >= sizeof(lookups[0].name) ) return ERR_ARG;
+    if ( (host_dns_hook != NULL) && host_dns_hook(hostname, &addr->addr) ) {
+        return ERR_OK;
+    }
+
+    for ( i=0; i<MAX_LOOKUPS; i++ ) {
+        if ( lookups[i].found != NULL ) continue;
+        strcpy(lookups[i].name, hostname);
+        lookups[i].found = found;
+        lookups[i].arg = callback_arg;
+        return ERR_INPROGRESS;
+    }
+    return ERR_MEM;
+}
+
+
+/* Finishes all the lookups waiting for 'name', NULL meaning failure */
+void host_dns_answer(const char *name, const uint32_t *addr)
+{
+    int i;
+
+    for ( i=0; i<MAX_LOOKUPS; i++ ) {
+
+        struct lookup l = lookups[i];
+        ip_addr_t a;
+
+        if ( (l.found == NULL) || (strcmp(l.name, name) != 0) ) continue;
+        lookups[i].found = NULL;
+        if ( addr != NULL ) a.addr = *addr;
+        l.found(name, (addr != NULL) ? &a : NULL, l.arg);
+
+    }
+}
+
+
+/* ---------------------------- Multicast ---------------------------- */
+
+err_t igmp_joingroup_netif(struct netif *netif, const ip4_addr_t *groupaddr)
+{
+    return ERR_OK;
+}
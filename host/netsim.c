@@ -0,0 +1,99 @@
+/*
+ * netsim.c
+ *
+ * The far end of the simulated network, shared by mtntp and mtfleet
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Only plain C here, no firmware code: mtfleet loads the firmware
+ * separately for each unit (see fleet.c), and calls these from inside
+ * whichever unit is running. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ntp_client.h"
+#include "netsim.h"
+
+#define DHCP_PORT 67
+
+struct netsim netsim;
+
+
+static void put_u32(uint8_t *buf, uint32_t v)
+{
+    buf[0] = v >> 24;
+    buf[1] = v >> 16;
+    buf[2] = v >> 8;
+    buf[3] = v;
+}
+
+
+static void put_timestamp(uint8_t *buf, uint64_t utc_us)
+{
+    put_u32(buf, utc_us/1000000 + NTP_DELTA);
+    put_u32(buf+4, ((utc_us % 1000000) << 32) / 1000000);
+}
+
+
+void netsim_send_hook(uint16_t src_port, uint32_t addr, uint16_t port,
+                      const uint8_t *data, size_t len)
+{
+    if ( (port == DHCP_PORT) && (len == 1) ) {
+        if ( netsim.dhcp != NULL ) netsim.dhcp(src_port, data[0]);
+    } else if ( (port == NTP_PORT) && (addr == netsim.server_addr)
+             && (len == NTP_MSG_LEN) && ((data[0] & 0x7) == NTP_MODE_CLIENT) )
+    {
+        netsim.ntp(src_port, data);
+    }
+}
+
+
+/* As lwIP's DNS client, including its cache */
+int netsim_dns_hook(const char *name, uint32_t *addr)
+{
+    if ( netsim.dns_cached(name) ) {
+        *addr = netsim.server_addr;
+        return 1;
+    }
+    netsim.dns(name);
+    return 0;
+}
+
+
+/* A stratum 2 server's reply to 'req', which it received at 'arrive' and
+ * answers at 'depart' (UTC microseconds).  'rep' is NTP_MSG_LEN bytes. */
+void netsim_ntp_reply(uint8_t *rep, const uint8_t *req,
+                      uint64_t arrive_utc_us, uint64_t depart_utc_us)
+{
+    memset(rep, 0, NTP_MSG_LEN);
+    rep[0] = 4<<3 | NTP_MODE_SERVER;
+    rep[1] = 2;
+    rep[2] = req[2];
+    rep[3] = -20;
+    put_u32(rep+4, 1000*65536/1000000);      /* Root delay 1 ms */
+    put_u32(rep+8, 2000*65536/1000000);      /* Root dispersion 2 ms */
+    memcpy(rep+12, "GPS", 4);
+    put_timestamp(rep+16, depart_utc_us - 16000000);
+    memcpy(rep+24, req+40, 8);
+    put_timestamp(rep+32, arrive_utc_us);
+    put_timestamp(rep+40, depart_utc_us);
+}
@@ -0,0 +1,53 @@
+/*
+ * netsim.h
+ *
+ * The far end of the simulated network, shared by mtntp and mtfleet
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The program fills in 'netsim', and points the firmware's
+ * host_udp_send_hook and host_dns_hook (see host.h) at netsim_send_hook()
+ * and netsim_dns_hook().  These sort out what the firmware sent, and pass
+ * it on to the program's own servers. */
+struct netsim
+{
+    uint32_t server_addr;       /* The NTP server, network order */
+
+    /* An NTP client request, NTP_MSG_LEN bytes from 'src_port' */
+    void (*ntp)(uint16_t src_port, const uint8_t *req);
+
+    /* A DHCP request (HOST_DHCP_xxx), or NULL to ignore them */
+    void (*dhcp)(uint16_t src_port, int type);
+
+    /* Non-zero if lwIP would still have the answer for 'name' cached,
+     * which is then server_addr */
+    int (*dns_cached)(const char *name);
+
+    /* A DNS lookup, to be answered with host_dns_answer() */
+    void (*dns)(const char *name);
+};
+
+extern struct netsim netsim;
+
+extern void netsim_send_hook(uint16_t src_port, uint32_t addr, uint16_t port,
+                             const uint8_t *data, size_t len);
+extern int netsim_dns_hook(const char *name, uint32_t *addr);
+extern void netsim_ntp_reply(uint8_t *rep, const uint8_t *req,
+                             uint64_t arrive_utc_us, uint64_t depart_utc_us);
@@ -0,0 +1,539 @@
+/*
+ * ntpsim.c
+ *
+ * Runs the NTP client against a simulated server which misbehaves
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* ntp_client.c, built for Linux with net.c in place of lwIP, talks to
+ * an NTP server and DNS server in this file.  Time is simulated, so the
+ * 37 hours between syncs pass in a moment.  Each request to the server
+ * can be lost, answered late or twice, answered for someone else, or
+ * answered with a wrong stratum, a kiss-o'-death or junk, either at
+ * random or following a script.  At the end comes:
+ *
+ *  - how long each sync took, from the first request,
+ *  - how far out the clock was just after each sync, and just before the
+ *    next, and whether that was within the firmware's error bound,
+ *  - how many bad replies were taken as good.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <pico/stdlib.h>
+
+#include "lwip/ip_addr.h"
+
+#include "settings.h"
+#include "clock.h"
+#include "ntp_client.h"
+#include "status.h"
+#include "host.h"
+#include "netsim.h"
+
+#define SERVER_NAME "pool.ntp.org"
+#define SERVER_ADDR "192.0.2.123"
+
+/* 2026-10-18 00:00:00 UTC */
+#define UTC_START 1792281600ULL
+
+/* How long lwIP keeps trying before giving up on a DNS lookup */
+#define DNS_TIMEOUT_US 10000000
+
+/* How long a DNS answer stays in lwIP's cache */
+#define DNS_TTL_US (300ULL*1000000)
+
+/* Late replies turn up after the client has given up (NTP_RESEND_TIME) */
+#define LATE_US 7000000
+
+enum fault
+{
+    F_OK,
+    F_LOSS,
+    F_LATE,
+    F_DUP,
+    F_MISMATCH,
+    F_STRATUM,
+    F_KOD,
+    F_JUNK,
+    F_DNS_FAIL,
+    F_DNS_LOSS,
+    NUM_FAULTS
+};
+
+static const char *fault_names[] = {"ok", "loss", "late", "dup", "mismatch",
+                                    "stratum", "kod", "junk", "dnsfail",
+                                    "dnsloss"};
+
+/* A packet or DNS answer on its way to the client */
+struct delivery
+{
+    uint64_t t;
+    int fault;
+    int dns;
+    int dns_ok;
+    uint16_t dst_port;
+    size_t len;
+    uint8_t data[64];
+};
+
+#define MAX_QUEUE 32
+static struct delivery queue[MAX_QUEUE];
+static int n_queue = 0;
+
+/* Options */
+static double p_fault[NUM_FAULTS];
+static int script[256];
+static int n_script = 0;
+static uint32_t latency_us = 5000;
+static uint32_t jitter_us = 2000;
+static double skew_ppm = 20.0;
+
+static uint32_t server_addr;
+static int n_requests = 0;
+static int n_lookups = 0;
+static uint64_t dns_cached_until = 0;
+static int sent[NUM_FAULTS];
+
+/* Results */
+static int in_cycle = 0;
+static uint64_t cycle_start;
+static int n_syncs = 0;
+static int n_bad = 0;
+static int n_outside = 0;
+static double conv_sum = 0.0;
+static double conv_max = 0.0;
+static double err_sum = 0.0;
+static double err_sum2 = 0.0;
+static double err_max = 0.0;
+static double drift_max = 0.0;
+
+
+static double frand()
+{
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+
+/* The Pico's crystal runs fast by skew_ppm */
+static uint64_t true_utc_us(uint64_t local_us)
+{
+    return UTC_START*1000000 + local_us - (int64_t)(local_us*skew_ppm/1e6);
+}
+
+
+static uint32_t one_way_us()
+{
+    return latency_us - jitter_us + frand()*2*jitter_us;
+}
+
+
+static int pick_fault(int dns)
+{
+    double r;
+    int i;
+
+    if ( n_script > 0 ) {
+        int f = script[(dns ? n_lookups : n_requests) % n_script];
+        if ( dns && (f != F_DNS_FAIL) && (f != F_DNS_LOSS) ) return F_OK;
+        if ( !dns && ((f == F_DNS_FAIL) || (f == F_DNS_LOSS)) ) return F_OK;
+        return f;
+    }
+
+    r = frand();
+    for ( i=1; i<NUM_FAULTS; i++ ) {
+        int is_dns = (i == F_DNS_FAIL) || (i == F_DNS_LOSS);
+        if ( is_dns != dns ) continue;
+        if ( r < p_fault[i] ) return i;
+        r -= p_fault[i];
+    }
+    return F_OK;
+}
+
+
+static struct delivery *enqueue(uint64_t t, int fault)
+{
+    struct delivery *d;
+
+    if ( n_queue == MAX_QUEUE ) return NULL;
+    d = &queue[n_queue++];
+    memset(d, 0, sizeof(*d));
+    d->t = t;
+    d->fault = fault;
+    return d;
+}
+
+
+static void server(uint16_t src_port, const uint8_t *req)
+{
+    uint64_t now = time_us_64();
+    uint64_t arrive = now + one_way_us();
+    uint64_t depart = arrive + 20;
+    uint8_t rep[NTP_MSG_LEN];
+    struct delivery *d;
+    int fault;
+    size_t i;
+
+    /* Each sync cycle starts with the first request after the last sync */
+    if ( !in_cycle ) {
+        if ( n_syncs > 0 ) {
+            double err = (int64_t)(clock_utc_us(now) - true_utc_us(now));
+            if ( fabs(err) > drift_max ) drift_max = fabs(err);
+            if ( fabs(err) > clock_error_us() ) n_outside++;
+        }
+        in_cycle = 1;
+        cycle_start = now;
+    }
+
+    fault = pick_fault(0);
+    n_requests++;
+    sent[fault]++;
+
+    netsim_ntp_reply(rep, req, true_utc_us(arrive), true_utc_us(depart));
+
+    switch ( fault ) {
+
+        case F_LOSS :
+        return;
+
+        case F_LATE :
+        depart += LATE_US;
+        break;
+
+        case F_MISMATCH :
+        for ( i=24; i<32; i++ ) rep[i] = rand();
+        break;
+
+        case F_STRATUM :
+        rep[0] |= 3<<6;
+        rep[1] = 16;
+        break;
+
+        case F_KOD :
+        rep[0] |= 3<<6;
+        rep[1] = 0;
+        memcpy(rep+12, "RATE", 4);
+        break;
+
+    }
+
+    d = enqueue(depart + one_way_us(), fault);
+    if ( d == NULL ) return;
+    d->dst_port = src_port;
+    if ( fault == F_JUNK ) {
+        d->len = rand() % sizeof(d->data);
+        for ( i=0; i<d->len; i++ ) d->data[i] = rand();
+    } else {
+        d->len = NTP_MSG_LEN;
+        memcpy(d->data, rep, NTP_MSG_LEN);
+    }
+
+    if ( fault == F_DUP ) {
+        struct delivery *d2 = enqueue(d->t + one_way_us(), fault);
+        if ( d2 != NULL ) *d2 = *d;
+    }
+}
+
+
+static int dns_cached(const char *name)
+{
+    return (strcmp(name, SERVER_NAME) == 0)
+        && (time_us_64() < dns_cached_until);
+}
+
+
+static void dns_server(const char *name)
+{
+    struct delivery *d;
+    int fault;
+    uint64_t now = time_us_64();
+
+    if ( strcmp(name, SERVER_NAME) != 0 ) {
+        d = enqueue(now + 2*latency_us, F_DNS_FAIL);
+        if ( d != NULL ) d->dns = 1;
+        return;
+    }
+
+    fault = pick_fault(1);
+    n_lookups++;
+    sent[fault]++;
+
+    if ( fault == F_DNS_LOSS ) {
+        d = enqueue(now + DNS_TIMEOUT_US, fault);
+    } else {
+        d = enqueue(now + 2*one_way_us(), fault);
+    }
+    if ( d == NULL ) return;
+    d->dns = 1;
+    d->dns_ok = (fault == F_OK);
+}
+
+
+static void synced(const struct delivery *d)
+{
+    uint64_t now = time_us_64();
+    double conv = (now - cycle_start)/1e6;
+    double err = (int64_t)(clock_utc_us(now) - true_utc_us(now));
+
+    /* Duplicates and late replies are genuine, if a bit odd */
+    if ( (d->fault != F_OK) && (d->fault != F_DUP) && (d->fault != F_LATE) ) {
+        n_bad++;
+        printf("Took a bad reply (%s) as good\n", fault_names[d->fault]);
+    }
+
+    n_syncs++;
+    conv_sum += conv;
+    if ( conv > conv_max ) conv_max = conv;
+    err_sum += err;
+    err_sum2 += err*err;
+    if ( fabs(err) > err_max ) err_max = fabs(err);
+    if ( fabs(err) > clock_error_us() ) n_outside++;
+    in_cycle = 0;
+}
+
+
+static void deliver(const struct delivery *d)
+{
+    uint32_t before = counters.ntp_syncs;
+
+    if ( d->dns ) {
+        if ( d->dns_ok ) {
+            dns_cached_until = time_us_64() + DNS_TTL_US;
+            host_dns_answer(SERVER_NAME, &server_addr);
+        } else {
+            host_dns_answer(SERVER_NAME, NULL);
+        }
+        return;
+    }
+
+    host_udp_deliver(server_addr, NTP_PORT, d->dst_port, d->data, d->len);
+    if ( counters.ntp_syncs != before ) synced(d);
+}
+
+
+/* Returns zero if nothing is on its way */
+static int next_delivery(uint64_t *t)
+{
+    int i;
+
+    for ( i=0; i<n_queue; i++ ) {
+        if ( (i == 0) || (queue[i].t < *t) ) *t = queue[i].t;
+    }
+    return n_queue > 0;
+}
+
+
+static void deliver_due()
+{
+    int i = 0;
+
+    while ( i < n_queue ) {
+        if ( queue[i].t <= time_us_64() ) {
+            struct delivery d = queue[i];
+            queue[i] = queue[--n_queue];
+            deliver(&d);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+
+static int parse_fault(const char *name)
+{
+    int i;
+    for ( i=0; i<NUM_FAULTS; i++ ) {
+        if ( strcmp(name, fault_names[i]) == 0 ) return i;
+    }
+    return -1;
+}
+
+
+/* "loss,ok,kod" -> the faults for successive requests, then round again */
+static int parse_script(const char *str)
+{
+    char *copy = strdup(str);
+    char *tok, *save;
+
+    for ( tok = strtok_r(copy, ",", &save);
+          tok != NULL;
+          tok = strtok_r(NULL, ",", &save) )
+    {
+        int f = parse_fault(tok);
+        if ( (f < 0) || (n_script == 256) ) {
+            fprintf(stderr, "Bad fault in script: '%s'\n", tok);
+            free(copy);
+            return 1;
+        }
+        script[n_script++] = f;
+    }
+    free(copy);
+    return 0;
+}
+
+
+/* "loss=0.1" */
+static int parse_prob(const char *str)
+{
+    char name[32];
+    double p;
+    int f;
+
+    if ( (sscanf(str, "%31[a-z]=%lf", name, &p) != 2)
+      || ((f = parse_fault(name)) <= F_OK) || (p < 0.0) || (p > 1.0) )
+    {
+        fprintf(stderr, "Bad fault probability: '%s'\n", str);
+        return 1;
+    }
+    p_fault[f] = p;
+    return 0;
+}
+
+
+static void show_help(const char *s)
+{
+    int i;
+
+    printf("Syntax: %s [options]\n\n", s);
+    printf("Runs ntp_client.c against a simulated NTP and DNS server.\n\n"
+           "  -n, --cycles=<n>        Stop after this many syncs (1000)\n"
+           "  -f, --fault=<f>=<p>     Make fault <f> happen with probability <p>\n"
+           "  -s, --script=<f>,<f>... Faults for successive requests, repeating\n"
+           "  -l, --latency=<us>      One-way network delay (5000)\n"
+           "  -j, --jitter=<us>       Random variation of the delay (2000)\n"
+           "  -k, --skew=<ppm>        How fast the Pico's crystal is (20)\n"
+           "  -r, --seed=<n>          Random seed (1)\n"
+           "  -v, --verbose           Show the firmware's output\n"
+           "  -h, --help              Display this help message\n\n"
+           "Faults:");
+    for ( i=1; i<NUM_FAULTS; i++ ) printf(" %s", fault_names[i]);
+    printf("\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    int c, i;
+    int cycles = 1000;
+    int verbose = 0;
+    unsigned int seed = 1;
+    ip4_addr_t a;
+    NTP_T *ntp;
+    double t0, t1;
+    struct timespec ts;
+
+    const struct option longopts[] = {
+        {"cycles",  1, NULL, 'n'},
+        {"fault",   1, NULL, 'f'},
+        {"script",  1, NULL, 's'},
+        {"latency", 1, NULL, 'l'},
+        {"jitter",  1, NULL, 'j'},
+        {"skew",    1, NULL, 'k'},
+        {"seed",    1, NULL, 'r'},
+        {"verbose", 0, NULL, 'v'},
+        {"help",    0, NULL, 'h'},
+        {0, 0, NULL, 0}
+    };
+
+    while ( (c = getopt_long(argc, argv, "n:f:s:l:j:k:r:vh", longopts, NULL)) != -1 ) {
+        switch ( c ) {
+            case 'n' : cycles = atoi(optarg); break;
+            case 'f' : if ( parse_prob(optarg) ) return 1; break;
+            case 's' : if ( parse_script(optarg) ) return 1; break;
+            case 'l' : latency_us = atoi(optarg); break;
+            case 'j' : jitter_us = atoi(optarg); break;
+            case 'k' : skew_ppm = atof(optarg); break;
+            case 'r' : seed = atoi(optarg); break;
+            case 'v' : verbose = 1; break;
+            case 'h' : show_help(argv[0]); return 0;
+            default : return 1;
+        }
+    }
+    if ( jitter_us > latency_us ) jitter_us = latency_us;
+
+    srand(seed);
+    ip4addr_aton(SERVER_ADDR, &a);
+    server_addr = a.addr;
+    netsim.server_addr = server_addr;
+    netsim.ntp = server;
+    netsim.dns_cached = dns_cached;
+    netsim.dns = dns_server;
+    host_udp_send_hook = netsim_send_hook;
+    host_dns_hook = netsim_dns_hook;
+    host_freeze_time();
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t0 = ts.tv_sec + ts.tv_nsec/1e9;
+
+    if ( !verbose ) host_quiet(1);
+    settings_read();
+    ntp = ntp_init();
+    while ( n_syncs < cycles ) {
+
+        uint64_t now = time_us_64();
+        uint64_t t, ta;
+        int have = next_delivery(&t);
+
+        if ( host_next_alarm(&ta) && (!have || (ta < t)) ) {
+            t = ta;
+            have = 1;
+        }
+        if ( !have ) {
+            printf("NTP client has stopped\n");
+            break;
+        }
+        if ( t > now ) host_advance_us(t - now);
+        deliver_due();
+
+    }
+    host_quiet(0);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t1 = ts.tv_sec + ts.tv_nsec/1e9;
+
+    printf("%i syncs in %.1f simulated days, %.2f s (%.0f syncs per second)\n",
+           n_syncs, time_us_64()/86400e6, t1-t0, n_syncs/(t1-t0));
+    printf("%i requests, %i DNS lookups, %li failures counted\n",
+           n_requests, n_lookups, counters.ntp_failures);
+    printf("Faults:");
+    for ( i=1; i<NUM_FAULTS; i++ ) {
+        if ( sent[i] > 0 ) printf(" %s %i", fault_names[i], sent[i]);
+    }
+    printf("\n");
+    if ( n_syncs == 0 ) return 1;
+
+    printf("Time to sync                %8.1f s mean, %.1f s worst\n",
+           conv_sum/n_syncs, conv_max);
+    printf("Error after sync            %8.1f us mean, %.1f us rms, "
+           "%.1f us worst\n", err_sum/n_syncs,
+           sqrt(err_sum2/n_syncs), err_max);
+    printf("Error before next sync      %8.1f us worst\n", drift_max);
+    printf("Outside the error bound     %8i times\n", n_outside);
+    printf("Bad replies taken as good   %8i\n", n_bad);
+    printf("NTP client says %s\n", ntp_ok(ntp) ? "ok" : "not ok");
+
+    return (n_bad > 0) || (n_outside > 0);
+}
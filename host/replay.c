@@ -0,0 +1,519 @@
+/*
+ * replay.c
+ *
+ * Feeds a recording of the firmware's inputs back through its code
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Reads the console output of 'record dump' (the '@rec' lines, anything
+ * else is ignored) and plays the inputs back through the firmware's
+ * clock, DS3231, 1 Hz, settings and terminal code in simulated time.
+ * Each LED decision in the recording is compared with the one made here,
+ * so a wrong decision in the field can be reproduced and debugged on
+ * the host.
+ *
+ * The NTP replies and LED decisions go through the same code as in the
+ * firmware (ntp_reply.c and holdover.c), but ntp_client.c itself isn't
+ * used, because its check that each reply matches a request would need
+ * the requests to be replayed at the same times.  Instead, a reply counts
+ * as the answer to a request if it hasn't been seen before, since the
+ * origin timestamp is the time when the request was sent.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <pico/stdlib.h>
+
+#include "settings.h"
+#include "schedule.h"
+#include "clock.h"
+#include "ds3231.h"
+#include "holdover.h"
+#include "ntp_client.h"
+#include "ntp_reply.h"
+#include "pps.h"
+#include "record.h"
+#include "terminal.h"
+#include "host.h"
+
+#define PIN_SQW 6
+
+struct record
+{
+    int type;
+    uint64_t t;
+    size_t len;
+    uint8_t *data;
+    int used;           /* DS3231 reads: already given to the firmware */
+};
+
+/* Something to do at a particular time.  Inputs which were noticed some
+ * time after they happened (1 Hz edges, DS3231 reads) have two events. */
+#define EV_RECORD 0
+#define EV_EDGE 1
+#define EV_READ 2
+
+struct event
+{
+    uint64_t t;
+    int rec;
+    int what;
+};
+
+static struct record *recs = NULL;
+static int n_recs = 0;
+static int next_read = 0;
+static int verbose = 0;
+
+static uint8_t leds = 0;
+static int leds_valid = 0;
+static int n_checked = 0;
+static int n_wrong = 0;
+
+/* NTP state, as far as ntp_client.c would have it */
+static uint8_t last_origin[8];
+static struct ntp_bcast bcast;
+static int64_t delay_us = 0;
+
+
+/* The firmware prints a lot.  Send it to /dev/null unless asked. */
+static void quiet(int on)
+{
+    if ( !verbose ) host_quiet(on);
+}
+
+
+static int hex_decode(const char *hex, uint8_t *buf, size_t max)
+{
+    size_t n = 0;
+    unsigned int v;
+
+    while ( (hex[0] != '\0') && (hex[0] != '\n') && (hex[0] != '\r') ) {
+        if ( (n == max) || (sscanf(hex, "%2x", &v) != 1) ) return -1;
+        buf[n++] = v;
+        hex += 2;
+    }
+    return n;
+}
+
+
+static uint64_t get_varint(const uint8_t *buf, size_t len, size_t *pos)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        if ( (*pos >= len) || (shift > 63) ) {
+            *pos = len+1;
+            return 0;
+        }
+        byte = buf[(*pos)++];
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while ( byte & 0x80 );
+    return v;
+}
+
+
+/* Returns the start time, or -1 on error */
+static int64_t read_dump(FILE *fh, struct mt_settings *start, int *have_start)
+{
+    char line[1024];
+    uint8_t *data = NULL;
+    size_t len = 0;
+    size_t slen = 0;
+    size_t pos = 0;
+    int64_t base = -1;
+    int ended = 0;
+    uint64_t t;
+
+    while ( fgets(line, sizeof(line), fh) != NULL ) {
+
+        char *rec = strstr(line, "@rec ");
+        uint8_t buf[512];
+        int n;
+
+        if ( rec == NULL ) continue;
+        rec += 5;
+
+        if ( strncmp(rec, "start ", 6) == 0 ) {
+            base = strtoll(rec+6, NULL, 10);
+            len = 0;
+            slen = 0;
+            ended = 0;
+        } else if ( strncmp(rec, "settings ", 9) == 0 ) {
+            n = hex_decode(rec+9, buf, sizeof(buf));
+            if ( (n < 0) || (slen + n > sizeof(*start)) ) {
+                fprintf(stderr, "Bad settings line: %s", line);
+                return -1;
+            }
+            memcpy((uint8_t *)start + slen, buf, n);
+            slen += n;
+        } else if ( strncmp(rec, "data ", 5) == 0 ) {
+            n = hex_decode(rec+5, buf, sizeof(buf));
+            if ( n < 0 ) {
+                fprintf(stderr, "Bad data line: %s", line);
+                return -1;
+            }
+            data = realloc(data, len+n);
+            memcpy(data+len, buf, n);
+            len += n;
+        } else if ( strncmp(rec, "end", 3) == 0 ) {
+            ended = 1;
+        }
+    }
+
+    if ( base < 0 ) {
+        fprintf(stderr, "No recording found\n");
+        return -1;
+    }
+    if ( !ended ) fprintf(stderr, "Recording is incomplete\n");
+    *have_start = (slen == sizeof(*start));
+
+    t = base;
+    while ( pos < len ) {
+        struct record r;
+        r.type = data[pos++];
+        r.len = get_varint(data, len, &pos);
+        t += get_varint(data, len, &pos);
+        if ( (pos > len) || (r.len > len - pos) ) {
+            fprintf(stderr, "Recording is truncated after %i records\n",
+                    n_recs);
+            break;
+        }
+        r.t = t;
+        r.data = malloc(r.len+1);
+        memcpy(r.data, data+pos, r.len);
+        r.used = 0;
+        pos += r.len;
+        recs = realloc(recs, (n_recs+1)*sizeof(struct record));
+        recs[n_recs++] = r;
+    }
+
+    free(data);
+    return base;
+}
+
+
+static int cmp_event(const void *av, const void *bv)
+{
+    const struct event *a = av;
+    const struct event *b = bv;
+    if ( a->t != b->t ) return (a->t < b->t) ? -1 : 1;
+    if ( a->rec != b->rec ) return a->rec - b->rec;
+    return b->what - a->what;
+}
+
+
+static struct event *make_events(int *pn)
+{
+    struct event *ev = malloc(2*n_recs*sizeof(struct event));
+    int i;
+    int n = 0;
+
+    for ( i=0; i<n_recs; i++ ) {
+        struct record *r = &recs[i];
+        uint32_t before;
+        uint16_t dt;
+
+        if ( (r->type == REC_PPS) && (r->len == 4) ) {
+            memcpy(&before, r->data, 4);
+            ev[n].what = EV_EDGE;
+        } else if ( (r->type == REC_DS3231) && (r->len >= 3) ) {
+            memcpy(&dt, r->data+1, 2);
+            before = dt;
+            ev[n].what = EV_READ;
+        } else {
+            before = UINT32_MAX;
+        }
+        if ( before != UINT32_MAX ) {
+            ev[n].t = (before > r->t) ? 0 : r->t - before;
+            ev[n].rec = i;
+            n++;
+        }
+
+        ev[n].t = r->t;
+        ev[n].rec = i;
+        ev[n].what = EV_RECORD;
+        n++;
+    }
+
+    qsort(ev, n, sizeof(struct event), cmp_event);
+    *pn = n;
+    return ev;
+}
+
+
+/* Hands out the recorded DS3231 time registers, in order */
+static int read_hook(int reg, uint8_t *dst, size_t len, int *result)
+{
+    struct record *r;
+    uint64_t now = time_us_64();
+
+    if ( (reg != 0) || (len != 7) ) return 0;
+
+    while ( (next_read < n_recs) && (recs[next_read].type != REC_DS3231) ) {
+        next_read++;
+    }
+    if ( next_read == n_recs ) return 0;
+
+    r = &recs[next_read++];
+    r->used = 1;
+    if ( r->t > now ) host_advance_us(r->t - now);
+
+    if ( (r->data[0] == 0) || (r->len < 10) ) {
+        *result = PICO_ERROR_TIMEOUT;
+    } else {
+        memcpy(dst, r->data+3, 7);
+        *result = 7;
+    }
+    return 1;
+}
+
+
+/* As ntp_recv() in ntp_client.c, except for matching replies to
+ * requests (see the top of this file).  Broadcasts are never ignored
+ * while waiting for a calibration reply. */
+static void ntp_packet(const struct record *r)
+{
+    struct ntp_reply reply;
+    uint32_t addr;
+    uint16_t port;
+    uint64_t t1;
+
+    if ( r->len != 6+NTP_MSG_LEN ) return;
+    memcpy(&addr, r->data, 4);
+    memcpy(&port, r->data+4, 2);
+    ntp_reply_decode(r->data+6, &reply);
+
+    if ( reply.mode == NTP_MODE_BROADCAST ) {
+
+        int what = ntp_bcast_check(&bcast, &reply, addr, r->t, 0);
+        if ( what == NTP_BCAST_SYNC ) {
+            ntp_bcast_sync(&bcast, &reply, addr, r->t, delay_us);
+        }
+
+    } else if ( reply.mode == NTP_MODE_SERVER ) {
+
+        memcpy(&t1, reply.origin, 8);
+        if ( memcmp(reply.origin, last_origin, 8) == 0 ) return;
+        if ( t1 > r->t ) return;
+        memcpy(last_origin, reply.origin, 8);
+        if ( (port != NTP_PORT) || !reply.synced ) return;
+
+        delay_us = ntp_reply_sync(&reply, t1, r->t, addr) / 2;
+        ntp_bcast_calibrate(&bcast, addr, r->t);
+
+    }
+}
+
+
+/* As the main loop in morningtown.c */
+static uint8_t decide()
+{
+    uint64_t now = time_us_64();
+    uint8_t sched;
+
+    holdover_poll();
+    sched = schedule_lookup(schedule_minute_of_week(clock_utc_us(now)/1000000));
+    return holdover_leds(sched, leds, leds_valid);
+}
+
+
+static void print_time(uint64_t t)
+{
+    datetime_t dt;
+
+    printf("%12.6f ", t/1e6);
+    if ( clock_source() == CLOCK_SRC_NONE ) {
+        printf("(time unknown)      ");
+        return;
+    }
+    clock_to_datetime(clock_utc_us(t), &dt);
+    printf("%04i-%02i-%02i %02i:%02i:%02i ", dt.year, dt.month, dt.day,
+           dt.hour, dt.min, dt.sec);
+}
+
+
+static void check_leds(const struct record *r)
+{
+    uint8_t ours;
+
+    if ( r->len != 1 ) return;
+
+    ours = decide();
+    n_checked++;
+
+    quiet(0);
+    print_time(r->t);
+    if ( ours == r->data[0] ) {
+        printf("LEDs %02x\n", ours);
+    } else {
+        printf("LEDs %02x, but %02x here  <-- MISMATCH\n", r->data[0], ours);
+        n_wrong++;
+    }
+    quiet(1);
+    leds = ours;
+    leds_valid = 1;
+}
+
+
+static void run_event(const struct event *ev, Terminal *trm)
+{
+    struct record *r = &recs[ev->rec];
+    uint64_t utc;
+    uint32_t err;
+
+    if ( ev->what == EV_EDGE ) {
+        host_gpio_event(PIN_SQW, GPIO_IRQ_EDGE_FALL);
+        return;
+    }
+
+    if ( ev->what == EV_READ ) {
+        /* Not already read by pps_poll() or the terminal, so it must
+         * have been the main loop */
+        if ( !r->used ) ds3231_to_clock();
+        return;
+    }
+
+    switch ( r->type ) {
+
+        case REC_BOOT :
+        if ( verbose ) printf("Boot\n");
+        break;
+
+        case REC_SETTINGS :
+        if ( r->len != sizeof(settings) ) break;
+        memcpy(&settings, r->data, sizeof(settings));
+        schedule_compile();
+        break;
+
+        case REC_NTP :
+        ntp_packet(r);
+        break;
+
+        case REC_PPS :
+        pps_poll();
+        break;
+
+        case REC_TERMINAL :
+        host_input((char *)r->data, r->len);
+        terminal_poll(trm);
+        break;
+
+        case REC_RETAINED :
+        if ( r->len != 12 ) break;
+        memcpy(&utc, r->data, 8);
+        memcpy(&err, r->data+8, 4);
+        clock_set(CLOCK_SRC_RETAINED, utc, 0, err);
+        break;
+
+        case REC_LEDS :
+        check_leds(r);
+        break;
+    }
+}
+
+
+static void show_help(const char *s)
+{
+    printf("Syntax: %s [options] [recording]\n\n", s);
+    printf("Plays back the output of 'record dump' (from the console log,\n"
+           "or standard input) and compares the LED decisions.\n\n"
+           "  -v, --verbose   Show the firmware's output as well\n"
+           "  -h, --help      Display this help message\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    int c;
+    FILE *fh = stdin;
+    struct mt_settings start;
+    int have_start;
+    int64_t base;
+    struct event *ev;
+    int n_ev, i;
+    Terminal *trm;
+
+    const struct option longopts[] = {
+        {"verbose", 0, NULL, 'v'},
+        {"help",    0, NULL, 'h'},
+        {0, 0, NULL, 0}
+    };
+
+    while ( (c = getopt_long(argc, argv, "vh", longopts, NULL)) != -1 ) {
+        switch ( c ) {
+            case 'v' : verbose = 1; break;
+            case 'h' : show_help(argv[0]); return 0;
+            default : return 1;
+        }
+    }
+
+    if ( optind < argc ) {
+        fh = fopen(argv[optind], "r");
+        if ( fh == NULL ) {
+            fprintf(stderr, "Couldn't open '%s'\n", argv[optind]);
+            return 1;
+        }
+    }
+    base = read_dump(fh, &start, &have_start);
+    if ( fh != stdin ) fclose(fh);
+    if ( base < 0 ) return 1;
+
+    printf("%i records from %.6f to %.6f s after boot\n", n_recs, base/1e6,
+           (n_recs > 0) ? recs[n_recs-1].t/1e6 : base/1e6);
+
+    /* The 1 Hz edges come from the record, not the model */
+    host_ds3231.sqw_gpio = -1;
+    host_freeze_time();
+    host_advance_us(base);
+    host_i2c_read_hook = read_hook;
+
+    quiet(1);
+    if ( have_start ) {
+        memcpy(&settings, &start, sizeof(settings));
+        schedule_compile();
+    }
+    ds3231_init();
+    pps_init();
+    trm = terminal_init();
+    quiet(0);
+
+    ev = make_events(&n_ev);
+    for ( i=0; i<n_ev; i++ ) {
+        uint64_t now = time_us_64();
+        if ( ev[i].t > now ) host_advance_us(ev[i].t - now);
+        quiet(1);
+        run_event(&ev[i], trm);
+        quiet(0);
+    }
+
+    printf("%i LED decisions, %i different here\n", n_checked, n_wrong);
+
+    free(ev);
+    for ( i=0; i<n_recs; i++ ) free(recs[i].data);
+    free(recs);
+    return n_wrong ? 1 : 0;
+}
@@ -0,0 +1,414 @@
+/*
+ * sdk.c
+ *
+ * Host implementation of the Pico SDK functions used by the firmware
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <pico/stdlib.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <hardware/irq.h>
+#include <hardware/pwm.h>
+
+#include "host.h"
+
+uint8_t host_flash[PICO_FLASH_SIZE_BYTES];
+
+static __attribute__((constructor)) void erase_all_flash()
+{
+    memset(host_flash, 0xff, sizeof(host_flash));
+}
+
+
+/* ---------------------------- Time ---------------------------- */
+
+static uint64_t start_ns = 0;
+static uint64_t advanced_us = 0;
+static int frozen = 0;
+
+static uint64_t mono_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+
+uint64_t time_us_64()
+{
+    if ( frozen ) return advanced_us;
+    if ( start_ns == 0 ) start_ns = mono_ns();
+    return (mono_ns() - start_ns)/1000 + advanced_us;
+}
+
+
+uint32_t time_us_32()
+{
+    return time_us_64();
+}
+
+
+/* Alarms go off when simulated time is moved on past them */
+#define MAX_ALARMS 8
+
+struct host_alarm
+{
+    alarm_id_t id;              /* Zero if free */
+    uint64_t target;
+    alarm_callback_t callback;
+    void *user_data;
+};
+
+static struct host_alarm alarms[MAX_ALARMS];
+static alarm_id_t next_alarm_id = 1;
+static int in_alarm = 0;
+
+
+static void run_alarms()
+{
+    int i;
+
+    /* Callbacks can wait, which moves time on and comes back here */
+    if ( in_alarm ) return;
+    in_alarm = 1;
+
+    for ( i=0; i<MAX_ALARMS; i++ ) {
+        struct host_alarm *a = &alarms[i];
+        int64_t r;
+
+        if ( (a->id == 0) || (time_us_64() < a->target) ) continue;
+        r = a->callback(a->id, a->user_data);
+        if ( r > 0 ) {
+            a->target += r;
+        } else if ( r < 0 ) {
+            a->target = time_us_64() - r;
+        } else {
+            a->id = 0;
+        }
+        i = -1;     /* Start again, in case another is now due */
+    }
+
+    in_alarm = 0;
+}
+
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past)
+{
+    int i;
+
+    for ( i=0; i<MAX_ALARMS; i++ ) {
+        if ( alarms[i].id != 0 ) continue;
+        alarms[i].id = next_alarm_id++;
+        alarms[i].target = time_us_64() + us;
+        alarms[i].callback = callback;
+        alarms[i].user_data = user_data;
+        return alarms[i].id;
+    }
+    return -1;
+}
+
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past)
+{
+    return add_alarm_in_us(ms*1000ULL, callback, user_data, fire_if_past);
+}
+
+
+bool cancel_alarm(alarm_id_t id)
+{
+    int i;
+
+    for ( i=0; i<MAX_ALARMS; i++ ) {
+        if ( alarms[i].id == id ) {
+            alarms[i].id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* From now on, time only moves when told to, starting from zero */
+void host_freeze_time()
+{
+    frozen = 1;
+    advanced_us = 0;
+}
+
+
+/* Returns zero if no alarms are set */
+int host_next_alarm(uint64_t *t)
+{
+    int i;
+    int found = 0;
+
+    for ( i=0; i<MAX_ALARMS; i++ ) {
+        if ( alarms[i].id == 0 ) continue;
+        if ( !found || (alarms[i].target < *t) ) *t = alarms[i].target;
+        found = 1;
+    }
+    return found;
+}
+
+
+/* Alarms go off at their own times on the way, so that they see the
+ * right time_us_64() */
+void host_advance_us(uint64_t us)
+{
+    uint64_t end = time_us_64() + us;
+    uint64_t t, now;
+
+    while ( !in_alarm && host_next_alarm(&t) && (t < end) ) {
+        now = time_us_64();
+        if ( t > now ) advanced_us += t - now;
+        run_alarms();
+    }
+
+    now = time_us_64();
+    if ( end > now ) advanced_us += end - now;
+    run_alarms();
+}
+
+
+void sleep_us(uint64_t us)
+{
+    host_advance_us(us);
+}
+
+
+void busy_wait_us_32(uint32_t us)
+{
+    host_advance_us(us);
+}
+
+
+void sleep_ms(uint32_t ms)
+{
+    host_advance_us(ms*1000ULL);
+}
+
+
+/* ---------------------------- Console ---------------------------- */
+
+static int quiet_fd = -1;
+
+
+/* The firmware prints a lot.  Send it to /dev/null for a while. */
+void host_quiet(int on)
+{
+    if ( on && (quiet_fd < 0) ) {
+        int null = open("/dev/null", O_WRONLY);
+        fflush(stdout);
+        quiet_fd = dup(1);
+        dup2(null, 1);
+        close(null);
+    } else if ( !on && (quiet_fd >= 0) ) {
+        fflush(stdout);
+        dup2(quiet_fd, 1);
+        close(quiet_fd);
+        quiet_fd = -1;
+    }
+}
+
+
+static char input[4096];
+static size_t input_head = 0;
+static size_t input_tail = 0;
+
+
+void host_input(const char *str, size_t len)
+{
+    if ( input_head == input_tail ) input_head = input_tail = 0;
+    if ( len > sizeof(input) - input_tail ) len = sizeof(input) - input_tail;
+    memcpy(input+input_tail, str, len);
+    input_tail += len;
+}
+
+
+size_t host_input_pending()
+{
+    return input_tail - input_head;
+}
+
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+    if ( input_head == input_tail ) return PICO_ERROR_TIMEOUT;
+    return (uint8_t)input[input_head++];
+}
+
+
+bool stdio_init_all()
+{
+    return true;
+}
+
+
+bool stdio_usb_connected()
+{
+    return false;
+}
+
+
+/* ---------------------------- GPIO ---------------------------- */
+
+static uint32_t gpio_out;
+static uint32_t gpio_dir;
+
+void gpio_init(uint gpio) {}
+void gpio_pull_up(uint gpio) {}
+void gpio_set_function(uint gpio, int fn) {}
+
+
+/* The I2C pins are also bit-banged to clear the bus (see ds3231.c) */
+void gpio_set_dir(uint gpio, bool out)
+{
+    if ( out ) {
+        gpio_dir |= 1u<<gpio;
+    } else {
+        gpio_dir &= ~(1u<<gpio);
+        host_i2c_pin_released(gpio);
+    }
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    if ( value ) {
+        gpio_out |= 1u<<gpio;
+    } else {
+        gpio_out &= ~(1u<<gpio);
+    }
+}
+
+
+bool gpio_get(uint gpio)
+{
+    int level;
+
+    if ( !((gpio_dir >> gpio) & 1) && host_i2c_pin_level(gpio, &level) ) {
+        return level;
+    }
+    return (gpio_out >> gpio) & 1;
+}
+
+
+/* The LEDs are lit with PWM, which does nothing here */
+pwm_config pwm_get_default_config()
+{
+    pwm_config c = {1.0f};
+    return c;
+}
+
+void pwm_init(uint slice_num, pwm_config *c, bool start) {}
+void pwm_set_gpio_level(uint gpio, uint16_t level) {}
+
+
+#define NUM_GPIOS 30
+
+static irq_handler_t gpio_handlers[NUM_GPIOS];
+static uint32_t gpio_irq_enabled[NUM_GPIOS];
+static uint32_t gpio_irq_pending[NUM_GPIOS];
+
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler)
+{
+    gpio_handlers[gpio] = handler;
+}
+
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled)
+{
+    if ( enabled ) {
+        gpio_irq_enabled[gpio] |= events;
+    } else {
+        gpio_irq_enabled[gpio] &= ~events;
+    }
+}
+
+
+uint32_t gpio_get_irq_event_mask(uint gpio)
+{
+    return gpio_irq_pending[gpio];
+}
+
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events)
+{
+    gpio_irq_pending[gpio] &= ~events;
+}
+
+
+void irq_set_enabled(uint num, bool enabled)
+{
+}
+
+
+void host_gpio_event(uint gpio, uint32_t events)
+{
+    events &= gpio_irq_enabled[gpio];
+    if ( events == 0 ) return;
+    gpio_irq_pending[gpio] |= events;
+    if ( gpio_handlers[gpio] != NULL ) gpio_handlers[gpio]();
+}
+
+
+/* ---------------------------- Flash ---------------------------- */
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if ( flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE ) {
+        fprintf(stderr, "Unaligned flash erase %x+%zx\n", flash_offs, count);
+        return;
+    }
+    memset(host_flash+flash_offs, 0xff, count);
+}
+
+
+/* Like the real thing, programming can only clear bits */
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count)
+{
+    size_t i;
+
+    if ( flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE ) {
+        fprintf(stderr, "Unaligned flash write %x+%zx\n", flash_offs, count);
+        return;
+    }
+    for ( i=0; i<count; i++ ) host_flash[flash_offs+i] &= data[i];
+}
+
+
+uint32_t save_and_disable_interrupts()
+{
+    return 0;
+}
+
+
+void restore_interrupts(uint32_t status)
+{
+}
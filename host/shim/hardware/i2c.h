@@ -0,0 +1,42 @@
+/*
+ * hardware/i2c.h
+ *
+ * Host stand-in for the Pico I2C driver, talking to a DS3231 model
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <pico/stdlib.h>
+
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t *i2c0;
+#define i2c_default i2c0
+
+extern uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+extern void i2c_deinit(i2c_inst_t *i2c);
+extern int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr,
+                              const uint8_t *src, size_t len, bool nostop);
+extern int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr,
+                             uint8_t *dst, size_t len, bool nostop);
+extern int i2c_write_timeout_us(i2c_inst_t *i2c, uint8_t addr,
+                                const uint8_t *src, size_t len, bool nostop,
+                                uint timeout_us);
+extern int i2c_read_timeout_us(i2c_inst_t *i2c, uint8_t addr,
+                               uint8_t *dst, size_t len, bool nostop,
+                               uint timeout_us);
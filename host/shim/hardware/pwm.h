@@ -0,0 +1,44 @@
+/*
+ * hardware/pwm.h
+ *
+ * Host stand-in for the PWM hardware (the LEDs)
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_HARDWARE_PWM_H
+#define HOST_HARDWARE_PWM_H
+
+#include <pico/stdlib.h>
+
+#define GPIO_FUNC_PWM 4
+
+typedef struct
+{
+    float clkdiv;
+} pwm_config;
+
+#define pwm_gpio_to_slice_num(gpio) (((gpio) >> 1) & 7)
+#define pwm_config_set_clkdiv(c, div) ((c)->clkdiv = (div))
+
+extern pwm_config pwm_get_default_config(void);
+extern void pwm_init(uint slice_num, pwm_config *c, bool start);
+extern void pwm_set_gpio_level(uint gpio, uint16_t level);
+
+#endif /* HOST_HARDWARE_PWM_H */
@@ -0,0 +1,45 @@
+/*
+ * lwip/dhcp.h
+ *
+ * Host stand-in for lwIP: DHCP client
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_DHCP_H
+#define HOST_LWIP_DHCP_H
+
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+
+struct dhcp
+{
+    u32_t offered_t0_lease;     /* Seconds */
+    u8_t bound;
+};
+
+#define netif_dhcp_data(n) ((n)->dhcp)
+extern u8_t dhcp_supplied_address(const struct netif *netif);
+
+/* Provided by the firmware, for LWIP_DHCP_GET_NTP_SRV */
+extern void dhcp_set_ntp_servers(u8_t num_ntp_servers,
+                                 const ip4_addr_t *ntp_server_addrs);
+
+#endif /* HOST_LWIP_DHCP_H */
@@ -0,0 +1,34 @@
+/*
+ * lwip/igmp.h
+ *
+ * Host stand-in for lwIP: multicast group membership
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_IGMP_H
+#define HOST_LWIP_IGMP_H
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+
+extern err_t igmp_joingroup_netif(struct netif *netif,
+                                  const ip4_addr_t *groupaddr);
+
+#endif /* HOST_LWIP_IGMP_H */
@@ -0,0 +1,55 @@
+/*
+ * lwip/ip_addr.h
+ *
+ * Host stand-in for lwIP: IPv4 addresses
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_IP_ADDR_H
+#define HOST_LWIP_IP_ADDR_H
+
+#include "lwip/opt.h"
+
+/* IPv4 only, as on the Pico W.  The address is in network byte order. */
+typedef struct
+{
+    u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_ANY 46
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ANY_TYPE (&ip_addr_any)
+
+#define ip4_addr_get_u32(a) ((a)->addr)
+#define ip4_addr_set_u32(a, v) ((a)->addr = (v))
+#define ip4_addr_isany_val(a) ((a).addr == 0)
+#define ip_2_ip4(a) (a)
+#define ip_addr_cmp(a, b) ((a)->addr == (b)->addr)
+#define ip_addr_copy_from_ip4(dest, src) ((dest) = (src))
+
+extern int ip4addr_aton(const char *cp, ip4_addr_t *addr);
+extern char *ip4addr_ntoa(const ip4_addr_t *addr);
+#define ipaddr_ntoa(a) ip4addr_ntoa(a)
+
+#endif /* HOST_LWIP_IP_ADDR_H */
@@ -0,0 +1,59 @@
+/*
+ * lwip/netif.h
+ *
+ * Host stand-in for lwIP: network interfaces
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_NETIF_H
+#define HOST_LWIP_NETIF_H
+
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+
+struct netif;
+typedef void (*netif_status_callback_fn)(struct netif *netif);
+
+#define NETIF_FLAG_LINK_UP 0x04
+
+struct netif
+{
+    ip4_addr_t ip_addr;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    u8_t flags;
+    netif_status_callback_fn status_callback;
+    netif_status_callback_fn link_callback;
+    struct dhcp *dhcp;
+};
+
+#define netif_is_link_up(n) (((n)->flags & NETIF_FLAG_LINK_UP) != 0)
+#define netif_ip4_addr(n) ((const ip4_addr_t *)&(n)->ip_addr)
+#define netif_ip4_netmask(n) ((const ip4_addr_t *)&(n)->netmask)
+#define netif_ip4_gw(n) ((const ip4_addr_t *)&(n)->gw)
+
+extern void netif_set_addr(struct netif *netif, const ip4_addr_t *ipaddr,
+                           const ip4_addr_t *netmask, const ip4_addr_t *gw);
+extern void netif_set_status_callback(struct netif *netif,
+                                      netif_status_callback_fn cb);
+extern void netif_set_link_callback(struct netif *netif,
+                                    netif_status_callback_fn cb);
+
+#endif /* HOST_LWIP_NETIF_H */
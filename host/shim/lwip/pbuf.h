@@ -0,0 +1,61 @@
+/*
+ * lwip/pbuf.h
+ *
+ * Host stand-in for lwIP: packet buffers
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_PBUF_H
+#define HOST_LWIP_PBUF_H
+
+#include "lwip/opt.h"
+
+typedef enum
+{
+    PBUF_TRANSPORT,
+    PBUF_IP,
+    PBUF_LINK,
+    PBUF_RAW
+} pbuf_layer;
+
+typedef enum
+{
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL
+} pbuf_type;
+
+/* Always a single buffer on the host */
+struct pbuf
+{
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+extern struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+extern u8_t pbuf_free(struct pbuf *p);
+extern u8_t pbuf_get_at(const struct pbuf *p, u16_t offset);
+extern u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr,
+                               u16_t len, u16_t offset);
+
+#endif /* HOST_LWIP_PBUF_H */
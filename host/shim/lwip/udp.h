@@ -0,0 +1,56 @@
+/*
+ * lwip/udp.h
+ *
+ * Host stand-in for lwIP: UDP
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_LWIP_UDP_H
+#define HOST_LWIP_UDP_H
+
+/* Same as the real one's guard, for headers which check for it */
+#define LWIP_HDR_UDP_H
+
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+struct udp_pcb;
+
+typedef void (*udp_recv_fn)(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                            const ip_addr_t *addr, u16_t port);
+
+struct udp_pcb
+{
+    u16_t local_port;
+    udp_recv_fn recv;
+    void *recv_arg;
+};
+
+extern struct udp_pcb *udp_new(void);
+extern struct udp_pcb *udp_new_ip_type(u8_t type);
+extern void udp_remove(struct udp_pcb *pcb);
+extern err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr,
+                      u16_t port);
+extern void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg);
+extern err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p,
+                        const ip_addr_t *dst_ip, u16_t dst_port);
+
+#endif /* HOST_LWIP_UDP_H */
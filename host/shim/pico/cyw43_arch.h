@@ -0,0 +1,66 @@
+/*
+ * pico/cyw43_arch.h
+ *
+ * Host stand-in for the Pico W wireless chip
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+#include <pico/stdlib.h>
+
+#include "lwip/netif.h"
+
+#define CYW43_ITF_STA 0
+#define CYW43_ITF_AP 1
+
+typedef struct
+{
+    struct netif netif[2];
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+/* Everything runs in one thread on the host */
+#define cyw43_arch_lwip_begin()
+#define cyw43_arch_lwip_end()
+
+/* The rest is only in the fleet simulator's build (see cyw43.c) */
+#define CYW43_WL_GPIO_LED_PIN 0
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_IOCTL_GET_CHANNEL 0x3a
+
+extern int cyw43_arch_init(void);
+extern void cyw43_arch_enable_sta_mode(void);
+extern void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+extern void cyw43_arch_poll(void);
+extern void cyw43_arch_wait_for_work_until(absolute_time_t until);
+extern int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw,
+                                         uint32_t auth);
+extern int cyw43_wifi_join(cyw43_t *self, size_t ssid_len,
+                           const uint8_t *ssid, size_t key_len,
+                           const uint8_t *key, uint32_t auth_type,
+                           const uint8_t *bssid, uint32_t channel);
+extern int cyw43_wifi_get_bssid(cyw43_t *self, uint8_t bssid[6]);
+extern int cyw43_ioctl(cyw43_t *self, uint32_t cmd, size_t len, uint8_t *buf,
+                       uint32_t iface);
+
+#endif /* HOST_PICO_CYW43_ARCH_H */
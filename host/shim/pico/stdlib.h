@@ -0,0 +1,106 @@
+/*
+ * pico/stdlib.h
+ *
+ * Host stand-in for the parts of the Pico SDK used by the firmware
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+
+typedef struct
+{
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+#define PICO_OK 0
+#define PICO_ERROR_GENERIC -1
+#define PICO_ERROR_TIMEOUT -2
+
+/* Flash is an array on the host, so that XIP_BASE+offset still works */
+extern uint8_t host_flash[];
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+#define XIP_BASE ((uintptr_t)host_flash)
+
+#define __not_in_flash_func(x) x
+#define __no_inline_not_in_flash_func(x) x
+#define __uninitialized_ram(x) x
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+#define GPIO_FUNC_I2C 3
+#define GPIO_FUNC_SIO 5
+#define PICO_DEFAULT_LED_PIN 25
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+typedef void (*irq_handler_t)(void);
+
+typedef uint64_t absolute_time_t;
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+extern uint64_t time_us_64(void);
+extern uint32_t time_us_32(void);
+extern void sleep_us(uint64_t us);
+extern void busy_wait_us_32(uint32_t us);
+extern void sleep_ms(uint32_t ms);
+extern int getchar_timeout_us(uint32_t timeout_us);
+extern bool stdio_init_all(void);
+extern bool stdio_usb_connected(void);
+
+#define get_absolute_time() time_us_64()
+#define make_timeout_time_ms(ms) (time_us_64() + (ms)*1000ULL)
+#define absolute_time_diff_us(from, to) ((int64_t)((to) - (from)))
+
+extern alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                                  void *user_data, bool fire_if_past);
+extern alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+                                  void *user_data, bool fire_if_past);
+extern bool cancel_alarm(alarm_id_t id);
+
+extern void gpio_init(uint gpio);
+extern void gpio_set_dir(uint gpio, bool out);
+extern void gpio_put(uint gpio, bool value);
+extern bool gpio_get(uint gpio);
+extern void gpio_pull_up(uint gpio);
+extern void gpio_set_function(uint gpio, int fn);
+extern void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler);
+extern void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+extern uint32_t gpio_get_irq_event_mask(uint gpio);
+extern void gpio_acknowledge_irq(uint gpio, uint32_t events);
+
+#endif /* HOST_PICO_STDLIB_H */
@@ -0,0 +1,81 @@
+/*
+ * stubs.c
+ *
+ * Firmware functions which have no meaning on the host
+ *
+ * Copyright © 2026 Thomas White <taw@physics.org>
+ *
+ * This file is part of MorningTown
+ *
+ * MorningTown is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MorningTown is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <pico/stdlib.h>
+
+#include "ota.h"
+#include "supervisor.h"
+#include "retain.h"
+#include "udpctl.h"
+
+
+void ota_init() {}
+void ota_poll() {}
+void ota_checkin(int connected) {}
+
+
+int ota_state()
+{
+    return OTA_IDLE;
+}
+
+
+int ota_trial_expired()
+{
+    return 0;
+}
+
+
+void ota_show()
+{
+    printf("No firmware updates on the host\n");
+}
+
+
+void supervisor_init() {}
+void supervisor_start() {}
+void supervisor_checkin(int task) {}
+void supervisor_poll() {}
+void supervisor_stop() {}
+
+
+void supervisor_show()
+{
+    printf("No watchdog on the host\n");
+}
+
+
+/* Nothing survives a restart on the host */
+int retain_restore()
+{
+    return 0;
+}
+
+void retain_update() {}
+
+
+/* No control port in the fleet simulator */
+void udpctl_init() {}
@@ -0,0 +1,363 @@
+#!/usr/bin/env python3
+#
+# footprint.py
+#
+# Flash, RAM and stack use per module, checked against budgets
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Report flash, RAM and stack use of a firmware build, per module.
+
+Normally run by the 'footprint' build target:
+
+  footprint.py --map build/morningtown.elf.map \\
+               --objects build/CMakeFiles/morningtown.dir \\
+               --source-dir firmware \\
+               --budgets firmware/footprint_budgets.txt --profile full
+
+Sizes come from the linker map.  Stack use comes from the -fstack-usage
+(.su) files, and if the compiler also wrote -fcallgraph-info (.ci) files,
+it's the deepest call chain starting in the module rather than just the
+biggest single frame.  Calls through function pointers (e.g. lwIP
+callbacks) can't be followed, so chains through them are underestimated.
+
+With --compare OTHER.map, also shows how much each module changes
+between the two builds, e.g. the full and minimal lwIP profiles.
+
+Exits with status 1 if any budget is exceeded, unless --warn-only.
+"""
+
+import argparse
+import glob
+import os
+import re
+import sys
+from collections import defaultdict
+
+FLASH = (0x10000000, 0x11000000)
+RAM = (0x20000000, 0x20042000)
+
+# Output sections which take RAM but nothing in flash
+NOLOAD = {".bss", ".heap", ".stack_dummy", ".stack1_dummy",
+          ".uninitialized_data", ".ram_vector_table"}
+
+TIME_FUNCS = re.compile(r"(gmtime|mktime|lcltime|localtime|strftime|tzset"
+                        r"|tzcalc|tzvars|tzlock|gettzinfo|month_lengths"
+                        r"|asctime|ctime|difftime|time)(_r)?$")
+
+
+def module_of_object(path, source_dir):
+    """Module name for an input file in the linker map"""
+    m = re.match(r"(.*)\((.*)\)$", path)
+    if m:
+        lib = os.path.basename(m.group(1))
+        member = os.path.splitext(m.group(2))[0]
+        member = re.sub(r"^lib[a-z]*_a-", "", member)
+        if lib.startswith("libc"):
+            return "newlib time" if TIME_FUNCS.match(member) else "newlib"
+        if lib.startswith("libgcc"):
+            return "libgcc"
+        if lib.startswith("libm"):
+            return "libm"
+        return lib
+    return module_of_source(path, source_dir)
+
+
+def module_of_source(path, source_dir):
+    """Module name for a source or object file"""
+    p = path.replace("\\", "/")
+    if re.search(r"/(pico_)?lwip/", p):
+        return "lwIP"
+    if "cyw43" in p:
+        return "cyw43"
+    if "morningtown.dir/" in p:
+        rel = p.split("morningtown.dir/", 1)[1]
+        if "/" not in rel:
+            return re.sub(r"\.(obj|o)$", "", rel)
+        return "pico-sdk"
+    if source_dir and os.path.dirname(os.path.abspath(p)) == source_dir:
+        return os.path.basename(p)
+    if "pico-sdk" in p or "/src/rp2" in p or "/src/common" in p:
+        return "pico-sdk"
+    if re.search(r"crt[^/]*\.o$", p):
+        return "libgcc"
+    return "other"
+
+
+def region(addr):
+    if FLASH[0] <= addr < FLASH[1]:
+        return "flash"
+    if RAM[0] <= addr < RAM[1]:
+        return "ram"
+    return None
+
+
+def parse_map(path, source_dir):
+    """Returns {module: [flash, ram]}"""
+    sizes = defaultdict(lambda: [0, 0])
+    in_map = False
+    outsec = None
+    pending = None
+
+    def add(name, addr, size, obj):
+        if size == 0 or outsec == "/DISCARD/":
+            return
+        r = region(addr)
+        if r is None:
+            return
+        obj = obj.strip()
+        mod = module_of_object(obj, source_dir) if obj else "(padding)"
+        if name == "*fill*":
+            mod = "(padding)"
+        if r == "flash":
+            sizes[mod][0] += size
+        else:
+            sizes[mod][1] += size
+            if outsec not in NOLOAD:
+                sizes[mod][0] += size   # Initial values are in flash
+
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                in_map = True
+                continue
+            if not in_map or not line:
+                continue
+
+            if not line[0].isspace():
+                outsec = line.split()[0]
+                pending = None
+                continue
+
+            m = re.match(r"^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(\s+.*)?$",
+                         line)
+            if m:
+                add(m.group(1), int(m.group(2), 16), int(m.group(3), 16),
+                    m.group(4) or "")
+                pending = None
+                continue
+
+            m = re.match(r"^ ((\.|COMMON)\S*)$", line)
+            if m:
+                pending = m.group(1)
+                continue
+
+            m = re.match(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(\s+.*)?$", line)
+            if m and pending is not None:
+                add(pending, int(m.group(1), 16), int(m.group(2), 16),
+                    m.group(3) or "")
+            pending = None
+
+    return sizes
+
+
+def parse_su(objects):
+    """Returns {(function, file): frame size} and a module for each file"""
+    frames = {}
+    for su in glob.glob(os.path.join(objects, "**", "*.su"), recursive=True):
+        with open(su) as f:
+            for line in f:
+                m = re.match(r"^(.*):\d+:\d+:(\S+)\t(\d+)\t(\S+)", line)
+                if m:
+                    frames[(m.group(2), m.group(1))] = int(m.group(3))
+    return frames
+
+
+def parse_ci(objects):
+    """Returns {(function, file): (frame, [callees])} from .ci files"""
+    nodes = {}
+    edges = defaultdict(list)
+    node_re = re.compile(r'node:\s*\{\s*title:\s*"([^"]+)"\s*label:\s*"([^"]*)"')
+    edge_re = re.compile(r'edge:\s*\{\s*sourcename:\s*"([^"]+)"\s*'
+                         r'targetname:\s*"([^"]+)"')
+    for ci in glob.glob(os.path.join(objects, "**", "*.ci"), recursive=True):
+        with open(ci) as f:
+            text = f.read()
+        local = {}
+        for m in node_re.finditer(text):
+            title, label = m.group(1), m.group(2).split("\\n")
+            src = label[1].rsplit(":", 2)[0] if len(label) > 1 else ""
+            fm = re.search(r"(\d+) bytes", m.group(2))
+            if fm is None:
+                continue    # Declaration only, defined elsewhere
+            key = (title, src)
+            nodes[key] = int(fm.group(1))
+            local[title] = key
+        for m in edge_re.finditer(text):
+            src = local.get(m.group(1))
+            if src is not None:
+                edges[src].append(m.group(2))
+    return nodes, edges
+
+
+def worst_stacks(nodes, edges):
+    """Deepest call chain from each function, following direct calls"""
+    by_title = defaultdict(list)
+    for key in nodes:
+        by_title[key[0]].append(key)
+
+    depth = {}
+    active = set()
+
+    def resolve(title, caller):
+        cands = by_title.get(title, [])
+        for c in cands:
+            if c[1] == caller[1]:
+                return c
+        return cands[0] if cands else None
+
+    def visit(key):
+        if key in depth:
+            return depth[key]
+        if key in active:
+            return 0        # Recursion: counted once
+        active.add(key)
+        deepest = 0
+        for t in edges.get(key, []):
+            callee = resolve(t, key)
+            if callee is not None:
+                deepest = max(deepest, visit(callee))
+        active.discard(key)
+        depth[key] = nodes[key] + deepest
+        return depth[key]
+
+    sys.setrecursionlimit(10000)
+    for key in nodes:
+        visit(key)
+    return depth
+
+
+def stack_per_module(objects, source_dir):
+    """Returns ({module: bytes}, description)"""
+    stacks = defaultdict(int)
+    nodes, edges = parse_ci(objects)
+    if nodes:
+        for (func, src), d in worst_stacks(nodes, edges).items():
+            mod = module_of_source(src, source_dir)
+            stacks[mod] = max(stacks[mod], d)
+        return stacks, "deepest call chain"
+    for (func, src), frame in parse_su(objects).items():
+        mod = module_of_source(src, source_dir)
+        stacks[mod] = max(stacks[mod], frame)
+    return stacks, "largest frame"
+
+
+def read_budgets(path, profile):
+    """Returns {module: (flash, ram, stack)}, None meaning no limit"""
+    budgets = {}
+    section = None
+    with open(path) as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            m = re.match(r"^\[(.*)\]$", line)
+            if m:
+                section = m.group(1)
+                continue
+            if section != profile:
+                continue
+            parts = line.split()
+            vals = [None if v == "-" else int(v) for v in parts[-3:]]
+            budgets[" ".join(parts[:-3])] = tuple(vals)
+    return budgets
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--map", required=True)
+    ap.add_argument("--objects", help="Directory with .su/.ci files")
+    ap.add_argument("--source-dir", default="")
+    ap.add_argument("--budgets")
+    ap.add_argument("--profile")
+    ap.add_argument("--compare", help="Linker map of another build")
+    ap.add_argument("--warn-only", action="store_true",
+                    help="Exit with status 0 even if a budget is exceeded")
+    args = ap.parse_args()
+
+    source_dir = os.path.abspath(args.source_dir) if args.source_dir else ""
+    sizes = parse_map(args.map, source_dir)
+    stacks, stack_kind = {}, None
+    if args.objects:
+        stacks, stack_kind = stack_per_module(args.objects, source_dir)
+    budgets = {}
+    if args.budgets:
+        budgets = read_budgets(args.budgets, args.profile)
+        if not budgets:
+            print(f"No budgets for profile '{args.profile}' in {args.budgets}")
+    other = parse_map(args.compare, source_dir) if args.compare else None
+
+    total = [sum(v[0] for v in sizes.values()),
+             sum(v[1] for v in sizes.values())]
+    rows = sorted(sizes.items(), key=lambda kv: -kv[1][0])
+    rows.append(("total", total))
+    stacks["total"] = max(stacks.values(), default=0)
+
+    hdr = f"{'module':<20} {'flash':>8} {'RAM':>8} {'stack':>6}"
+    if other is not None:
+        hdr += f" {'d flash':>8} {'d RAM':>8}"
+    print(hdr)
+
+    over = []
+    for mod, (fl, ram) in rows:
+        st = stacks.get(mod)
+        line = f"{mod:<20} {fl:8} {ram:8} {st if st is not None else '-':>6}"
+        if other is not None:
+            if mod == "total":
+                o = [sum(v[0] for v in other.values()),
+                     sum(v[1] for v in other.values())]
+            else:
+                o = other.get(mod, [0, 0])
+            line += f" {o[0]-fl:+8} {o[1]-ram:+8}"
+        b = budgets.get(mod)
+        if b is not None:
+            for what, used, limit in zip(("flash", "RAM", "stack"),
+                                         (fl, ram, st), b):
+                if limit is not None and used is not None and used > limit:
+                    over.append(f"{mod}: {what} {used} > budget {limit}")
+                    line += f"  {what.upper()} OVER"
+        print(line)
+
+    if other is not None:
+        for mod in sorted(set(other) - set(sizes)):
+            o = other[mod]
+            print(f"{mod:<20} {0:8} {0:8} {'-':>6} {o[0]:+8} {o[1]:+8}")
+        print(f"'d' columns are {args.compare} minus {args.map}")
+
+    if stack_kind is not None:
+        print(f"Stack column is the {stack_kind} per module "
+              "(calls via function pointers are not followed)")
+
+    b = budgets.get("total")
+    if b is not None:
+        for what, used, limit in zip(("flash", "RAM", "stack"),
+                                     (total[0], total[1], stacks["total"]), b):
+            if limit is not None:
+                print(f"Headroom: {what} {limit-used} bytes of {limit}")
+
+    if over:
+        print("\nFootprint budget exceeded:")
+        for o in over:
+            print("  " + o)
+        if not args.warn_only:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+# mtctl.py
+#
+# Status and configuration of MorningTown units over the network
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Talk to MorningTown units using the UDP control protocol.
+
+  mtctl.py status HOST [HOST ...] [--watch SECONDS]
+  mtctl.py get HOST > settings.json
+  mtctl.py set HOST settings.json [--save]
+  mtctl.py save HOST
+
+Status requests go to all hosts at once, so polling a whole fleet takes
+about one round trip.
+"""
+
+import argparse
+import json
+import select
+import socket
+import sys
+import time
+
+import mtproto
+from mtproto import (MAGIC, VERSION, HEADER, STATUS, GET_SETTINGS,
+                     SET_SETTINGS, SAVE_SETTINGS, OTA_START, ERROR, REPLY)
+
+PORT = 4123
+
+
+class Error(Exception):
+    pass
+
+
+def exchange(sock, requests, timeout=0.5, retries=3):
+    """Send each (addr, op, payload) and return {addr: (op, payload)}"""
+    replies = {}
+    seq = int(time.time() * 1000) & 0xffffffff
+    pending = {}
+    for addr, op, payload in requests:
+        seq = (seq + 1) & 0xffffffff
+        pending[seq] = (addr, HEADER.pack(MAGIC, VERSION, op, seq) + payload)
+
+    for _ in range(retries):
+        if not pending:
+            break
+        for addr, pkt in pending.values():
+            sock.sendto(pkt, addr)
+        deadline = time.monotonic() + timeout
+        while pending:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                break
+            r, _, _ = select.select([sock], [], [], left)
+            if not r:
+                break
+            data, _ = sock.recvfrom(2048)
+            if len(data) < HEADER.size:
+                continue
+            magic, version, op, seq = HEADER.unpack_from(data)
+            if magic != MAGIC or seq not in pending:
+                continue
+            addr, _ = pending.pop(seq)
+            replies[addr] = (op & ~REPLY, data[HEADER.size:])
+    return replies
+
+
+def resolve(host):
+    return (socket.gethostbyname(host), PORT)
+
+
+def one(sock, host, op, payload=b""):
+    addr = resolve(host)
+    r = exchange(sock, [(addr, op, payload)])
+    if addr not in r:
+        raise Error(f"{host}: no reply")
+    rop, data = r[addr]
+    if rop == ERROR:
+        raise Error(f"{host}: {mtproto.error_text(data)}")
+    return data
+
+
+def cmd_status(sock, args):
+    addrs = {resolve(h): h for h in args.hosts}
+    while True:
+        t0 = time.monotonic()
+        r = exchange(sock, [(a, STATUS, b"") for a in addrs])
+        dt = time.monotonic() - t0
+        print(mtproto.STATUS_TITLE)
+        for a, h in addrs.items():
+            if a not in r:
+                print(f"{h:<20} (no reply)")
+                continue
+            if r[a][0] != STATUS:
+                print(f"{h:<20} ({mtproto.error_text(r[a][1])})")
+                continue
+            try:
+                st = mtproto.unpack_status(r[a][1])
+            except ValueError as e:
+                print(f"{h:<20} ({e})")
+                continue
+            print(f"{h:<20} " + mtproto.format_status(st))
+        print(f"{len(r)}/{len(addrs)} units answered in {dt*1000:.0f} ms")
+        if not args.watch:
+            break
+        time.sleep(max(0, args.watch - dt))
+
+
+def cmd_get(sock, args):
+    data = one(sock, args.host, GET_SETTINGS)
+    json.dump(mtproto.unpack_settings(data), sys.stdout, indent=2)
+    print()
+
+
+def cmd_set(sock, args):
+    with open(args.file) as f:
+        new = json.load(f)
+    # Start from what's there, so that a partial file works too
+    s = mtproto.unpack_settings(one(sock, args.host, GET_SETTINGS))
+    s.update(new)
+    one(sock, args.host, SET_SETTINGS, mtproto.pack_settings(s))
+    if args.save:
+        one(sock, args.host, SAVE_SETTINGS)
+
+
+def cmd_save(sock, args):
+    one(sock, args.host, SAVE_SETTINGS)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("status")
+    p.add_argument("hosts", nargs="+")
+    p.add_argument("--watch", type=float, default=0)
+    p = sub.add_parser("get")
+    p.add_argument("host")
+    p = sub.add_parser("set")
+    p.add_argument("host")
+    p.add_argument("file")
+    p.add_argument("--save", action="store_true")
+    p = sub.add_parser("save")
+    p.add_argument("host")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        {"status": cmd_status, "get": cmd_get,
+         "set": cmd_set, "save": cmd_save}[args.cmd](sock, args)
+    except Error as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
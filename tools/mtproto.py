@@ -0,0 +1,220 @@
+#
+# mtproto.py
+#
+# Wire formats shared by the MorningTown host tools
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Must match struct mt_settings (settings.h), struct mt_status (status.h)
+and the control messages (ctl.h, serialctl.c) in the firmware."""
+
+import binascii
+import struct
+
+MAX_CHANNELS = 8
+MAX_EVENTS = 12
+NTP_MAX_SERVERS = 2
+SETTINGS_SIZE = 256
+
+# Control protocol messages (see ctl.h)
+MAGIC = 0x544d
+VERSION = 2
+HEADER = struct.Struct("<HBBI")
+
+(STATUS, GET_SETTINGS, SET_SETTINGS, SAVE_SETTINGS, OTA_START, SUBSCRIBE,
+ TELEMETRY) = range(1, 8)
+ERROR = 0x7f
+REPLY = 0x80
+
+ERRORS = {1: "bad request", 2: "not permitted (needs 'remote on')",
+          3: "bad settings", 4: "update refused",
+          5: "unit speaks a different protocol version"}
+
+SUBSCRIBE_REQ = struct.Struct("<HH")
+
+_EVENT = struct.Struct("<BBHH")
+_SETTINGS_HEAD = struct.Struct("<IIi8B")
+_SETTINGS_NET = struct.Struct("<6sBBIIII")
+_SETTINGS_TAIL = struct.Struct("<32s32sI")
+_SETTINGS_HOLDOVER = struct.Struct("<HBx")
+
+# Values of mt_settings.holdover_policy (see settings.h)
+HOLDOVER_POLICIES = ["flag", "hold", "off"]
+
+# Values of mt_status.ota (see ota.h)
+OTA_STATES = ["idle", "receiving", "swap pending", "on trial", "rolled back"]
+
+# Values of mt_status.source (see clock.h)
+CLOCK_SOURCES = ["none", "console", "retained", "DS3231", "NTP"]
+
+COUNTERS = ["ntp_syncs", "ntp_failures", "ntp_served", "ntp_limited",
+            "wifi_joins", "ctl_requests", "i2c_errors", "check_max_us",
+            "leds_held"]
+# Power states with residency in mt_status (see energy.h)
+ENERGY_STATES = ["awake", "usb", "joining", "wifi", "leds"]
+
+_STATUS = struct.Struct("<IQIBBBBhBBI" + "I" * len(COUNTERS)
+                        + "I" + "I" * len(ENERGY_STATES))
+
+
+def unpack_settings(data):
+    if len(data) != SETTINGS_SIZE:
+        raise ValueError(f"settings are {len(data)} bytes, expected {SETTINGS_SIZE}")
+    off = 0
+    head = _SETTINGS_HEAD.unpack_from(data, off)
+    off += _SETTINGS_HEAD.size
+    events = []
+    for i in range(MAX_EVENTS):
+        days, channel, on_min, off_min = _EVENT.unpack_from(data, off)
+        off += _EVENT.size
+        events.append({"days": days, "channel": channel,
+                       "on": f"{on_min//60}:{on_min%60:02}",
+                       "off": f"{off_min//60}:{off_min%60:02}"})
+    net = _SETTINGS_NET.unpack_from(data, off)
+    off += _SETTINGS_NET.size
+    ntp0, ntp1, flags = _SETTINGS_TAIL.unpack_from(data, off)
+    off += _SETTINGS_TAIL.size
+    holdover_max_s, holdover_policy = _SETTINGS_HOLDOVER.unpack_from(data, off)
+    return {
+        "signature": head[0],
+        "version": head[1],
+        "utc_offset": head[2],
+        "channel_pin": list(head[3:]),
+        "events": events,
+        "net_bssid": net[0].hex(":"),
+        "net_channel": net[1],
+        "ntp_server": [n.split(b"\0")[0].decode() for n in (ntp0, ntp1)],
+        "flags": flags,
+        "holdover_max_s": holdover_max_s,
+        "holdover_policy": holdover_policy,
+        "_raw": data.hex(),
+    }
+
+
+def _minutes(hhmm):
+    h, m = hhmm.split(":")
+    return (int(h) * 60 + int(m)) % (24 * 60)
+
+
+def pack_settings(s):
+    """Pack settings, keeping anything we don't know about from '_raw'"""
+    data = bytearray(bytes.fromhex(s["_raw"]))
+    off = 0
+    _SETTINGS_HEAD.pack_into(data, off, s["signature"], s["version"],
+                             s["utc_offset"], *s["channel_pin"])
+    off += _SETTINGS_HEAD.size
+    for e in s["events"]:
+        _EVENT.pack_into(data, off, e["days"], e["channel"],
+                         _minutes(e["on"]), _minutes(e["off"]))
+        off += _EVENT.size
+    off += _SETTINGS_NET.size
+    ntp = [n.encode()[:31] for n in s["ntp_server"]]
+    _SETTINGS_TAIL.pack_into(data, off, ntp[0], ntp[1], s["flags"])
+    off += _SETTINGS_TAIL.size
+    if "holdover_max_s" in s:
+        _SETTINGS_HOLDOVER.pack_into(data, off, s["holdover_max_s"],
+                                     s["holdover_policy"])
+    return bytes(data)
+
+
+def error_text(data):
+    code = data[0] if data else None
+    return f"error {code}: {ERRORS.get(code, 'unknown')}"
+
+
+def unpack_status(data):
+    if len(data) != _STATUS.size:
+        raise ValueError(f"status is {len(data)} bytes, expected {_STATUS.size}")
+    v = _STATUS.unpack(data)
+    st = dict(zip(["uptime_ms", "utc_us", "root_disp_us", "synced",
+                   "stratum", "leds", "ds3231", "temperature", "ota",
+                   "source", "settings_version"], v))
+    n = 11 + len(COUNTERS)
+    st.update(zip(COUNTERS, v[11:n]))
+    st["uah_per_day"] = v[n]
+    st["residency_s"] = dict(zip(ENERGY_STATES, v[n+1:]))
+    return st
+
+
+STATUS_TITLE = (f"{'unit':<20} {'uptime':>9} {'source':>8} {'sync':>4} "
+                f"{'str':>3} {'disp/ms':>8} {'leds':>8} {'DS3231':>8} {'temp':>6} "
+                f"{'mAh/d':>6}  utc")
+
+
+def format_status(st):
+    import time
+    utc = (time.strftime("%Y-%m-%d %H:%M:%S",
+                         time.gmtime(st["utc_us"] / 1e6))
+           if st["utc_us"] else "unknown")
+    ds = ("absent" if not st["ds3231"] & 1 else
+          "OSF" if st["ds3231"] & 2 else "ok")
+    src = (CLOCK_SOURCES[st["source"]] if st["source"] < len(CLOCK_SOURCES)
+           else "?")
+    return (f"{st['uptime_ms']/1000:9.0f} {src:>8} "
+            f"{'yes' if st['synced'] else 'no':>4} "
+            f"{st['stratum']:3} {st['root_disp_us']/1000:8.1f} "
+            f"{st['leds']:08b} {ds:>8} {st['temperature']/100:6.2f} "
+            f"{st['uah_per_day']/1000:6.1f}  {utc}")
+
+
+def cobs_encode(data):
+    out = bytearray()
+    for block in data.split(b"\0"):
+        while len(block) >= 254:
+            out += b"\xff" + block[:254]
+            block = block[254:]
+        out += bytes([len(block) + 1]) + block
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("bad COBS")
+        out += data[i+1:i+code]
+        i += code
+        if code != 0xff and i < len(data):
+            out += b"\0"
+    return bytes(out)
+
+
+def frame(op, seq, payload=b""):
+    """A control message as sent on the console link (see serialctl.c)"""
+    msg = HEADER.pack(MAGIC, VERSION, op, seq) + payload
+    msg += struct.pack("<H", binascii.crc_hqx(msg, 0xffff))
+    return b"\0" + cobs_encode(msg) + b"\0"
+
+
+def unframe(data):
+    """Returns (op, seq, payload) from what was between two zero bytes, or
+    None if it's not a message (e.g. text from the console)"""
+    try:
+        msg = cobs_decode(data)
+    except ValueError:
+        return None
+    if len(msg) < HEADER.size + 2:
+        return None
+    if binascii.crc_hqx(msg[:-2], 0xffff) != struct.unpack("<H", msg[-2:])[0]:
+        return None
+    magic, version, op, seq = HEADER.unpack_from(msg)
+    if magic != MAGIC:
+        return None
+    return op, seq, msg[HEADER.size:-2]
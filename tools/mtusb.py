@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+#
+# mtusb.py
+#
+# Status, telemetry and configuration of MorningTown units over USB
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Talk to MorningTown units on the console link using the binary protocol.
+
+  mtusb.py status [DEVICE ...] [--watch SECONDS]
+  mtusb.py telemetry [DEVICE ...] [--period MS]
+  mtusb.py get DEVICE > settings.json
+  mtusb.py set settings.json [DEVICE ...] [--save]
+  mtusb.py save [DEVICE ...]
+
+Without any devices, all of /dev/ttyACM* are used.  Requests go to all
+units at once.  Unlike over the network, settings can be changed without
+'remote on'.
+"""
+
+import argparse
+import glob
+import json
+import os
+import select
+import sys
+import termios
+import time
+import tty
+
+import mtproto
+from mtproto import (STATUS, GET_SETTINGS, SET_SETTINGS, SAVE_SETTINGS,
+                     SUBSCRIBE, TELEMETRY, SUBSCRIBE_REQ, ERROR, REPLY)
+
+# Telemetry stops by itself this long after subscribing, in case we go
+# away without saying so.  We subscribe again well before then.
+SUBSCRIBE_S = 30
+RESUBSCRIBE_S = 10
+
+
+class Error(Exception):
+    pass
+
+
+class Unit:
+    def __init__(self, path):
+        self.path = path
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.buf = b""
+
+    def fileno(self):
+        return self.fd
+
+    def send(self, op, seq, payload=b""):
+        os.write(self.fd, mtproto.frame(op, seq, payload))
+
+    def receive(self):
+        """Returns the messages which have arrived, skipping console text"""
+        self.buf += os.read(self.fd, 4096)
+        *frames, self.buf = self.buf.split(b"\0")
+        return [m for m in map(mtproto.unframe, frames) if m is not None]
+
+
+def exchange(requests, timeout=0.5, retries=3, telemetry=None):
+    """Send each (unit, op, payload) and return {unit: (op, payload)}.
+    Telemetry which turns up meanwhile goes to telemetry(unit, payload)."""
+    replies = {}
+    seq = int(time.time() * 1000) & 0xffffffff
+    pending = {}
+    for unit, op, payload in requests:
+        seq = (seq + 1) & 0xffffffff
+        pending[seq] = (unit, op, payload)
+
+    for _ in range(retries):
+        if not pending:
+            break
+        for s, (unit, op, payload) in pending.items():
+            unit.send(op, s, payload)
+        deadline = time.monotonic() + timeout
+        while pending:
+            left = deadline - time.monotonic()
+            if left <= 0:
+                break
+            units = {u for u, _, _ in pending.values()}
+            r, _, _ = select.select(list(units), [], [], left)
+            for unit in r:
+                for op, s, payload in unit.receive():
+                    if op == TELEMETRY | REPLY:
+                        if telemetry:
+                            telemetry(unit, payload)
+                    elif s in pending and pending[s][0] is unit:
+                        pending.pop(s)
+                        replies[unit] = (op & ~REPLY, payload)
+    return replies
+
+
+def check(units, replies, op):
+    """Returns the units which answered 'op', and complains about the rest"""
+    ok = []
+    for u in units:
+        if u not in replies:
+            print(f"{u.path}: no reply", file=sys.stderr)
+        elif replies[u][0] == ERROR:
+            print(f"{u.path}: {mtproto.error_text(replies[u][1])}",
+                  file=sys.stderr)
+        elif replies[u][0] == op:
+            ok.append(u)
+    return ok
+
+
+def cmd_status(units, args):
+    while True:
+        t0 = time.monotonic()
+        r = exchange([(u, STATUS, b"") for u in units])
+        dt = time.monotonic() - t0
+        print(mtproto.STATUS_TITLE)
+        for u in units:
+            if u not in r:
+                print(f"{u.path:<20} (no reply)")
+                continue
+            if r[u][0] != STATUS:
+                print(f"{u.path:<20} ({mtproto.error_text(r[u][1])})")
+                continue
+            try:
+                st = mtproto.unpack_status(r[u][1])
+            except ValueError as e:
+                print(f"{u.path:<20} ({e})")
+                continue
+            print(f"{u.path:<20} " + mtproto.format_status(st))
+        print(f"{len(r)}/{len(units)} units answered in {dt*1000:.0f} ms")
+        if not args.watch:
+            break
+        time.sleep(max(0, args.watch - dt))
+
+
+def cmd_telemetry(units, args):
+    def show(unit, payload):
+        print(f"{unit.path:<20} " + mtproto.format_status(mtproto.unpack_status(payload)),
+              flush=True)
+
+    sub = SUBSCRIBE_REQ.pack(args.period, SUBSCRIBE_S)
+    print(mtproto.STATUS_TITLE)
+    try:
+        while True:
+            check(units, exchange([(u, SUBSCRIBE, sub) for u in units],
+                                  telemetry=show), SUBSCRIBE)
+            until = time.monotonic() + RESUBSCRIBE_S
+            while (left := until - time.monotonic()) > 0:
+                r, _, _ = select.select(units, [], [], left)
+                for u in r:
+                    for op, _, payload in u.receive():
+                        if op == TELEMETRY | REPLY:
+                            show(u, payload)
+    except KeyboardInterrupt:
+        exchange([(u, SUBSCRIBE, SUBSCRIBE_REQ.pack(0, 0)) for u in units])
+
+
+def cmd_get(units, args):
+    if len(units) != 1:
+        raise Error("get needs exactly one device")
+    r = exchange([(units[0], GET_SETTINGS, b"")])
+    if not check(units, r, GET_SETTINGS):
+        raise Error(f"{units[0].path}: couldn't get settings")
+    json.dump(mtproto.unpack_settings(r[units[0]][1]), sys.stdout, indent=2)
+    print()
+
+
+def cmd_set(units, args):
+    with open(args.file) as f:
+        new = json.load(f)
+
+    # Start from what each unit has, so that a partial file works too
+    r = exchange([(u, GET_SETTINGS, b"") for u in units])
+    ok = check(units, r, GET_SETTINGS)
+    req = []
+    for u in ok:
+        s = mtproto.unpack_settings(r[u][1])
+        s.update(new)
+        req.append((u, SET_SETTINGS, mtproto.pack_settings(s)))
+    ok = check(ok, exchange(req), SET_SETTINGS)
+    if args.save:
+        ok = check(ok, exchange([(u, SAVE_SETTINGS, b"") for u in ok]),
+                   SAVE_SETTINGS)
+    print(f"{len(ok)}/{len(units)} units done")
+    if len(ok) != len(units):
+        sys.exit(1)
+
+
+def cmd_save(units, args):
+    ok = check(units, exchange([(u, SAVE_SETTINGS, b"") for u in units]),
+               SAVE_SETTINGS)
+    if len(ok) != len(units):
+        sys.exit(1)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("status")
+    p.add_argument("devices", nargs="*")
+    p.add_argument("--watch", type=float, default=0)
+    p = sub.add_parser("telemetry")
+    p.add_argument("devices", nargs="*")
+    p.add_argument("--period", type=int, default=1000,
+                   help="Milliseconds between updates (default 1000)")
+    p = sub.add_parser("get")
+    p.add_argument("devices", nargs="*")
+    p = sub.add_parser("set")
+    p.add_argument("file")
+    p.add_argument("devices", nargs="*")
+    p.add_argument("--save", action="store_true")
+    p = sub.add_parser("save")
+    p.add_argument("devices", nargs="*")
+    args = ap.parse_args()
+
+    paths = args.devices or sorted(glob.glob("/dev/ttyACM*"))
+    if not paths:
+        print("No devices found", file=sys.stderr)
+        sys.exit(1)
+    try:
+        units = [Unit(p) for p in paths]
+        {"status": cmd_status, "telemetry": cmd_telemetry, "get": cmd_get,
+         "set": cmd_set, "save": cmd_save}[args.cmd](units, args)
+    except (Error, OSError) as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+# ntp_load.py
+#
+# Load generator for the MorningTown SNTP server
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Send SNTP requests at a fixed rate and report throughput and latency.
+
+Usage: ntp_load.py <host> [--rate N] [--duration S]
+
+Every reply is checked: mode 4, origin timestamp matching the request,
+non-zero stratum and a sane offset from the local clock.
+"""
+
+import argparse
+import select
+import socket
+import struct
+import time
+
+NTP_DELTA = 2208988800
+
+
+def ntp_to_unix(secs, frac):
+    return secs - NTP_DELTA + frac / 2**32
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=123)
+    ap.add_argument("--rate", type=float, default=20,
+                    help="Requests per second (default 20)")
+    ap.add_argument("--duration", type=float, default=10,
+                    help="Seconds to run for (default 10)")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    addr = (socket.gethostbyname(args.host), args.port)
+
+    outstanding = {}
+    latencies = []
+    offsets = []
+    bad = 0
+    sent = 0
+    seq = 0
+    start = time.monotonic()
+    next_send = start
+    end = start + args.duration
+
+    while True:
+        now = time.monotonic()
+        if now >= end + 1.0:
+            break
+
+        if now >= next_send and now < end:
+            seq += 1
+            # Use the sequence number as the transmit timestamp
+            pkt = struct.pack("!B39xQ", 0x23, seq)
+            outstanding[seq] = (time.monotonic(), time.time())
+            sock.sendto(pkt, addr)
+            sent += 1
+            next_send += 1.0 / args.rate
+
+        timeout = max(0.0, min(next_send, end + 1.0) - time.monotonic())
+        r, _, _ = select.select([sock], [], [], timeout)
+        if not r:
+            continue
+
+        while True:
+            try:
+                data, _ = sock.recvfrom(512)
+            except BlockingIOError:
+                break
+            t_mono = time.monotonic()
+            t_wall = time.time()
+            if len(data) < 48:
+                bad += 1
+                continue
+            li_vn_mode, stratum = data[0], data[1]
+            origin, = struct.unpack("!Q", data[24:32])
+            if (li_vn_mode & 7) != 4 or stratum == 0 or origin not in outstanding:
+                bad += 1
+                continue
+            t1_mono, t1_wall = outstanding.pop(origin)
+            t2 = ntp_to_unix(*struct.unpack("!II", data[32:40]))
+            t3 = ntp_to_unix(*struct.unpack("!II", data[40:48]))
+            latencies.append(t_mono - t1_mono)
+            offsets.append(((t2 - t1_wall) + (t3 - t_wall)) / 2)
+
+    n = len(latencies)
+    elapsed = min(time.monotonic(), end) - start
+    print(f"Sent {sent} requests in {elapsed:.1f} s ({sent/elapsed:.1f}/s)")
+    print(f"Good replies {n} ({n/elapsed:.1f}/s), bad {bad}, "
+          f"lost or rate-limited {len(outstanding)}")
+    if n:
+        latencies.sort()
+        ms = [x * 1000 for x in latencies]
+        print(f"Latency ms: min {ms[0]:.2f}  median {ms[n//2]:.2f}  "
+              f"p99 {ms[min(n-1, int(n*0.99))]:.2f}  max {ms[-1]:.2f}")
+        offsets.sort()
+        print(f"Offset from this host's clock: median "
+              f"{offsets[n//2]*1000:.2f} ms")
+
+
+if __name__ == "__main__":
+    main()
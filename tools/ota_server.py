@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# ota_server.py
+#
+# Send a firmware update to a MorningTown unit over the network
+#
+# Copyright © 2026 Thomas White <taw@physics.org>
+#
+# This file is part of MorningTown
+#
+# MorningTown is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# MorningTown is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with MorningTown.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Serve a firmware image to one MorningTown unit.
+
+  ota_server.py HOST build/morningtown.bin
+
+The unit must have 'remote on' set.  We listen on a TCP port, ask the
+unit to fetch the image from it, send the image and then follow the unit
+through its restart until the new firmware confirms itself (after
+joining the network and synchronising) or is rolled back.
+
+--corrupt flips one bit of the image as it's sent, to check that the
+unit refuses it.
+"""
+
+import argparse
+import hashlib
+import socket
+import struct
+import sys
+import time
+
+import mtctl
+import mtproto
+
+OTA_START = struct.Struct("<HHI32s")
+
+
+def follow(sock, host, timeout):
+    """Poll the unit's status until the update is confirmed or rolled back"""
+    addr = mtctl.resolve(host)
+    last = None
+    rebooted = False
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        r = mtctl.exchange(sock, [(addr, mtctl.STATUS, b"")])
+        if addr in r and r[addr][0] == mtctl.STATUS:
+            st = mtproto.unpack_status(r[addr][1])
+            state = mtproto.OTA_STATES[st["ota"]]
+            if state != last:
+                print(f"{host}: {state} (uptime {st['uptime_ms']/1000:.0f} s)")
+                last = state
+            if state == "on trial":
+                rebooted = True
+            elif state == "rolled back":
+                return False
+            elif rebooted and state == "idle":
+                return True
+        elif last != "no reply":
+            print(f"{host}: no reply")
+            last = "no reply"
+        time.sleep(1)
+    print(f"{host}: gave up waiting")
+    return False
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host")
+    ap.add_argument("image")
+    ap.add_argument("--port", type=int, default=0,
+                    help="TCP port to listen on (default: any)")
+    ap.add_argument("--corrupt", action="store_true")
+    ap.add_argument("--no-wait", action="store_true",
+                    help="Don't wait for the new firmware to start")
+    args = ap.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    digest = hashlib.sha256(image).digest()
+    if args.corrupt:
+        image = bytearray(image)
+        image[len(image) // 2] ^= 1
+        image = bytes(image)
+
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", args.port))
+    listener.listen(1)
+    listener.settimeout(10)
+    port = listener.getsockname()[1]
+
+    udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    print(f"{args.image}: {len(image)} bytes, SHA-256 {digest.hex()}")
+    try:
+        mtctl.one(udp, args.host, mtctl.OTA_START,
+                  OTA_START.pack(port, 0, len(image), digest))
+    except mtctl.Error as e:
+        print(f"Update refused: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    try:
+        conn, peer = listener.accept()
+    except socket.timeout:
+        print("Unit didn't connect", file=sys.stderr)
+        sys.exit(1)
+
+    t0 = time.monotonic()
+    with conn:
+        conn.settimeout(30)
+        conn.sendall(image)
+        result = conn.recv(1)
+    dt = time.monotonic() - t0
+    print(f"Sent to {peer[0]} in {dt:.1f} s ({len(image)/dt/1024:.0f} KiB/s)")
+
+    if result != b"\0":
+        print("Unit rejected the image (see its console)", file=sys.stderr)
+        sys.exit(1)
+    print("Image verified, unit is installing it")
+
+    if not args.no_wait:
+        if not follow(udp, args.host, 6 * 60):
+            sys.exit(1)
+        print("Update confirmed")
+
+
+if __name__ == "__main__":
+    main()